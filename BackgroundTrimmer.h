@@ -0,0 +1,80 @@
+#ifndef BACKGROUND_TRIMMER_H
+#define BACKGROUND_TRIMMER_H
+
+// Background Trimmer Class
+// A helper thread that unlinks the nodes removed from a set in TRIM_DEFERRED mode
+// Any set with getBacklog() and trimBacklog(id) can be trimmed (LinkFreeDurableSet, SOFTDurableSet)
+// The thread uses id of its own, the set and its memory manager need one more id than the workers
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+template <typename Set>
+class BackgroundTrimmer {
+
+  private:
+
+      static constexpr int IDLE_MICROSECONDS = 50;  // Sleep while the backlog is empty (constexpr, sleep_for binds it by reference)
+
+      Set* set;
+      int id;
+      std::thread thread;
+      std::atomic<bool> running;
+      std::atomic<long> passes;   // Passes over the set
+      std::atomic<long> trimmed;  // Nodes unlinked
+
+      void loop(void) {
+          while (this->running.load(std::memory_order_acquire)) {
+              long unlinked = 0;
+              if (this->set->getBacklog() > 0) {
+                  unlinked = this->set->trimBacklog(this->id);
+                  this->passes.fetch_add(1, std::memory_order_relaxed);
+                  this->trimmed.fetch_add(unlinked, std::memory_order_relaxed);
+              }
+              if (unlinked == 0) std::this_thread::sleep_for(std::chrono::microseconds(IDLE_MICROSECONDS));
+          }
+      }
+
+  public:
+
+      // Constructor
+      // id must not be used by any other thread while the trimmer runs
+      BackgroundTrimmer(Set* set, int id) {
+          this->set = set;
+          this->id = id;
+          this->running.store(false);
+          this->passes.store(0);
+          this->trimmed.store(0);
+      }
+
+      BackgroundTrimmer(const BackgroundTrimmer&) = delete;
+      BackgroundTrimmer& operator=(const BackgroundTrimmer&) = delete;
+
+      // Destructor
+      ~BackgroundTrimmer(void) {
+          this->stop();
+      }
+
+      void start(void) {
+          if (this->running.exchange(true)) return;
+          this->thread = std::thread(&BackgroundTrimmer::loop, this);
+      }
+
+      // Waits for the pass under way, the backlog left is trimmed by the next start or setTrimMode
+      void stop(void) {
+          if (!this->running.exchange(false)) return;
+          this->thread.join();
+      }
+
+      long getPasses(void) {
+          return this->passes.load();
+      }
+
+      long getTrimmed(void) {
+          return this->trimmed.load();
+      }
+
+};
+
+#endif
@@ -0,0 +1,802 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Benchmark Harness
+// Runs a durable set over pre-generated per-thread operation streams
+// Reports throughput, per-op latency percentiles and FLUSH counts as JSON or CSV
+// Any set with insert(key, item, id), remove(key, id), contains(key, id) and getStats() can be run
+// The counters of the set and of its memory manager are reported along with the latencies
+// What else a set has (batches, trim modes, checkpoints, ...) is detected from its members,
+// so one binary runs every set
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "PersistentMemory.h"
+#include "Workload.h"
+#include "Stats.h"
+#include "NumaTopology.h"
+#include "BackgroundTrimmer.h"
+// Features of a set, true if Set has the members the benchmark calls for them
+// insertBatch(keys, items, id), the prefill is loaded in key order with one batch
+template <typename Set, typename T, typename = void>
+struct HasBatchOperations : std::false_type {};
+
+template <typename Set, typename T>
+struct HasBatchOperations<Set, T, std::void_t<decltype(std::declval<Set&>().insertBatch(
+    std::declval<const std::vector<long>&>(), std::declval<const std::vector<T>&>(), 0))>> : std::true_type {};
+
+// setTrimMode and setMaxBacklog, with getBacklog and trimBacklog for a BackgroundTrimmer
+template <typename Set, typename = void>
+struct HasTrimModes : std::false_type {};
+
+template <typename Set>
+struct HasTrimModes<Set, std::void_t<decltype(std::declval<Set&>().setTrimMode(0)),
+                                     decltype(std::declval<Set&>().setMaxBacklog(0L)),
+                                     decltype(std::declval<Set&>().trimBacklog(0))>> : std::true_type {};
+
+// checkpoint(path, id) and restore(path)
+template <typename Set, typename = void>
+struct HasCheckpoints : std::false_type {};
+
+template <typename Set>
+struct HasCheckpoints<Set, std::void_t<decltype(std::declval<Set&>().checkpoint(std::declval<const char*>(), 0)),
+                                       decltype(std::declval<Set&>().restore(std::declval<const char*>()))>> : std::true_type {};
+
+// setReadMode(READER_FLUSH or READER_NO_FLUSH)
+template <typename Set, typename = void>
+struct HasReadModes : std::false_type {};
+
+template <typename Set>
+struct HasReadModes<Set, std::void_t<decltype(std::declval<Set&>().setReadMode(0))>> : std::true_type {};
+
+// setContentionMode(CONTENTION_RETRY or CONTENTION_ELIMINATE)
+template <typename Set, typename = void>
+struct HasContentionModes : std::false_type {};
+
+template <typename Set>
+struct HasContentionModes<Set, std::void_t<decltype(std::declval<Set&>().setContentionMode(0))>> : std::true_type {};
+
+// setSearchMode(SEARCH_FROM_HEAD or SEARCH_FROM_FINGER)
+template <typename Set, typename = void>
+struct HasSearchModes : std::false_type {};
+
+template <typename Set>
+struct HasSearchModes<Set, std::void_t<decltype(std::declval<Set&>().setSearchMode(0))>> : std::true_type {};
+
+// setElisionMode(ELISION_OFF or ELISION_RTM)
+template <typename Set, typename = void>
+struct HasElisionModes : std::false_type {};
+
+template <typename Set>
+struct HasElisionModes<Set, std::void_t<decltype(std::declval<Set&>().setElisionMode(0))>> : std::true_type {};
+
+// resetStats() of a sharded set or memory, which sums its shards in getStats()
+template <typename Part, typename = void>
+struct HasResetStats : std::false_type {};
+
+template <typename Part>
+struct HasResetStats<Part, std::void_t<decltype(std::declval<Part&>().resetStats())>> : std::true_type {};
+
+// shard(i) of a sharded set or memory, each shard with its own memory manager (--shards)
+template <typename Part, typename = void>
+struct HasShards : std::false_type {};
+
+template <typename Part>
+struct HasShards<Part, std::void_t<decltype(std::declval<Part&>().shard(0))>> : std::true_type {};
+
+// A set that is not thread safe says so with SINGLE_THREADED
+template <typename Set, typename = void>
+struct IsSingleThreaded : std::false_type {};
+
+template <typename Set>
+struct IsSingleThreaded<Set, std::void_t<decltype(Set::SINGLE_THREADED)>> : std::integral_constant<bool, Set::SINGLE_THREADED> {};
+
+struct BenchmarkConfig {
+    const char* setName;   // The set to run (see DurableSetBenchmark.cpp), or all of them
+    int numThreads;
+    long numOps;           // Length of each thread's stream
+    long durationMs;       // If set, threads cycle their stream until time is up
+    WorkloadConfig workload;
+    long prefill;          // Keys inserted (by thread 0) before the run
+    int sampleEvery;       // Every sampleEvery'th op of a thread is timed
+    int numBuckets;        // Hash sets only
+    const char* poolPath;  // Mapped memPool file, DRAM simulation if nullptr
+    int groupSize;         // GROUP_COMMIT batch size, SYNC_FLUSH if 0
+    int readMode;          // READER_FLUSH or READER_NO_FLUSH (link-free sets only)
+    bool csv;
+    bool header;           // Print the CSV header line
+    bool verify;           // Count the keys after the run
+    bool recover;          // Time a recover() after the run
+    bool threadStats;      // Report the counters of every thread, not only the totals
+    int numa;              // COMPACT or SCATTER binds the threads and places their memory, -1 if off
+    bool shardByNode;      // Hash sets only, one range of buckets per NUMA node
+    bool trimmer;          // TRIM_DEFERRED with a BackgroundTrimmer (link-free and SOFT lists only)
+    long maxBacklog;       // Removed nodes left linked before removes trim inline again
+    const char* checkpointPath;  // Image a checkpoint takes during the run and --recover restores from
+    bool eliminate;        // CONTENTION_ELIMINATE (link-free list only)
+    bool finger;           // SEARCH_FROM_FINGER (link-free and SOFT lists)
+    bool elide;            // ELISION_RTM (lock based lists)
+    int numShards;         // Shards of a sharded set, 0 if not sharded
+    bool shardByHash;      // SHARD_BY_HASH instead of SHARD_BY_RANGE (sharded set only)
+    long crashMs;          // Crash at a random time within crashMs of the start, then recover, 0 if off
+    bool tear;             // The crash tears the cells not synced yet (GROUP_COMMIT)
+};
+
+inline BenchmarkConfig defaultConfig(void) {
+    BenchmarkConfig config;
+    config.setName = "link-free";
+    config.numThreads = 4;
+    config.numOps = 100000;
+    config.durationMs = 0;
+    config.workload = defaultWorkload();
+    config.prefill = 0;
+    config.sampleEvery = 1;
+    config.numBuckets = 1024;
+    config.poolPath = nullptr;
+    config.groupSize = 0;
+    config.readMode = READER_FLUSH;
+    config.csv = false;
+    config.header = true;
+    config.verify = false;
+    config.recover = false;
+    config.threadStats = false;
+    config.numa = -1;
+    config.shardByNode = false;
+    config.trimmer = false;
+    config.maxBacklog = DEFAULT_MAX_BACKLOG;
+    config.checkpointPath = nullptr;
+    config.eliminate = false;
+    config.finger = false;
+    config.elide = false;
+    config.numShards = 0;
+    config.shardByHash = false;
+    config.crashMs = 0;
+    config.tear = false;
+    return config;
+}
+
+inline void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl
+              << "  --set NAME       the set to run (default link-free), all runs every set in turn" << std::endl
+              << "                   (see DurableSetBenchmark.cpp for the names)" << std::endl
+              << "  --threads N      worker threads (default 4)" << std::endl
+              << "  --ops N          operations per thread (default 100000)" << std::endl
+              << "  --duration MS    run for MS milliseconds instead, cycling the operations" << std::endl
+              << "  --range N        keys are drawn from [0, N) (default 100)" << std::endl
+              << "  --insert P       percent of inserts (default 50)" << std::endl
+              << "  --remove P       percent of removes (default 30), the rest are contains" << std::endl
+              << "  --prefill N      keys inserted before the run (default 0)" << std::endl
+              << "  --sample N       time every Nth operation (default 1)" << std::endl
+              << "  --seed N         seed of the operation streams (default 1)" << std::endl
+              << "  --workload KIND  uniform (default), zipf, hotspot, latest, burst or read-only" << std::endl
+              << "  --ycsb A|B|C|D   YCSB core workload (sets the kind and the mix)" << std::endl
+              << "  --theta X        skew of zipf and latest, in (0, 1) (default 0.99)" << std::endl
+              << "  --hot-keys P     percent of the keys that are hot (default 20)" << std::endl
+              << "  --hot-ops P      percent of the operations on hot keys (default 80)" << std::endl
+              << "  --burst N        inserts in a row of a burst (default 1000)" << std::endl
+              << "  --burst-every N  operations from one burst to the next (default 10000)" << std::endl
+              << "  --buckets N      buckets of the hash sets (default 1024)" << std::endl
+              << "  --pool PATH      mmap the memPool onto PATH (default DRAM simulation)" << std::endl
+              << "  --group-commit N write FLUSHes back in batches of N, synced at the end of each thread" << std::endl
+              << "  --reader-no-flush contains never flushes, it reports what the writers persisted" << std::endl
+              << "                   (link-free sets, the other sets have a single read mode)" << std::endl
+              << "  --csv            CSV instead of JSON" << std::endl
+              << "  --no-header      omit the CSV header line" << std::endl
+              << "  --verify         check the set size against the successful operations" << std::endl
+              << "  --recover        time a recover() after the run" << std::endl
+              << "  --thread-stats   report the counters of every thread (JSON only)" << std::endl
+              << "  --numa KIND      bind thread ids to CPUs, compact or scatter over the NUMA nodes," << std::endl
+              << "                   and put the memory of each thread on its node" << std::endl
+              << "  --shard-by-node  hash sets only, one range of buckets per NUMA node (with --numa)" << std::endl
+              << "  --trimmer        removes leave their node linked, a helper thread unlinks them" << std::endl
+              << "                   (link-free and SOFT lists, it takes one more id)" << std::endl
+              << "  --max-backlog N  with --trimmer, removes trim inline past N linked nodes (default 256)" << std::endl
+              << "  --checkpoint PATH a helper thread writes an image of the set to PATH during the run," << std::endl
+              << "                   --recover restores from it (link-free and SOFT lists, it takes one more id)" << std::endl
+              << "  --eliminate      an insert or remove that lost its CAS waits for an operation on its key" << std::endl
+              << "                   to complete it before it retries (link-free list)" << std::endl
+              << "  --finger         every operation searches on from where the previous one of its thread" << std::endl
+              << "                   stopped (link-free and SOFT lists)" << std::endl
+              << "  --elide          take the locks of an update in a hardware transaction (RTM) first" << std::endl
+              << "                   (lock based lists)" << std::endl
+              << "  --shards N       shards of the sharded set, each with its own memory manager (default 4)" << std::endl
+              << "  --shard-by KIND  range (default), each shard a slice of the keys, or hash" << std::endl
+              << "  --crash MS       stop every thread at its next crash point at a random time within MS" << std::endl
+              << "                   of the start, then recover (built with -DCRASH_INJECTION)" << std::endl
+              << "  --tear           with --crash, the cells FLUSHed but not synced yet are torn" << std::endl;
+}
+
+inline const char* readModeName(int mode) {
+    return (mode == READER_NO_FLUSH) ? "no-flush" : "flush";
+}
+
+inline const char* trimModeName(bool trimmer) {
+    return trimmer ? "deferred" : "inline";
+}
+
+inline const char* contentionModeName(bool eliminate) {
+    return eliminate ? "eliminate" : "retry";
+}
+
+inline const char* searchModeName(bool finger) {
+    return finger ? "finger" : "head";
+}
+
+inline const char* elisionModeName(bool elide) {
+    return elide ? "rtm" : "off";
+}
+
+inline const char* shardModeName(const BenchmarkConfig& config) {
+    if (config.numShards == 0) return "none";
+    return config.shardByHash ? "hash" : "range";
+}
+
+// Ids the set and the memory manager are created with, the trimmer takes the one after the workers
+// and the checkpoint thread the one after that
+inline int checkpointID(const BenchmarkConfig& config) {
+    return config.trimmer ? config.numThreads + 1 : config.numThreads;
+}
+
+inline int numSetIDs(const BenchmarkConfig& config) {
+    return (config.checkpointPath != nullptr) ? checkpointID(config) + 1 : checkpointID(config);
+}
+
+// Returns false (after printing the usage) if the arguments are not valid
+inline bool parseArgs(int argc, char* argv[], BenchmarkConfig* config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--help") {
+            printUsage(argv[0]);
+            return false;
+        }
+        else if (arg == "--csv") config->csv = true;
+        else if (arg == "--no-header") config->header = false;
+        else if (arg == "--verify") config->verify = true;
+        else if (arg == "--recover") config->recover = true;
+        else if (arg == "--thread-stats") config->threadStats = true;
+        else if (arg == "--shard-by-node") config->shardByNode = true;
+        else if (arg == "--reader-no-flush") config->readMode = READER_NO_FLUSH;
+        else if (arg == "--trimmer") config->trimmer = true;
+        else if (arg == "--eliminate") config->eliminate = true;
+        else if (arg == "--finger") config->finger = true;
+        else if (arg == "--elide") config->elide = true;
+        else if (arg == "--tear") config->tear = true;
+        else if (arg == "--checkpoint" && hasValue) config->checkpointPath = argv[++i];
+        else if (arg == "--set" && hasValue) config->setName = argv[++i];
+        else if (arg == "--numa" && hasValue) {
+            std::string kind = argv[++i];
+            if (kind == "compact") config->numa = COMPACT;
+            else if (kind == "scatter") config->numa = SCATTER;
+            else {
+                std::cerr << "Unknown NUMA placement " << kind << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        else if (arg == "--shard-by" && hasValue) {
+            std::string kind = argv[++i];
+            if (kind == "range") config->shardByHash = false;
+            else if (kind == "hash") config->shardByHash = true;
+            else {
+                std::cerr << "Unknown shard partitioning " << kind << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        else if (arg == "--pool" && hasValue) config->poolPath = argv[++i];
+        else if (arg == "--workload" && hasValue) {
+            config->workload.kind = workloadKind(argv[++i]);
+            if (config->workload.kind == -1) {
+                std::cerr << "Unknown workload " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        else if (arg == "--ycsb" && hasValue) {
+            if (!ycsbPreset(argv[++i], &config->workload)) {
+                std::cerr << "Unknown YCSB workload " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        else if (arg == "--theta" && hasValue) {
+            char* end = nullptr;
+            config->workload.theta = std::strtod(argv[++i], &end);
+            if (*end != '\0' || !(config->workload.theta > 0 && config->workload.theta < 1)) {
+                std::cerr << "theta must be in (0, 1): " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+        else if (hasValue && arg.compare(0, 2, "--") == 0) {
+            char* end = nullptr;
+            long value = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || value < 0) {
+                std::cerr << "Not a valid value for " << arg << ": " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+            if (arg == "--threads") config->numThreads = (int) value;
+            else if (arg == "--ops") config->numOps = value;
+            else if (arg == "--duration") config->durationMs = value;
+            else if (arg == "--range") config->workload.keyRange = value;
+            else if (arg == "--insert") config->workload.insertChance = (int) value;
+            else if (arg == "--remove") config->workload.removeChance = (int) value;
+            else if (arg == "--prefill") config->prefill = value;
+            else if (arg == "--sample") config->sampleEvery = (int) value;
+            else if (arg == "--seed") config->workload.seed = (unsigned int) value;
+            else if (arg == "--hot-keys") config->workload.hotKeyPercent = (int) value;
+            else if (arg == "--hot-ops") config->workload.hotOpPercent = (int) value;
+            else if (arg == "--burst") config->workload.burstLength = value;
+            else if (arg == "--burst-every") config->workload.burstPeriod = value;
+            else if (arg == "--buckets") config->numBuckets = (int) value;
+            else if (arg == "--group-commit") config->groupSize = (int) value;
+            else if (arg == "--max-backlog") config->maxBacklog = value;
+            else if (arg == "--shards") config->numShards = (int) value;
+            else if (arg == "--crash") config->crashMs = value;
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    WorkloadConfig& workload = config->workload;
+    if (config->numThreads < 1 || config->numOps < 1 || workload.keyRange < 1 ||
+        config->sampleEvery < 1 || workload.insertChance + workload.removeChance > 100 ||
+        config->prefill > workload.keyRange || workload.hotKeyPercent > 100 ||
+        workload.hotOpPercent > 100 || workload.burstPeriod < 1) {
+        std::cerr << "Need at least one thread, one operation and one key, "
+                  << "insert + remove at most 100, prefill at most range, "
+                  << "hot percents at most 100 and a burst period" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// Latencies (nanoseconds) of one kind of operation
+struct LatencySummary {
+    long count;       // Operations run (timed or not)
+    long succeeded;
+    long p50;
+    long p90;
+    long p99;
+    long p999;
+    long max;
+};
+
+template <typename Set, typename Memory, typename T>
+class Benchmark {
+
+  private:
+
+      // Written only by its own thread
+      struct alignas(CACHE_LINE_SIZE) ThreadResult {
+          long count[NUM_OP_TYPES];
+          long succeeded[NUM_OP_TYPES];
+          std::vector<long> latencies[NUM_OP_TYPES];
+          long counters[NUM_STAT_COUNTERS];  // Of the set and the memory manager, taken after the run
+      };
+
+      Set* set;
+      Memory* mem;
+      std::atomic<bool>* abortFlag;  // The abortFlag of the set, set by a crash
+      BenchmarkConfig config;
+      std::vector<std::vector<Operation>> streams;  // One per thread
+      std::vector<ThreadResult> results;
+      long trimmerCounters[NUM_STAT_COUNTERS];  // Of the trimmer's id, in the totals only
+      long prefilled;
+      long prefillFlushes;
+      double seconds;
+      double recoverSeconds;
+      double checkpointSeconds;  // Of the checkpoint taken during the run, 0 if none
+      bool crashed;              // The crash happened before every thread was done
+      double crashSeconds;       // From the start to the crash
+      long tornCells;
+      long recoveredKeys;        // Durable keys found by the recover after the crash
+      long lostKeys;             // Linked before the crash, not durable
+      long extraKeys;            // Durable, not linked before the crash
+
+      void runThread(int id, std::atomic<bool>* start, std::atomic<bool>* stop) {
+          ThreadResult& result = this->results.at(id);
+          std::vector<Operation>& stream = this->streams.at(id);
+          long numOps = stream.size();
+          long sampleEvery = this->config.sampleEvery;
+          if (NumaTopology::placement() != nullptr)
+              NumaTopology::placement()->bindThread(id);
+          bool timed = (this->config.durationMs > 0);
+          for (int i = 0; i < NUM_OP_TYPES; i++) {
+              result.count[i] = 0;
+              result.succeeded[i] = 0;
+              result.latencies[i].reserve(timed ? 1024 : numOps / sampleEvery + 1);
+          }
+          while (!start->load(std::memory_order_acquire));
+          for (long i = 0; !timed || !stop->load(std::memory_order_relaxed); i++) {
+              if (!timed && i == numOps) break;
+              if (CRASH_INJECTION_ENABLED && this->abortFlag->load(std::memory_order_relaxed))
+                  return;  // Crashed, nothing more is synced
+              const Operation& op = stream[i % numOps];
+              bool sample = (i % sampleEvery == 0);
+              std::chrono::steady_clock::time_point begin;
+              if (sample) begin = std::chrono::steady_clock::now();
+              bool success;
+              if (op.type == INSERT_OP)
+                  success = this->set->insert(op.key, (T) op.key, id);
+              else if (op.type == REMOVE_OP)
+                  success = this->set->remove(op.key, id);
+              else
+                  success = this->set->contains(op.key, id);
+              if (sample) {
+                  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin;
+                  result.latencies[op.type].push_back(elapsed.count());
+              }
+              result.count[op.type] += 1;
+              if (success) result.succeeded[op.type] += 1;
+          }
+          this->mem->sync(id);  // Part of the run, the last batch becomes durable
+      }
+
+      // Sorts the latencies of every thread for one kind of operation (all kinds if type == NUM_OP_TYPES)
+      LatencySummary summarize(int type) {
+          LatencySummary summary = LatencySummary();
+          std::vector<long> latencies;
+          for (int i = 0; i < this->config.numThreads; i++) {
+              for (int j = 0; j < NUM_OP_TYPES; j++) {
+                  if (type != NUM_OP_TYPES && type != j) continue;
+                  ThreadResult& result = this->results.at(i);
+                  summary.count += result.count[j];
+                  summary.succeeded += result.succeeded[j];
+                  latencies.insert(latencies.end(), result.latencies[j].begin(), result.latencies[j].end());
+              }
+          }
+          if (latencies.empty()) return summary;
+          std::sort(latencies.begin(), latencies.end());
+          long last = latencies.size() - 1;
+          summary.p50 = latencies.at(last * 50 / 100);
+          summary.p90 = latencies.at(last * 90 / 100);
+          summary.p99 = latencies.at(last * 99 / 100);
+          summary.p999 = latencies.at(last * 999 / 1000);
+          summary.max = latencies.at(last);
+          return summary;
+      }
+
+  public:
+
+      // Constructor, abortFlag is the one the set was created with
+      Benchmark(Set* set, Memory* mem, std::atomic<bool>* abortFlag, const BenchmarkConfig& config)
+          : results(config.numThreads) {
+          this->set = set;
+          this->mem = mem;
+          this->abortFlag = abortFlag;
+          this->config = config;
+          this->prefilled = 0;
+          this->prefillFlushes = 0;
+          this->seconds = 0;
+          this->recoverSeconds = 0;
+          this->checkpointSeconds = 0;
+          this->crashed = false;
+          this->crashSeconds = 0;
+          this->tornCells = 0;
+          this->recoveredKeys = 0;
+          this->lostKeys = 0;
+          this->extraKeys = 0;
+          for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+              this->trimmerCounters[j] = 0;
+      }
+
+      // Each thread has its own seeded stream, generated in parallel
+      void generate(void) {
+          WorkloadGenerator generator(this->config.workload, this->config.numThreads);
+          this->streams = std::vector<std::vector<Operation>>(this->config.numThreads);
+          std::vector<std::thread> threads;
+          for (int i = 0; i < this->config.numThreads; i++)
+              threads.push_back(std::thread(&WorkloadGenerator::generate, &generator, i,
+                                            this->config.numOps, &this->streams.at(i)));
+          for (int i = 0; i < this->config.numThreads; i++)
+              threads.at(i).join();
+      }
+
+      // Inserts config.prefill distinct keys as thread 0, not timed
+      // Sets with batch operations load them in key order with one insertBatch
+      void prefill(void) {
+          std::mt19937 generator(this->config.workload.seed - 1);
+          std::uniform_int_distribution<long> keys(0, this->config.workload.keyRange - 1);
+          std::vector<bool> chosen(this->config.workload.keyRange, false);
+          std::vector<long> prefillKeys;
+          long attempts = 0;
+          while ((long) prefillKeys.size() < this->config.prefill && attempts < 4 * this->config.workload.keyRange) {
+              long key = (attempts < 2 * this->config.workload.keyRange) ? keys(generator) : attempts % this->config.workload.keyRange;
+              if (!chosen.at(key)) {
+                  chosen.at(key) = true;
+                  prefillKeys.push_back(key);
+              }
+              attempts += 1;
+          }
+          if constexpr (HasBatchOperations<Set, T>::value) {
+              std::sort(prefillKeys.begin(), prefillKeys.end());
+              std::vector<T> items(prefillKeys.begin(), prefillKeys.end());
+              this->prefilled = this->set->insertBatch(prefillKeys, items, 0);
+          } else {
+              for (long i = 0; i < (long) prefillKeys.size(); i++) {
+                  long key = prefillKeys.at(i);
+                  if (this->set->insert(key, (T) key, 0)) this->prefilled += 1;
+              }
+          }
+          this->mem->sync(0);
+          this->prefillFlushes = this->mem->getStats()->total(FLUSHES_ISSUED);
+
+          // Only the run is counted, a sharded set or memory resets every shard
+          if constexpr (HasResetStats<Set>::value) this->set->resetStats();
+          else this->set->getStats()->reset();
+          if constexpr (HasResetStats<Memory>::value) this->mem->resetStats();
+          else this->mem->getStats()->reset();
+      }
+
+      // Takes one checkpoint as soon as the workers start (sets with checkpoints only)
+      void runCheckpoint(std::atomic<bool>* start) {
+          while (!start->load(std::memory_order_acquire))
+              std::this_thread::yield();
+          std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+          bool written = this->set->checkpoint(this->config.checkpointPath, checkpointID(this->config));
+          std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+          this->checkpointSeconds = elapsed.count();
+          if (!written) std::cerr << "Could not write the checkpoint " << this->config.checkpointPath << std::endl;
+      }
+
+      // Sets the abortFlag at a random time within crashMs of the start, unless the workers are done first
+      // Every thread then stops at its next crash point (see CRASH_POINT)
+      void runCrash(std::atomic<bool>* start, std::atomic<bool>* done) {
+          std::mt19937 generator(this->config.workload.seed);
+          std::uniform_int_distribution<long> delays(1, this->config.crashMs * 1000);
+          std::chrono::microseconds delay(delays(generator));
+          while (!start->load(std::memory_order_acquire))
+              std::this_thread::yield();
+          std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+          std::chrono::steady_clock::time_point deadline = begin + delay;
+          while (!done->load() && std::chrono::steady_clock::now() < deadline)
+              std::this_thread::sleep_for(std::min(std::chrono::microseconds(1000), delay));
+          if (done->load()) return;
+          this->abortFlag->store(true);
+          std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+          this->crashSeconds = elapsed.count();
+          this->crashed = true;
+      }
+
+      // Starts every thread at once and waits for all of them
+      void run(void) {
+          std::atomic<bool> start(false);
+          std::atomic<bool> stop(false);
+          std::vector<std::thread> threads;
+          for (int i = 0; i < this->config.numThreads; i++)
+              threads.push_back(std::thread(&Benchmark::runThread, this, i, &start, &stop));
+          BackgroundTrimmer<Set>* trimmer = nullptr;
+          if constexpr (HasTrimModes<Set>::value) {
+              if (this->config.trimmer) {
+                  trimmer = new BackgroundTrimmer<Set>(this->set, this->config.numThreads);
+                  trimmer->start();
+              }
+          }
+          std::thread checkpointer;
+          if constexpr (HasCheckpoints<Set>::value) {
+              if (this->config.checkpointPath != nullptr)
+                  checkpointer = std::thread(&Benchmark::runCheckpoint, this, &start);
+          }
+          std::atomic<bool> done(false);
+          std::thread crasher;
+          if (CRASH_INJECTION_ENABLED && this->config.crashMs > 0)
+              crasher = std::thread(&Benchmark::runCrash, this, &start, &done);
+          std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+          start.store(true, std::memory_order_release);
+          if (this->config.durationMs > 0) {
+              std::this_thread::sleep_for(std::chrono::milliseconds(this->config.durationMs));
+              stop.store(true, std::memory_order_relaxed);
+          }
+          for (int i = 0; i < this->config.numThreads; i++)
+              threads.at(i).join();
+          std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+          this->seconds = elapsed.count();
+          done.store(true);
+          if (crasher.joinable()) crasher.join();
+          if (checkpointer.joinable()) checkpointer.join();
+          if constexpr (HasTrimModes<Set>::value) {
+              if (trimmer != nullptr) {
+                  trimmer->stop();
+                  delete trimmer;
+              }
+          }
+          OperationStats* setStats = this->set->getStats();
+          OperationStats* memStats = this->mem->getStats();
+          for (int i = 0; i < this->config.numThreads; i++) {
+              for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                  this->results.at(i).counters[j] = setStats->get(i, j) + memStats->get(i, j);
+          }
+          if (this->config.trimmer) {
+              int id = this->config.numThreads;
+              for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                  this->trimmerCounters[j] = setStats->get(id, j) + memStats->get(id, j);
+          }
+      }
+
+      // A restore from the checkpoint if one was taken (not run concurrently)
+      // After a crash the unsynced cells are torn first (--tear), and the recovered keys are
+      // compared with the ones that were linked
+      void timeRecover(void) {
+          if (this->crashed && this->config.tear) this->tornCells = this->mem->tearUnsynced();
+          this->abortFlag->store(false);  // Rebooted
+          std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+          bool restoring = false;  // restore() recovers by itself if there is no image
+          if constexpr (HasCheckpoints<Set>::value) {
+              restoring = (this->config.checkpointPath != nullptr);
+              if (restoring && !this->set->restore(this->config.checkpointPath))
+                  std::cerr << "No checkpoint at " << this->config.checkpointPath << ", recovered instead" << std::endl;
+          }
+          if (!restoring) this->set->recover();
+          std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+          this->recoverSeconds = elapsed.count();
+          if (this->crashed) this->compareRecovered();
+      }
+
+      // Every thread stopped in at most one operation and each torn cell holds at most one key,
+      // more keys lost (or left durable) than that is reported
+      void compareRecovered(void) {
+          std::vector<long> linked;
+          std::vector<long> durable;
+          this->set->recoveredKeys(&linked, &durable);
+          std::sort(linked.begin(), linked.end());
+          std::sort(durable.begin(), durable.end());
+          std::vector<long> difference;
+          std::set_difference(linked.begin(), linked.end(), durable.begin(), durable.end(), std::back_inserter(difference));
+          this->lostKeys = difference.size();
+          difference.clear();
+          std::set_difference(durable.begin(), durable.end(), linked.begin(), linked.end(), std::back_inserter(difference));
+          this->extraKeys = difference.size();
+          this->recoveredKeys = durable.size();
+          long bound = numSetIDs(this->config) + this->tornCells;
+          if (this->lostKeys + this->extraKeys > bound)
+              std::cerr << "Recovery lost " << this->lostKeys << " and kept " << this->extraKeys
+                        << " keys, more than the " << bound << " operations and torn cells cut short" << std::endl;
+      }
+
+      // Keys present, found with contains (not run concurrently)
+      long countKeys(void) {
+          long count = 0;
+          for (long key = 0; key < this->config.workload.keyRange; key++) {
+              if (this->set->contains(key, 0)) count += 1;
+          }
+          return count;
+      }
+
+      // Successful inserts less successful removes, plus the prefill
+      long expectedSize(void) {
+          LatencySummary inserts = this->summarize(INSERT_OP);
+          LatencySummary removes = this->summarize(REMOVE_OP);
+          return this->prefilled + inserts.succeeded - removes.succeeded;
+      }
+
+      // One JSON object or one CSV row (after the header if asked for)
+      void report(std::ostream& out, const char* setName) {
+          static const char* names[NUM_OP_TYPES + 1] = { "insert", "remove", "contains", "all" };
+          LatencySummary summaries[NUM_OP_TYPES + 1];
+          for (int i = 0; i <= NUM_OP_TYPES; i++)
+              summaries[i] = this->summarize(i);
+          long counters[NUM_STAT_COUNTERS];
+          for (int j = 0; j < NUM_STAT_COUNTERS; j++) {
+              counters[j] = this->trimmerCounters[j];
+              for (int i = 0; i < this->config.numThreads; i++)
+                  counters[j] += this->results.at(i).counters[j];
+          }
+          long flushes = counters[FLUSHES_ISSUED];
+          long persistNanoseconds = (counters[PERSIST_SAMPLES] > 0) ? counters[PERSIST_NANOSECONDS] / counters[PERSIST_SAMPLES] : 0;
+          long totalOps = summaries[NUM_OP_TYPES].count;
+          double opsPerSec = (this->seconds > 0) ? totalOps / this->seconds : 0;
+          double flushesPerOp = (totalOps > 0) ? (double) flushes / totalOps : 0;
+          long size = this->config.verify ? this->countKeys() : -1;
+          long expected = this->expectedSize();
+
+          if (this->config.csv) {
+              if (this->config.header) {
+                  out << "set,threads,ops,durationMs,workload,theta,keyRange,insertChance,removeChance,prefill,"
+                      << "groupSize,readMode,trimMode,contentionMode,searchMode,elisionMode,shards,shardMode,seconds,opsPerSec,flushes,flushesPerOp,prefillFlushes";
+                  for (int i = 0; i <= NUM_OP_TYPES; i++) {
+                      out << "," << names[i] << "Count," << names[i] << "Succeeded,"
+                          << names[i] << "P50," << names[i] << "P90," << names[i] << "P99,"
+                          << names[i] << "P999," << names[i] << "Max";
+                  }
+                  for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                      out << "," << statName(j);
+                  out << ",persistLatency,expectedSize,size,recoverSeconds,checkpointSeconds,"
+                      << "crashed,crashSeconds,tornCells,recoveredKeys,lostKeys,extraKeys" << std::endl;
+              }
+              out << setName << "," << this->config.numThreads << "," << totalOps << ","
+                  << this->config.durationMs << "," << workloadName(this->config.workload.kind) << ","
+                  << this->config.workload.theta << "," << this->config.workload.keyRange << ","
+                  << this->config.workload.insertChance << "," << this->config.workload.removeChance << ","
+                  << this->prefilled << "," << this->config.groupSize << ","
+                  << readModeName(this->config.readMode) << "," << trimModeName(this->config.trimmer) << ","
+                  << contentionModeName(this->config.eliminate) << "," << searchModeName(this->config.finger) << ","
+                  << elisionModeName(this->config.elide) << ","
+                  << std::max(this->config.numShards, 1) << "," << shardModeName(this->config) << ","
+                  << this->seconds << ","
+                  << opsPerSec << ","
+                  << flushes << "," << flushesPerOp << "," << this->prefillFlushes;
+              for (int i = 0; i <= NUM_OP_TYPES; i++) {
+                  LatencySummary& s = summaries[i];
+                  out << "," << s.count << "," << s.succeeded << "," << s.p50 << "," << s.p90
+                      << "," << s.p99 << "," << s.p999 << "," << s.max;
+              }
+              for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                  out << "," << counters[j];
+              out << "," << persistNanoseconds << "," << expected << "," << size << ","
+                  << this->recoverSeconds << "," << this->checkpointSeconds << ","
+                  << this->crashed << "," << this->crashSeconds << "," << this->tornCells << ","
+                  << this->recoveredKeys << "," << this->lostKeys << "," << this->extraKeys << std::endl;
+              return;
+          }
+
+          out << "{\"set\":\"" << setName << "\",\"threads\":" << this->config.numThreads
+              << ",\"ops\":" << totalOps << ",\"durationMs\":" << this->config.durationMs
+              << ",\"workload\":\"" << workloadName(this->config.workload.kind)
+              << "\",\"theta\":" << this->config.workload.theta
+              << ",\"keyRange\":" << this->config.workload.keyRange
+              << ",\"insertChance\":" << this->config.workload.insertChance
+              << ",\"removeChance\":" << this->config.workload.removeChance
+              << ",\"prefill\":" << this->prefilled << ",\"groupSize\":" << this->config.groupSize
+              << ",\"readMode\":\"" << readModeName(this->config.readMode) << "\""
+              << ",\"trimMode\":\"" << trimModeName(this->config.trimmer) << "\""
+              << ",\"contentionMode\":\"" << contentionModeName(this->config.eliminate) << "\""
+              << ",\"searchMode\":\"" << searchModeName(this->config.finger) << "\""
+              << ",\"elisionMode\":\"" << elisionModeName(this->config.elide) << "\""
+              << ",\"shards\":" << std::max(this->config.numShards, 1)
+              << ",\"shardMode\":\"" << shardModeName(this->config) << "\""
+              << ",\"seconds\":" << this->seconds
+              << ",\"opsPerSec\":" << opsPerSec << ",\"flushes\":" << flushes
+              << ",\"flushesPerOp\":" << flushesPerOp << ",\"prefillFlushes\":" << this->prefillFlushes;
+          for (int i = 0; i <= NUM_OP_TYPES; i++) {
+              LatencySummary& s = summaries[i];
+              out << ",\"" << names[i] << "\":{\"count\":" << s.count << ",\"succeeded\":" << s.succeeded
+                  << ",\"p50\":" << s.p50 << ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99
+                  << ",\"p999\":" << s.p999 << ",\"max\":" << s.max << "}";
+          }
+          out << ",\"stats\":{";
+          for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+              out << (j > 0 ? "," : "") << "\"" << statName(j) << "\":" << counters[j];
+          out << "},\"persistLatency\":" << persistNanoseconds;
+          if (this->config.threadStats) {
+              out << ",\"threadStats\":[";
+              for (int i = 0; i < this->config.numThreads; i++) {
+                  out << (i > 0 ? ",{" : "{");
+                  for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                      out << (j > 0 ? "," : "") << "\"" << statName(j) << "\":" << this->results.at(i).counters[j];
+                  out << "}";
+              }
+              out << "]";
+          }
+          out << ",\"expectedSize\":" << expected << ",\"size\":" << size
+              << ",\"recoverSeconds\":" << this->recoverSeconds
+              << ",\"checkpointSeconds\":" << this->checkpointSeconds
+              << ",\"crashed\":" << (this->crashed ? "true" : "false")
+              << ",\"crashSeconds\":" << this->crashSeconds << ",\"tornCells\":" << this->tornCells
+              << ",\"recoveredKeys\":" << this->recoveredKeys << ",\"lostKeys\":" << this->lostKeys
+              << ",\"extraKeys\":" << this->extraKeys << "}" << std::endl;
+      }
+
+};
+
+#endif
@@ -0,0 +1,343 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Checkpoint Log and Image
+// A checkpoint writes the live cells of a set into one key ordered image file while the
+// operations go on. From then on every section logs the cells FLUSHed into it (each
+// cell once per checkpoint), so a restore reads the image and the logged cells only
+// instead of scanning every cell of every section
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PersistentMemory.h"
+#include "NodePool.h"
+
+// The cells FLUSHed into each section since the last checkpoint began
+// Generation g logs into the entries of parity g % 2, the other parity still holds what the
+// previous generation logged until the image of g is written. An entry is a cell index + 1,
+// 0 is empty. Entries of older generations left in a log only make a restore read a cell again
+class CheckpointLog {
+
+  public:
+
+      // The log of one section, padded so sections never share its line
+      struct alignas(CACHE_LINE_SIZE) SectionLog {
+          ChunkedArena<std::atomic<std::uint32_t>>* marks;  // Generation each cell was last logged in (DRAM)
+          ChunkedArena<std::int32_t>* entries[2];            // One log per parity of the generation
+          std::atomic<long> count[2];                         // Entries handed out in each log
+          std::atomic<int> writers[2];                        // Appends under way in each log
+      };
+
+  private:
+
+      std::vector<SectionLog> sections;
+      int numSections;
+      bool enabled;                          // Set by enable(), nothing is logged before
+      bool mapped;                           // The entries live in a mapped region
+      std::atomic<std::uint32_t> generation; // Of the last checkpoint begun, 0 if none
+      std::atomic<bool> busy;                // A checkpoint is under way
+
+      // Zeroes the log of parity in every section, none of its appends may be under way
+      void clear(int parity) {
+          for (int i = 0; i < this->numSections; i++) {
+              SectionLog& log = this->sections.at(i);
+              long count = log.count[parity].load();
+              for (long j = 0; j < count; j++)
+                  *log.entries[parity]->at(j) = 0;
+              if (this->mapped && count > 0)
+                  Persistence::WRITEBACK(log.entries[parity]->at(0), sizeof(std::int32_t) * (std::size_t) count);
+              log.count[parity].store(0);
+          }
+          if (this->mapped) Persistence::FENCE();
+      }
+
+      void init(int numSections) {
+          this->sections = std::vector<SectionLog>(numSections);
+          this->numSections = numSections;
+          this->enabled = false;
+          this->generation.store(0);
+          this->busy.store(false);
+          for (int i = 0; i < numSections; i++) {
+              for (int p = 0; p < 2; p++) {
+                  this->sections.at(i).count[p].store(0);
+                  this->sections.at(i).writers[p].store(0);
+              }
+          }
+      }
+
+  public:
+
+      // Constructor, create or adopt builds the logs
+      CheckpointLog(void) {
+          this->numSections = 0;
+          this->enabled = false;
+          this->mapped = false;
+          this->generation.store(0);
+          this->busy.store(false);
+      }
+
+      CheckpointLog(const CheckpointLog&) = delete;
+      CheckpointLog& operator=(const CheckpointLog&) = delete;
+
+      // Destructor
+      ~CheckpointLog(void) {
+          for (int i = 0; i < this->numSections; i++) {
+              delete this->sections.at(i).marks;
+              delete this->sections.at(i).entries[0];
+              delete this->sections.at(i).entries[1];
+          }
+      }
+
+      // Bytes of the entries of numSections sections of numCells cells (see adopt)
+      static std::size_t regionBytes(int numSections, long numCells) {
+          return sizeof(std::int32_t) * 2 * (std::size_t) numSections * (std::size_t) numCells;
+      }
+
+      // Logs that grow along with their sections (DRAM_SIMULATION)
+      void create(int numSections, long chunkSize) {
+          this->init(numSections);
+          this->mapped = false;
+          for (int i = 0; i < numSections; i++) {
+              SectionLog& log = this->sections.at(i);
+              log.marks = new ChunkedArena<std::atomic<std::uint32_t>>(chunkSize);
+              log.entries[0] = new ChunkedArena<std::int32_t>(chunkSize);
+              log.entries[1] = new ChunkedArena<std::int32_t>(chunkSize);
+          }
+      }
+
+      // Logs of numCells entries each in region (regionBytes long, i.e. behind the cells of a mapped pool)
+      void adopt(int numSections, std::int32_t* region, long numCells) {
+          this->init(numSections);
+          this->mapped = true;
+          for (int i = 0; i < numSections; i++) {
+              SectionLog& log = this->sections.at(i);
+              log.marks = new ChunkedArena<std::atomic<std::uint32_t>>(numCells);
+              log.marks->reserve(numCells - 1);
+              log.entries[0] = new ChunkedArena<std::int32_t>(region + (std::size_t) (2 * i) * numCells, numCells);
+              log.entries[1] = new ChunkedArena<std::int32_t>(region + (std::size_t) (2 * i + 1) * numCells, numCells);
+          }
+      }
+
+      // FLUSHes are logged from now on (once a checkpoint begins)
+      // Will not be called concurrently
+      void enable(void) {
+          this->enabled = true;
+      }
+
+      bool isEnabled(void) {
+          return this->enabled;
+      }
+
+      // Makes room for cell index of section, along with the cell itself
+      // Only called by the owner of the section
+      bool reserve(int section, long index) {
+          SectionLog& log = this->sections.at(section);
+          return log.marks->reserve(index) && log.entries[0]->reserve(index) && log.entries[1]->reserve(index);
+      }
+
+      // Called by a FLUSH once it wrote the cell index of section, from any thread
+      // The cell is written before the generation is read, so a FLUSH that logs into the previous
+      // generation wrote its cell before the checkpoint began and the scan sees it
+      // Returns the entry to write back along with the cell, nullptr if none was added
+      std::int32_t* record(int section, long index) {
+          if (!this->enabled) return nullptr;
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          std::uint32_t current = this->generation.load();
+          if (current == 0) return nullptr;
+          SectionLog& log = this->sections[section];
+          std::atomic<std::uint32_t>* mark = log.marks->at(index);
+          if (mark->load(std::memory_order_relaxed) == current || mark->exchange(current) == current)
+              return nullptr;  // Already logged in this generation
+          int parity = current % 2;
+          log.writers[parity].fetch_add(1);
+          if (this->generation.load() != current) {  // The log may be cleared already, the scan saw the cell
+              log.writers[parity].fetch_sub(1);
+              return nullptr;
+          }
+          long position = log.count[parity].fetch_add(1);  // Each cell once per generation, below capacity
+          std::int32_t* entry = log.entries[parity]->at(position);
+          *entry = (std::int32_t) index + 1;
+          log.writers[parity].fetch_sub(1);
+          return entry;
+      }
+
+      // Starts the generation of a new checkpoint, later FLUSHes log into it
+      // Returns 0 if checkpoints are not enabled or one is under way
+      std::uint32_t begin(void) {
+          if (!this->enabled || this->busy.exchange(true)) return 0;
+          std::uint32_t next = this->generation.load() + 1;
+          this->generation.store(next);
+          std::atomic_thread_fence(std::memory_order_seq_cst);  // Before the scan reads any cell
+          return next;
+      }
+
+      // The image of generation is durable, what the generation before it logged is not needed anymore
+      void end(std::uint32_t generation) {
+          int parity = (generation - 1) % 2;
+          for (int i = 0; i < this->numSections; i++) {
+              while (this->sections.at(i).writers[parity].load() != 0)
+                  std::this_thread::yield();
+          }
+          this->clear(parity);
+          this->busy.store(false);
+      }
+
+      // Every cell index logged in section (either parity, unordered and possibly repeated)
+      // A crash may leave a hole per append under way, so a log ends once more holes follow
+      // than there are sections (one thread per section)
+      // Not run concurrently
+      void logged(int section, std::vector<long>* indices) {
+          SectionLog& log = this->sections.at(section);
+          for (int p = 0; p < 2; p++) {
+              long capacity = log.entries[p]->capacity();
+              int holes = 0;
+              for (long j = 0; j < capacity && holes <= this->numSections; j++) {
+                  std::int32_t entry = *log.entries[p]->at(j);
+                  if (entry == 0) {
+                      holes += 1;
+                      continue;
+                  }
+                  holes = 0;
+                  indices->push_back((long) entry - 1);
+              }
+          }
+      }
+
+      // A restore made a new image of generation, every log starts empty
+      // Not run concurrently
+      void restart(std::uint32_t generation) {
+          for (int i = 0; i < this->numSections; i++) {
+              for (int p = 0; p < 2; p++) {
+                  SectionLog& log = this->sections.at(i);
+                  long count = 0;  // What a crash left may lie past count, zero up to the last entry
+                  long capacity = log.entries[p]->capacity();
+                  int holes = 0;
+                  for (long j = 0; j < capacity && holes <= this->numSections; j++) {
+                      holes = (*log.entries[p]->at(j) == 0) ? holes + 1 : 0;
+                      if (holes == 0) count = j + 1;
+                  }
+                  log.count[p].store(std::max(count, log.count[p].load()));
+              }
+          }
+          this->clear(0);
+          this->clear(1);
+          this->enabled = true;
+          this->generation.store(std::max(generation, this->generation.load()));
+          this->busy.store(false);
+      }
+
+      std::uint32_t getGeneration(void) {
+          return this->generation.load();
+      }
+
+};
+
+// A key ordered array of Cells (RecoveredCell of a memory manager) behind a header
+// Written to a temporary file that is renamed over path, so path always holds a complete image
+template <typename Cell>
+struct CheckpointImage {
+
+      static const std::uint64_t MAGIC = 0x54504b4344534c44ull;  // "DLSDCKPT"
+
+      struct Header {
+          std::uint64_t magic;
+          std::uint32_t cellBytes;    // sizeof(Cell), a set of other types can not read it
+          std::uint32_t numSections;
+          std::uint64_t generation;   // Whose log holds the cells written since
+          std::uint64_t count;
+      };
+
+      // Returns false if the image could not be written
+      static bool write(const char* path, const std::vector<Cell>& cells, int numSections, std::uint32_t generation) {
+          std::string temporary = std::string(path) + ".tmp";
+          int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          if (fd < 0) return false;
+          Header header;
+          std::memset(&header, 0, sizeof(Header));
+          header.magic = MAGIC;
+          header.cellBytes = sizeof(Cell);
+          header.numSections = (std::uint32_t) numSections;
+          header.generation = generation;
+          header.count = cells.size();
+          bool written = writeAll(fd, &header, sizeof(Header)) &&
+                         writeAll(fd, cells.data(), sizeof(Cell) * cells.size()) &&
+                         ::fsync(fd) == 0;
+          ::close(fd);
+          if (!written || std::rename(temporary.c_str(), path) != 0) {
+              ::unlink(temporary.c_str());
+              return false;
+          }
+          return syncDirectory(path);  // The rename is not durable before its directory is
+      }
+
+      // Removes the image at path for good, a restore then scans every section
+      // Returns false if the removal could not be made durable
+      static bool remove(const char* path) {
+          ::unlink(path);
+          return syncDirectory(path);
+      }
+
+      // Maps the image at path and copies its cells
+      // Returns false if there is none or it was written for other sections or cells
+      static bool read(const char* path, int numSections, std::vector<Cell>* cells, std::uint32_t* generation) {
+          int fd = ::open(path, O_RDONLY);
+          if (fd < 0) return false;
+          struct stat info;
+          if (::fstat(fd, &info) != 0 || (std::size_t) info.st_size < sizeof(Header)) {
+              ::close(fd);
+              return false;
+          }
+          void* address = ::mmap(nullptr, (std::size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          ::close(fd);
+          if (address == MAP_FAILED) return false;
+          const Header* header = (const Header*) address;
+          bool valid = header->magic == MAGIC && header->cellBytes == sizeof(Cell) &&
+                       header->numSections == (std::uint32_t) numSections &&
+                       (std::size_t) info.st_size == sizeof(Header) + sizeof(Cell) * header->count;
+          if (valid) {
+              const Cell* begin = (const Cell*) ((const char*) address + sizeof(Header));
+              cells->assign(begin, begin + header->count);
+              *generation = (std::uint32_t) header->generation;
+          }
+          ::munmap(address, (std::size_t) info.st_size);
+          return valid;
+      }
+
+  private:
+
+      // Persists the entries of the directory that holds path
+      static bool syncDirectory(const char* path) {
+          std::string directory(path);
+          std::size_t slash = directory.find_last_of('/');
+          directory = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : directory.substr(0, slash);
+          int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+          if (fd < 0) return false;
+          bool synced = ::fsync(fd) == 0;
+          ::close(fd);
+          return synced;
+      }
+
+      static bool writeAll(int fd, const void* data, std::size_t length) {
+          const char* bytes = (const char*) data;
+          while (length > 0) {
+              ssize_t written = ::write(fd, bytes, length);
+              if (written <= 0) return false;
+              bytes += written;
+              length -= (std::size_t) written;
+          }
+          return true;
+      }
+
+};
+
+#endif
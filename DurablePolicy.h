@@ -0,0 +1,260 @@
+#ifndef DURABLE_POLICY_H
+#define DURABLE_POLICY_H
+
+// Durability Policy
+// DurableStore<Node, Memory, Protocol, K> is what every set does around its durable cells:
+// it owns the node pool, ties a pool node to the next cell of its thread's section, and runs
+// the recovery (read the memory manager, record what was linked and what is durable, take a
+// fresh node for every durable cell) and its test output
+// The axes a set picks:
+//   Memory    the backend, MemoryManager or SOFTMemoryManager (a DRAM copy or a mapped file each)
+//   Protocol  how a node holds its cell, which follows how the set synchronizes
+//     LinkFreeCells  the node names its cell, atomic valid flags (link-free list, skip list, hash set)
+//     LockedCells    the node names its cell, plain valid bits set under a lock (lock, MRLock, sequential)
+//     SOFTCells      the PNode of the node names its cell (SOFT list and hash set)
+// The set keeps how it links nodes (and LockPolicies how a lock based list locks them)
+// A Protocol has tie(node, prefix, postfix) and revive(node, cell), LinkFreeCells and SOFTCells
+// also give the cell format of MemoryManager: the Flags a node FLUSHes and the state they map to
+// (the lock based sets write the link-free format)
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "NodePool.h"
+
+// The keys the last recover of a set found linked (volatile) and durable (For testing only)
+// A crash loses the keys of the first that are not in the second
+template <typename K>
+struct RecoveredKeys {
+
+      std::vector<K> volatileKeys;
+      std::vector<K> durableKeys;
+
+      // The first count cells recoverMemory returned
+      template <typename Cells>
+      void recordDurable(const Cells& cells, int count) {
+          this->durableKeys.clear();
+          for (int i = 0; i < count; i++)
+              this->durableKeys.push_back(cells.at(i).key);
+      }
+
+      void append(std::vector<K>* volatileKeys, std::vector<K>* durableKeys) const {
+          volatileKeys->insert(volatileKeys->end(), this->volatileKeys.begin(), this->volatileKeys.end());
+          durableKeys->insert(durableKeys->end(), this->durableKeys.begin(), this->durableKeys.end());
+      }
+
+      void print(void) const {
+
+          // Print the keys recovered from volatile memory
+          std::cout << "Volatile Set keys" << std::endl;
+          for (int i = 0; i < (int) this->volatileKeys.size(); i++)
+              std::cout << "Key: " << this->volatileKeys.at(i) << std::endl;
+
+          // Print the keys recovered from durable memory
+          std::cout << "Durable Set keys" << std::endl;
+          for (int i = 0; i < (int) this->durableKeys.size(); i++)
+              std::cout << "Key: " << this->durableKeys.at(i) << std::endl;
+
+      }
+
+};
+
+struct LinkFreeCells {
+
+      // The insert and delete flags are not stored, recovery does not need them
+      struct Flags {
+          int validBits;
+          bool insertValidFlag;
+          bool deleteValidFlag;
+          std::uintptr_t next;
+      };
+
+      // VALID once validBits are both set, DELETED once next is marked
+      static std::uint32_t state(const Flags& flags) {
+          std::uint32_t state = ((flags.validBits & 3) == 3) ? CellState::VALID : 0;
+          if (flags.next & 1) state |= CellState::DELETED;
+          return state;
+      }
+
+      template <typename Node>
+      static void tie(Node* node, int prefix, int postfix) {
+          node->durableAddressPrefix = prefix;
+          node->durableAddressPostfix = postfix;
+      }
+
+      // A node whose insert is durable and that was not removed
+      template <typename Node, typename Cell>
+      static void revive(Node* node, const Cell& cell) {
+          node->key = cell.key;
+          node->item = cell.item;
+          node->validBits.store(3, std::memory_order_relaxed);  // Already durable
+          node->insertValidFlag.store(true, std::memory_order_relaxed);
+          node->deleteValidFlag.store(false, std::memory_order_relaxed);
+          tie(node, cell.durableAddressPrefix, cell.durableAddressPostfix);
+      }
+
+};
+
+struct LockedCells {
+
+      template <typename Node>
+      static void tie(Node* node, int prefix, int postfix) {
+          node->durableAddressPrefix = prefix;
+          node->durableAddressPostfix = postfix;
+      }
+
+      template <typename Node, typename Cell>
+      static void revive(Node* node, const Cell& cell) {
+          node->key = cell.key;
+          node->item = cell.item;
+          node->validBits = 3;  // Already durable
+          tie(node, cell.durableAddressPrefix, cell.durableAddressPostfix);
+      }
+
+};
+
+struct SOFTCells {
+
+      struct Flags {
+          bool validStart;
+          bool validEnd;
+          bool deleted;
+      };
+
+      // VALID once validStart and validEnd are set, DELETED once deleted is
+      static std::uint32_t state(const Flags& flags) {
+          std::uint32_t state = (flags.validStart && flags.validEnd) ? CellState::VALID : 0;
+          if (flags.deleted) state |= CellState::DELETED;
+          return state;
+      }
+
+      template <typename Node>
+      static void tie(Node* node, int prefix, int postfix) {
+          node->PNodePointer->durableAddressPrefix = prefix;
+          node->PNodePointer->durableAddressPostfix = postfix;
+      }
+
+      template <typename Node, typename Cell>
+      static void revive(Node* node, const Cell& cell) {
+          node->key = cell.key;
+          node->item = cell.item;
+          auto* pNode = node->PNodePointer;  // Already durable
+          pNode->key.store(cell.key, std::memory_order_relaxed);
+          pNode->item.store(cell.item, std::memory_order_relaxed);
+          pNode->validStart.store(true, std::memory_order_relaxed);
+          pNode->validEnd.store(true, std::memory_order_relaxed);
+          pNode->deleted.store(false, std::memory_order_relaxed);
+          tie(node, cell.durableAddressPrefix, cell.durableAddressPostfix);
+      }
+
+};
+
+template <typename Node, typename Memory, typename Protocol, typename K = long>
+class DurableStore {
+
+  public:
+
+      typedef typename Memory::RecoveredCell Cell;
+      typedef typename NodePool<Node>::ThreadPool ThreadPool;
+      typedef typename Memory::Section Section;
+
+      Memory* mem;
+      NodePool<Node>* nodePool;  // Each thread takes its nodes from its own chunks
+      RecoveredKeys<K> recovered;
+      int numIDs;
+
+      // Constructor
+      // Will not be called concurrently
+      DurableStore(Memory* mem, int numIDs) {
+          this->mem = mem;
+          this->nodePool = new NodePool<Node>(numIDs);
+          this->numIDs = numIDs;
+      }
+
+      DurableStore(const DurableStore&) = delete;
+      DurableStore& operator=(const DurableStore&) = delete;
+
+      // Frees every node handed out (the set's FREE)
+      void release(void) {
+          delete this->nodePool;
+          this->nodePool = nullptr;
+      }
+
+      // Gets memory address from permanent storage and ties it with a pool node
+      // Neither is taken until commit, returns nullptr if no node or cell is available
+      Node* allocate(int id) {
+          return this->allocate(this->nodePool->pool(id), this->mem->section(id), id);
+      }
+
+      // Same through the pool and section handles of a thread (see NodePool::pool, Memory::section)
+      Node* allocate(ThreadPool* pool, Section* section, int id) {
+          Node* newNode = this->nodePool->peek(pool);
+          if (newNode == nullptr) return nullptr;
+          int durAddr = this->mem->retrieveAddress(section);
+          if (durAddr == -1) return nullptr;
+          Protocol::tie(newNode, id, durAddr);
+          return newNode;
+      }
+
+      // Insertion was successful move the indices
+      void commit(int id) {
+          this->commit(this->nodePool->pool(id), this->mem->section(id));
+      }
+
+      void commit(ThreadPool* pool, Section* section) {
+          this->nodePool->commit(pool);
+          this->mem->updateAddress(section);
+      }
+
+      // Rebuilds the set from cells (numActiveNodes of them, in key order)
+      // linked(keys) appends the keys the set has linked now, reset() frees every node (FREE)
+      // and builds the empty set, link(node, cell) appends the revived node of each cell
+      // Stops early if no memory is available
+      template <typename Linked, typename Reset, typename Link>
+      void rebuild(std::vector<Cell>& cells, int numActiveNodes, Linked linked, Reset reset, Link link) {
+
+          // Record volatile memory (For testing only)
+          this->recovered.volatileKeys.clear();
+          linked(&this->recovered.volatileKeys);
+
+          // Record durable memory (For testing only)
+          this->recovered.recordDurable(cells, numActiveNodes);
+
+          // Rejuvenate all of the nodes
+          reset();
+          if (this->nodePool == nullptr) this->nodePool = new NodePool<Node>(this->numIDs);
+
+          // String the nodes together, the cells are already in key order
+          for (int i = 0; i < numActiveNodes; i++) {
+              Cell& cell = cells.at(i);
+              Node* node = this->nodePool->peek(cell.durableAddressPrefix);
+              if (node == nullptr) break;  // No memory available
+              this->nodePool->commit(cell.durableAddressPrefix);
+              Protocol::revive(node, cell);
+              link(node, cell);
+          }
+      }
+
+      // Scans the memory sections in parallel (valid cells stay where they are) and rebuilds from them
+      // Will not be called concurrently
+      template <typename Linked, typename Reset, typename Link>
+      void recover(Linked linked, Reset reset, Link link) {
+          std::vector<Cell> cells;
+          int numActiveNodes = this->mem->recoverMemory(&cells);
+          this->rebuild(cells, numActiveNodes, linked, reset, link);
+      }
+
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      void recoveredKeys(std::vector<K>* volatileKeys, std::vector<K>* durableKeys) {
+          this->recovered.append(volatileKeys, durableKeys);
+      }
+
+      // For testing (not run concurrentlly) (For abort testing only)
+      void printRecovery(void) {
+          this->recovered.print();
+      }
+
+};
+
+#endif
@@ -0,0 +1,246 @@
+// Durable Set Benchmark
+// Every set is compiled in, --set picks the one to run (or all of them in turn)
+//   g++ -std=c++17 -O2 -pthread DurableSetBenchmark.cpp -o DurableSetBenchmark
+//   ./DurableSetBenchmark --set soft --threads 8
+// Benchmark.h detects what each set has, the options a set has no use for are ignored with a warning
+// Build with -DCRASH_INJECTION for --crash (the crash points are compiled into the sets)
+
+#include <iostream>
+#include <atomic>
+#include <string>
+#include "Benchmark.h"
+#include "LinkFreeDurableSet.h"
+#include "SOFTDurableSet.h"
+#include "LinkFreeDurableSkipList.h"
+#include "LinkFreeDurableHashSet.h"
+#include "SOFTDurableHashSet.h"
+#include "LockDurableSet.h"
+#include "MRLockDurableSet.h"
+#include "SequentialDurableSet.h"
+#include "ShardedDurableSet.h"
+
+// One memory manager (a sharded memory has one per shard, shard i maps PATH.i)
+template <typename Memory>
+Memory* createMemory(const BenchmarkConfig& config) {
+    Memory* mem = nullptr;
+    if constexpr (HasShards<Memory>::value) {
+        if (config.poolPath == nullptr) {
+            mem = new Memory(config.numShards, numSetIDs(config));
+        } else {
+            mem = new Memory(config.numShards, numSetIDs(config), config.numOps + config.prefill, config.poolPath);
+            if (mem->getBackend() != MAPPED_FILE)
+                std::cerr << "Could not map every " << config.poolPath << ".N, using the DRAM simulation" << std::endl;
+        }
+    } else {
+        if (config.poolPath == nullptr) {
+            mem = new Memory(numSetIDs(config));
+        } else {
+            // Thread 0 also inserts the prefill, a timed run reuses the cells it frees
+            mem = new Memory(numSetIDs(config), config.numOps + config.prefill, config.poolPath);
+            if (mem->getBackend() != MAPPED_FILE)
+                std::cerr << "Could not map " << config.poolPath << ", using the DRAM simulation" << std::endl;
+        }
+    }
+    return mem;
+}
+
+// The sets are created with the ids of numSetIDs, the hash sets also take their buckets
+template <typename Set, typename Memory>
+Set* createSet(Memory* mem, std::atomic<bool>* abortFlag, const BenchmarkConfig& config) {
+    if constexpr (std::is_constructible<Set, Memory*, std::atomic<bool>*, int, int, bool>::value)
+        return new Set(mem, abortFlag, numSetIDs(config), config.numBuckets, config.shardByNode);
+    else if constexpr (std::is_constructible<Set, Memory*, std::atomic<bool>*, int>::value)
+        return new Set(mem, abortFlag, numSetIDs(config));
+    else
+        return new Set(mem, abortFlag);
+}
+
+// Every shard is a LinkFreeDurableSet over the memory manager of its shard
+typedef LinkFreeDurableSet<int> ShardSet;
+typedef ShardedDurableSet<ShardSet, ShardSet::Memory, int> ShardedSet;
+
+template <>
+ShardedSet* createSet<ShardedSet, ShardedMemory<ShardSet::Memory>>(ShardedMemory<ShardSet::Memory>* mem,
+                                                                   std::atomic<bool>* abortFlag,
+                                                                   const BenchmarkConfig& config) {
+    int mode = config.shardByHash ? SHARD_BY_HASH : SHARD_BY_RANGE;
+    int numIDs = numSetIDs(config);
+    return new ShardedSet(mem, mode, 0, config.workload.keyRange, [abortFlag, numIDs](ShardSet::Memory* shard, int) {
+        return new ShardSet(shard, abortFlag, numIDs);
+    });
+}
+
+// Runs Set with config (a copy, the options Set has no use for are turned off) and prints its report
+// Returns false if Set can not run with config
+template <typename Set, typename Memory>
+bool runSet(BenchmarkConfig config, const char* setName) {
+    if constexpr (IsSingleThreaded<Set>::value) {
+        if (config.numThreads != 1) {
+            std::cerr << setName << " is not thread safe, run it with --threads 1" << std::endl;
+            return false;
+        }
+    }
+    if constexpr (!HasTrimModes<Set>::value) {
+        if (config.trimmer) {
+            std::cerr << setName << " always trims inline, ignoring --trimmer" << std::endl;
+            config.trimmer = false;
+        }
+    }
+    if constexpr (!HasContentionModes<Set>::value) {
+        if (config.eliminate) {
+            std::cerr << setName << " always retries a lost CAS, ignoring --eliminate" << std::endl;
+            config.eliminate = false;
+        }
+    }
+    if constexpr (!HasSearchModes<Set>::value) {
+        if (config.finger) {
+            std::cerr << setName << " always searches from the head, ignoring --finger" << std::endl;
+            config.finger = false;
+        }
+    }
+    if constexpr (!HasElisionModes<Set>::value) {
+        if (config.elide) {
+            std::cerr << setName << " takes no locks, ignoring --elide" << std::endl;
+            config.elide = false;
+        }
+    } else {
+        if (config.elide && !HardwareTransaction::available())
+            std::cerr << "No RTM on this CPU, --elide takes the locks as usual" << std::endl;
+    }
+    if constexpr (HasShards<Set>::value) {
+        if (config.numShards == 0) config.numShards = DEFAULT_SHARDS;
+    } else {
+        if (config.numShards != 0 || config.shardByHash) {
+            std::cerr << setName << " is a single shard, ignoring --shards and --shard-by" << std::endl;
+            config.numShards = 0;
+            config.shardByHash = false;
+        }
+    }
+    if constexpr (!HasCheckpoints<Set>::value) {
+        if (config.checkpointPath != nullptr) {
+            std::cerr << setName << " has no checkpoints, ignoring --checkpoint" << std::endl;
+            config.checkpointPath = nullptr;
+        }
+    }
+    if constexpr (!HasReadModes<Set>::value) {
+        if (config.readMode != READER_FLUSH)
+            std::cerr << setName << " has a single read mode, ignoring --reader-no-flush" << std::endl;
+    }
+
+    Memory* mem = createMemory<Memory>(config);
+    if (config.groupSize > 0) mem->setFlushMode(GROUP_COMMIT, config.groupSize);
+    if constexpr (HasCheckpoints<Set>::value) {
+        if (config.checkpointPath != nullptr) mem->enableCheckpoints();
+    }
+    std::atomic<bool>* abortFlag = new std::atomic<bool>(false);
+    Set* durableSet = createSet<Set, Memory>(mem, abortFlag, config);
+    if constexpr (HasReadModes<Set>::value) durableSet->setReadMode(config.readMode);
+    if constexpr (HasContentionModes<Set>::value) {
+        if (config.eliminate) durableSet->setContentionMode(CONTENTION_ELIMINATE);
+    }
+    if constexpr (HasSearchModes<Set>::value) {
+        if (config.finger) durableSet->setSearchMode(SEARCH_FROM_FINGER);
+    }
+    if constexpr (HasElisionModes<Set>::value) {
+        if (config.elide) durableSet->setElisionMode(ELISION_RTM);
+    }
+    if constexpr (HasTrimModes<Set>::value) {
+        if (config.trimmer) {
+            durableSet->setTrimMode(TRIM_DEFERRED);
+            durableSet->setMaxBacklog(config.maxBacklog);
+        }
+    }
+
+    Benchmark<Set, Memory, int> benchmark(durableSet, mem, abortFlag, config);
+    benchmark.generate();
+    benchmark.prefill();
+    benchmark.run();
+    if (config.recover || config.crashMs > 0) benchmark.timeRecover();  // A crash is always recovered
+    benchmark.report(std::cout, setName);
+
+    durableSet->FREE();
+    delete durableSet;
+    delete mem;
+    delete abortFlag;
+    return true;
+}
+
+// The names --set takes, in the order --set all runs them
+struct BenchmarkSet {
+    const char* name;
+    bool (*run)(const BenchmarkConfig& config);
+};
+
+static const BenchmarkSet SETS[] = {
+    { "link-free", [](const BenchmarkConfig& config) {
+        return runSet<LinkFreeDurableSet<int>, MemoryManager<int>>(config, "LinkFreeDurableSet"); } },
+    { "soft", [](const BenchmarkConfig& config) {
+        return runSet<SOFTDurableSet<int>, SOFTMemoryManager<int>>(config, "SOFTDurableSet"); } },
+    { "skip-list", [](const BenchmarkConfig& config) {
+        return runSet<LinkFreeDurableSkipList<int>, MemoryManager<int>>(config, "LinkFreeDurableSkipList"); } },
+    { "link-free-hash", [](const BenchmarkConfig& config) {
+        return runSet<LinkFreeDurableHashSet<int>, MemoryManager<int>>(config, "LinkFreeDurableHashSet"); } },
+    { "soft-hash", [](const BenchmarkConfig& config) {
+        return runSet<SOFTDurableHashSet<int>, SOFTMemoryManager<int>>(config, "SOFTDurableHashSet"); } },
+    { "lock", [](const BenchmarkConfig& config) {
+        return runSet<LockDurableSet<int>, MemoryManager<int>>(config, "LockDurableSet"); } },
+    { "lock-spin", [](const BenchmarkConfig& config) {
+        return runSet<LockDurableSet<int, SpinLock>, MemoryManager<int>>(config, "LockDurableSet<SpinLock>"); } },
+    { "lock-version", [](const BenchmarkConfig& config) {
+        return runSet<LockDurableSet<int, VersionLock>, MemoryManager<int>>(config, "LockDurableSet<VersionLock>"); } },
+    { "mrlock", [](const BenchmarkConfig& config) {
+        return runSet<MRLockDurableSet<int>, MemoryManager<int>>(config, "MRLockDurableSet"); } },
+    { "mrlock-park", [](const BenchmarkConfig& config) {
+        return runSet<MRLockDurableSet<int, StaticBitset<DEFAULT_MRLOCK_RESOURCES>, ParkWait>, MemoryManager<int>>(
+            config, "MRLockDurableSet<ParkWait>"); } },
+    { "sequential", [](const BenchmarkConfig& config) {
+        return runSet<SequentialDurableSet<int>, MemoryManager<int>>(config, "SequentialDurableSet"); } },
+    { "sharded", [](const BenchmarkConfig& config) {
+        return runSet<ShardedSet, ShardedMemory<ShardSet::Memory>>(config, "ShardedDurableSet<LinkFreeDurableSet>"); } },
+};
+
+static const int NUM_SETS = sizeof(SETS) / sizeof(SETS[0]);
+
+int main(int argc, char* argv[]) {
+
+    BenchmarkConfig config = defaultConfig();
+    if (!parseArgs(argc, argv, &config)) return 1;
+    std::string setName = config.setName;
+    int chosen = -1;
+    for (int i = 0; i < NUM_SETS; i++) {
+        if (setName == SETS[i].name) chosen = i;
+    }
+    if (chosen == -1 && setName != "all") {
+        std::cerr << "Unknown set " << setName << ", one of all";
+        for (int i = 0; i < NUM_SETS; i++)
+            std::cerr << ", " << SETS[i].name;
+        std::cerr << std::endl;
+        return 1;
+    }
+    if (!CRASH_INJECTION_ENABLED && (config.crashMs > 0 || config.tear)) {
+        std::cerr << "Built without CRASH_INJECTION, ignoring --crash and --tear" << std::endl;
+        config.crashMs = 0;
+        config.tear = false;
+    }
+
+    // The memory of thread id is placed on the node it is bound to
+    NumaTopology* topology = nullptr;
+    if (config.numa >= 0) {
+        topology = new NumaTopology(config.numa);
+        NumaTopology::setPlacement(topology);
+    }
+
+    // With all, a set that can not run with config is skipped, the CSV header comes with the first report
+    int ran = 0;
+    for (int i = 0; i < NUM_SETS; i++) {
+        if (chosen != -1 && i != chosen) continue;
+        if (SETS[i].run(config)) {
+            ran += 1;
+            config.header = false;
+        }
+    }
+
+    NumaTopology::setPlacement(nullptr);
+    delete topology;
+    return (ran > 0) ? 0 : 1;
+}
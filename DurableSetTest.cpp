@@ -0,0 +1,324 @@
+// Durable Set Test
+// Every set inserts, removes and checks keys, then recovers and has to find exactly the keys it kept
+//   g++ -std=c++17 -O2 -pthread DurableSetTest.cpp -o DurableSetTest
+//   ./DurableSetTest            (every set, returns 1 if one of them fails)
+//   ./DurableSetTest skip-list  (one set, by its --set name)
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include "Benchmark.h"
+#include "LinkFreeDurableSet.h"
+#include "SOFTDurableSet.h"
+#include "LinkFreeDurableSkipList.h"
+#include "LinkFreeDurableHashSet.h"
+#include "SOFTDurableHashSet.h"
+#include "LockDurableSet.h"
+#include "MRLockDurableSet.h"
+#include "SequentialDurableSet.h"
+#include "ShardedDurableSet.h"
+
+static const long NUM_KEYS = 600;   // Keys 0 .. NUM_KEYS - 1 are inserted
+static const int NUM_IDS = 4;       // Consecutive keys go to different sections
+static const int NUM_BUCKETS = 16;  // Of the hash sets
+static const long NUM_RACE_KEYS = 32;  // Few keys a round, so removes and inserts of one key overlap
+static const int NUM_RACE_ROUNDS = 40;
+static const int NUM_RACE_OPS = 50000;  // Per thread and round
+
+// Reports the first check of a set that failed
+struct TestResult {
+      bool passed;
+      std::string failure;
+};
+
+static void fail(TestResult* result, const std::string& what, long key) {
+    if (!result->passed) return;
+    result->passed = false;
+    result->failure = what + " " + std::to_string(key);
+}
+
+template <typename Set, typename Memory>
+Set* createTestSet(Memory* mem, std::atomic<bool>* abortFlag, int numIDs) {
+    if constexpr (std::is_constructible<Set, Memory*, std::atomic<bool>*, int, int, bool>::value)
+        return new Set(mem, abortFlag, numIDs, NUM_BUCKETS, false);
+    else if constexpr (std::is_constructible<Set, Memory*, std::atomic<bool>*, int>::value)
+        return new Set(mem, abortFlag, numIDs);
+    else
+        return new Set(mem, abortFlag);
+}
+
+typedef LinkFreeDurableSet<int> ShardSet;
+typedef ShardedDurableSet<ShardSet, ShardSet::Memory, int> ShardedSet;
+
+template <>
+ShardedSet* createTestSet<ShardedSet, ShardedMemory<ShardSet::Memory>>(ShardedMemory<ShardSet::Memory>* mem,
+                                                                       std::atomic<bool>* abortFlag, int numIDs) {
+    return new ShardedSet(mem, SHARD_BY_RANGE, 0, NUM_KEYS, [abortFlag, numIDs](ShardSet::Memory* shard, int) {
+        return new ShardSet(shard, abortFlag, numIDs);
+    });
+}
+
+template <typename Memory>
+Memory* createTestMemory(int numIDs) {
+    if constexpr (HasShards<Memory>::value)
+        return new Memory(DEFAULT_SHARDS, numIDs);
+    else
+        return new Memory(numIDs);
+}
+
+// Every key in [0, NUM_KEYS) is in durableSet iff expected holds it
+template <typename Set>
+void checkContains(Set* durableSet, const std::vector<bool>& expected, const char* when, TestResult* result) {
+    for (long key = 0; key < NUM_KEYS; key++) {
+        if (durableSet->contains(key, 0) != expected.at(key))
+            fail(result, std::string(expected.at(key) ? "missing " : "extra ") + when + ", key", key);
+    }
+}
+
+// Inserts every key, removes every third one (and a few twice), then recovers
+// The keys recover finds durable, and the set after it, are the keys that were not removed
+template <typename Set, typename Memory>
+TestResult testSet(void) {
+    TestResult result = {true, ""};
+    int numIDs = IsSingleThreaded<Set>::value ? 1 : NUM_IDS;
+    Memory* mem = createTestMemory<Memory>(numIDs);
+    std::atomic<bool>* abortFlag = new std::atomic<bool>(false);
+    Set* durableSet = createTestSet<Set, Memory>(mem, abortFlag, numIDs);
+    std::vector<bool> expected(NUM_KEYS, false);
+
+    for (long key = 0; key < NUM_KEYS; key++) {
+        if (!durableSet->insert(key, (int) key, (int) (key % numIDs))) fail(&result, "insert failed, key", key);
+        expected.at(key) = true;
+    }
+    for (long key = 0; key < NUM_KEYS; key += 50) {
+        if (durableSet->insert(key, (int) key, 0)) fail(&result, "second insert succeeded, key", key);
+    }
+    for (long key = 0; key < NUM_KEYS; key += 3) {
+        if (!durableSet->remove(key, (int) ((key + 1) % numIDs))) fail(&result, "remove failed, key", key);
+        expected.at(key) = false;
+    }
+    for (long key = 0; key < NUM_KEYS; key += 30) {
+        if (durableSet->remove(key, 0)) fail(&result, "second remove succeeded, key", key);
+    }
+    checkContains(durableSet, expected, "before recover", &result);
+
+    durableSet->recover();
+    std::vector<long> linked;
+    std::vector<long> durable;
+    durableSet->recoveredKeys(&linked, &durable);
+    std::sort(durable.begin(), durable.end());
+    std::vector<long> kept;
+    for (long key = 0; key < NUM_KEYS; key++) {
+        if (expected.at(key)) kept.push_back(key);
+    }
+    std::vector<long> lost;
+    std::vector<long> extra;
+    std::set_difference(kept.begin(), kept.end(), durable.begin(), durable.end(), std::back_inserter(lost));
+    std::set_difference(durable.begin(), durable.end(), kept.begin(), kept.end(), std::back_inserter(extra));
+    if (!lost.empty()) fail(&result, "recover lost key", lost.front());
+    if (!extra.empty()) fail(&result, "recover found removed key", extra.front());
+    checkContains(durableSet, expected, "after recover", &result);
+
+    // The recovered set takes updates again
+    if (!durableSet->remove(1, 0)) fail(&result, "remove after recover failed, key", 1);
+    if (!durableSet->insert(3, 3, 0)) fail(&result, "insert after recover failed, key", 3);
+    expected.at(1) = false;
+    expected.at(3) = true;
+    checkContains(durableSet, expected, "after the updates that followed recover", &result);
+
+    durableSet->FREE();
+    delete durableSet;
+    delete mem;
+    delete abortFlag;
+    return result;
+}
+
+// The index levels recover rebuilds over the keys that were kept
+TestResult testSkipListLevels(void) {
+    typedef LinkFreeDurableSkipList<int> SkipList;
+    TestResult result = {true, ""};
+    MemoryManager<int>* mem = new MemoryManager<int>(NUM_IDS);
+    std::atomic<bool>* abortFlag = new std::atomic<bool>(false);
+    SkipList* skipList = new SkipList(mem, abortFlag, NUM_IDS);
+    std::vector<bool> expected(NUM_KEYS, false);
+    long kept = 0;
+    for (long key = 0; key < NUM_KEYS; key++) {
+        skipList->insert(key, (int) key, (int) (key % NUM_IDS));
+        expected.at(key) = (key % 3 != 0);
+        if (expected.at(key)) kept += 1;
+    }
+    for (long key = 0; key < NUM_KEYS; key += 3)
+        skipList->remove(key, 0);
+
+    std::vector<long> levelSizes;
+    if (!skipList->checkLevels(&levelSizes)) fail(&result, "index levels broken before recover, level 0 has", levelSizes.at(0));
+    skipList->recover();
+    if (!skipList->checkLevels(&levelSizes)) fail(&result, "index levels broken after recover, level 0 has", levelSizes.at(0));
+    if (levelSizes.at(0) != kept) fail(&result, "bottom level after recover has nodes", levelSizes.at(0));
+    if (levelSizes.at(1) == 0 || levelSizes.at(1) >= levelSizes.at(0))  // About half of them
+        fail(&result, "index level 1 after recover has nodes", levelSizes.at(1));
+    checkContains(skipList, expected, "after recover", &result);
+
+    skipList->FREE();
+    delete skipList;
+    delete mem;
+    delete abortFlag;
+    return result;
+}
+
+// Threads insert and remove the same few keys, so a remove often marks a node whose insert is
+// still linking its upper levels. Each round takes the band of keys below the last one, finds
+// of later rounds never pass a band at the index levels, so a removed node left linked there
+// stays for checkLevels. Once they are done a key is in the set iff its successful inserts
+// outnumber its successful removes (by one), and recover finds the same keys
+TestResult testSkipListRaces(void) {
+    typedef LinkFreeDurableSkipList<int> SkipList;
+    TestResult result = {true, ""};
+    MemoryManager<int>* mem = new MemoryManager<int>(NUM_IDS);
+    std::atomic<bool>* abortFlag = new std::atomic<bool>(false);
+    SkipList* skipList = new SkipList(mem, abortFlag, NUM_IDS);
+    long numKeys = NUM_RACE_ROUNDS * NUM_RACE_KEYS;
+    std::vector<std::vector<long>> balance(NUM_IDS, std::vector<long>(numKeys, 0));
+    for (int round = 0; round < NUM_RACE_ROUNDS; round++) {
+        long lo = numKeys - (round + 1) * NUM_RACE_KEYS;
+        std::vector<std::thread> threads;
+        for (int id = 0; id < NUM_IDS; id++) {
+            threads.push_back(std::thread([skipList, &balance, id, round, lo](void) {
+                std::mt19937 generator(round * NUM_IDS + id + 1);
+                for (int i = 0; i < NUM_RACE_OPS; i++) {
+                    long key = lo + (long) (generator() % NUM_RACE_KEYS);
+                    if (generator() % 2 == 0) {
+                        if (skipList->insert(key, (int) key, id)) balance.at(id).at(key) += 1;
+                    } else {
+                        if (skipList->remove(key, id)) balance.at(id).at(key) -= 1;
+                    }
+                }
+            }));
+        }
+        for (int id = 0; id < NUM_IDS; id++)
+            threads.at(id).join();
+    }
+
+    std::vector<bool> expected(numKeys, false);
+    for (long key = 0; key < numKeys; key++) {
+        long net = 0;
+        for (int id = 0; id < NUM_IDS; id++)
+            net += balance.at(id).at(key);
+        if (net != 0 && net != 1) fail(&result, "inserts less removes is not 0 or 1, key", key);
+        expected.at(key) = (net == 1);
+    }
+    std::vector<long> levelSizes;
+    if (!skipList->checkLevels(&levelSizes)) fail(&result, "index levels broken after the races, level 0 has", levelSizes.at(0));
+    for (long key = 0; key < numKeys; key++) {
+        if (skipList->contains(key, 0) != expected.at(key)) fail(&result, "contains is wrong after the races, key", key);
+    }
+    skipList->recover();
+    if (!skipList->checkLevels(&levelSizes)) fail(&result, "index levels broken after recover, level 0 has", levelSizes.at(0));
+    for (long key = 0; key < numKeys; key++) {
+        if (skipList->contains(key, 0) != expected.at(key)) fail(&result, "contains is wrong after recover, key", key);
+    }
+
+    skipList->FREE();
+    delete skipList;
+    delete mem;
+    delete abortFlag;
+    return result;
+}
+
+// Keys of every bucket, with the ends of long, under 1, 5 (rounded up to 8) and 64 buckets
+// recover has to rebuild each bucket with the keys it held, in key order
+template <typename Set, typename Memory>
+TestResult testHashBuckets(void) {
+    TestResult result = {true, ""};
+    static const int BUCKET_COUNTS[] = {1, 5, 64};
+    std::vector<long> keys;
+    for (long key = 0; key < NUM_KEYS; key++)
+        keys.push_back(key);
+    std::vector<long> edges = {MIN_KEY + 1, -NUM_KEYS, -1, 1L << 40, MAX_KEY - 1};
+    keys.insert(keys.end(), edges.begin(), edges.end());
+    for (int numBuckets : BUCKET_COUNTS) {
+        Memory* mem = new Memory(NUM_IDS);
+        std::atomic<bool>* abortFlag = new std::atomic<bool>(false);
+        Set* hashSet = new Set(mem, abortFlag, NUM_IDS, numBuckets);
+        std::vector<bool> expected(keys.size(), true);
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (!hashSet->insert(keys.at(i), (int) i, (int) (i % NUM_IDS))) fail(&result, "insert failed, key", keys.at(i));
+        }
+        for (std::size_t i = 0; i < keys.size(); i += 3) {
+            if (!hashSet->remove(keys.at(i), (int) (i % NUM_IDS))) fail(&result, "remove failed, key", keys.at(i));
+            expected.at(i) = false;
+        }
+
+        std::vector<long> before;
+        std::vector<long> after;
+        if (!hashSet->checkBuckets(&before)) fail(&result, "buckets broken before recover, buckets", numBuckets);
+        long busy = std::count_if(before.begin(), before.end(), [](long size) { return size > 0; });
+        if (before.size() < (std::size_t) numBuckets || busy * 2 < (long) before.size())  // The hash spreads the keys
+            fail(&result, "keys only in some of the buckets, buckets", numBuckets);
+        hashSet->recover();
+        if (!hashSet->checkBuckets(&after)) fail(&result, "buckets broken after recover, buckets", numBuckets);
+        if (after != before) fail(&result, "recover moved keys between buckets, buckets", numBuckets);
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (hashSet->contains(keys.at(i), 0) != expected.at(i)) fail(&result, "contains is wrong after recover, key", keys.at(i));
+        }
+
+        hashSet->FREE();
+        delete hashSet;
+        delete mem;
+        delete abortFlag;
+    }
+    return result;
+}
+
+// The sets, by the names of DurableSetBenchmark --set, and the tests of one set
+struct TestCase {
+      const char* name;
+      TestResult (*run)(void);
+};
+
+static const TestCase TESTS[] = {
+    { "link-free", testSet<LinkFreeDurableSet<int>, MemoryManager<int>> },
+    { "soft", testSet<SOFTDurableSet<int>, SOFTMemoryManager<int>> },
+    { "skip-list", testSet<LinkFreeDurableSkipList<int>, MemoryManager<int>> },
+    { "skip-list-levels", testSkipListLevels },
+    { "skip-list-races", testSkipListRaces },
+    { "link-free-hash", testSet<LinkFreeDurableHashSet<int>, MemoryManager<int>> },
+    { "link-free-hash-buckets", testHashBuckets<LinkFreeDurableHashSet<int>, MemoryManager<int>> },
+    { "soft-hash", testSet<SOFTDurableHashSet<int>, SOFTMemoryManager<int>> },
+    { "soft-hash-buckets", testHashBuckets<SOFTDurableHashSet<int>, SOFTMemoryManager<int>> },
+    { "lock", testSet<LockDurableSet<int>, MemoryManager<int>> },
+    { "lock-spin", testSet<LockDurableSet<int, SpinLock>, MemoryManager<int>> },
+    { "lock-version", testSet<LockDurableSet<int, VersionLock>, MemoryManager<int>> },
+    { "mrlock", testSet<MRLockDurableSet<int>, MemoryManager<int>> },
+    { "mrlock-park", testSet<MRLockDurableSet<int, StaticBitset<DEFAULT_MRLOCK_RESOURCES>, ParkWait>, MemoryManager<int>> },
+    { "sequential", testSet<SequentialDurableSet<int>, MemoryManager<int>> },
+    { "sharded", testSet<ShardedSet, ShardedMemory<ShardSet::Memory>> },
+};
+
+static const int NUM_TESTS = sizeof(TESTS) / sizeof(TESTS[0]);
+
+int main(int argc, char* argv[]) {
+
+    int failed = 0;
+    int ran = 0;
+    for (int i = 0; i < NUM_TESTS; i++) {
+        if (argc > 1 && std::string(argv[1]) != TESTS[i].name) continue;
+        TestResult result = TESTS[i].run();
+        ran += 1;
+        if (result.passed) {
+            std::cout << TESTS[i].name << " passed" << std::endl;
+        } else {
+            std::cout << TESTS[i].name << " FAILED: " << result.failure << std::endl;
+            failed += 1;
+        }
+    }
+    if (ran == 0) {
+        std::cerr << "Unknown set " << argv[1] << std::endl;
+        return 1;
+    }
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#ifndef DURABLE_TYPES_H
+#define DURABLE_TYPES_H
+
+// Key and Value Policies
+// KeyTraits<K, Compare> gives the sentinel keys of a set ordered by Compare (head and tail)
+// A value policy says what a node and its durable cell hold for an item of type T
+// InlineValue   the item itself, T is copied into the cell (trivially copyable)
+// HeapValue     an offset into a ValueHeap, the item lives out of line in the slot of its cell
+// Also what every set shares: the sentinel keys of the long keyed sets
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <functional>
+#include "PersistentMemory.h"
+#include "NodePool.h"
+
+// Sentinel keys of the long keyed sets (head and tail), keys must lie strictly between them
+// One definition for every set header, so any of them can be used in the same program
+// Fixed at the ends of long, they never depend on the keys of a run (the SOFT hash set has a
+// second tail at MAX_KEY + 1)
+inline const long MIN_KEY = std::numeric_limits<long>::lowest();
+inline const long MAX_KEY = std::numeric_limits<long>::max() - 1;
+
+// Every key of a set must compare strictly between minKey() and maxKey()
+// Specialize for key types without std::numeric_limits
+template <typename K, typename Compare = std::less<K>>
+struct KeyTraits {
+    static K minKey(void) { return std::numeric_limits<K>::lowest(); }
+    static K maxKey(void) { return std::numeric_limits<K>::max(); }
+};
+
+template <typename K>
+struct KeyTraits<K, std::greater<K>> {
+    static K minKey(void) { return std::numeric_limits<K>::max(); }
+    static K maxKey(void) { return std::numeric_limits<K>::lowest(); }
+};
+
+template <typename T>
+struct InlineValue {
+
+      typedef T Item;
+      typedef T Stored;  // What the node and the durable cell hold
+
+      // prefix and postfix are the durable address of the node the item is given to
+      Stored store(const T& item, int prefix, int postfix) {
+          (void) prefix; (void) postfix;
+          return item;
+      }
+
+      T load(const Stored& stored) {
+          return stored;
+      }
+
+      // Whether store found no room for the item, never for an inline one
+      bool failed(const Stored& stored) {
+          (void) stored;
+          return false;
+      }
+
+};
+
+// Out of line items, section i slot j belongs to the durable cell of section i index j
+// A slot is only rewritten once its cell is free again, so no slot is ever allocated or freed
+// Under GROUP_COMMIT a cell whose delete was not synced yet may be paired with a newer item
+// Like the memPool it is DRAM (grows on demand) or an mmap'd file (fixed size), placed like the memPool
+template <typename T>
+class ValueHeap {
+
+  private:
+
+      std::vector<ChunkedArena<T>*> sections;
+      int numSections;
+      int backend;
+      PersistentRegion region;  // Only used by MAPPED_FILE
+
+  public:
+
+      static const std::uint64_t NO_SLOT = ~0ull;
+
+      // Constructor (DRAM_SIMULATION backend)
+      ValueHeap(int numIDs, long chunkSize = DEFAULT_CHUNK_SIZE) {
+          this->sections = std::vector<ChunkedArena<T>*>(numIDs);
+          for (int i = 0; i < numIDs; i++) {
+              this->sections.at(i) = new ChunkedArena<T>(chunkSize);
+              this->sections.at(i)->setNode(NumaTopology::placedNode(i));
+          }
+          this->numSections = numIDs;
+          this->backend = DRAM_SIMULATION;
+      }
+
+      // Constructor (MAPPED_FILE backend), numSlots should match the cells of the memPool sections
+      // T is written to the file as is, it has to be trivially copyable
+      // Falls back to DRAM_SIMULATION if the file can not be mapped (see getBackend)
+      ValueHeap(int numIDs, long numSlots, const char* heapPath, bool clearHeap = true) {
+          this->sections = std::vector<ChunkedArena<T>*>(numIDs);
+          this->numSections = numIDs;
+          this->backend = MAPPED_FILE;
+          std::size_t sectionBytes = sizeof(T) * (std::size_t) numSlots;
+          if (this->region.map(heapPath, sectionBytes * numIDs, clearHeap)) {
+              T* slots = (T*) this->region.address();
+              for (int i = 0; i < numIDs; i++) {
+                  this->sections.at(i) = new ChunkedArena<T>(slots + (std::size_t) i * numSlots, numSlots);
+                  if (NumaTopology::placedNode(i) >= 0)
+                      NumaTopology::bindMemory(slots + (std::size_t) i * numSlots, sectionBytes,
+                                               NumaTopology::placedNode(i), true);
+              }
+          } else {
+              this->backend = DRAM_SIMULATION;
+              for (int i = 0; i < numIDs; i++) {
+                  this->sections.at(i) = new ChunkedArena<T>(numSlots);
+                  this->sections.at(i)->setNode(NumaTopology::placedNode(i));
+              }
+          }
+      }
+
+      ValueHeap(const ValueHeap&) = delete;
+      ValueHeap& operator=(const ValueHeap&) = delete;
+
+      // Destructor
+      ~ValueHeap(void) {
+          for (int i = 0; i < this->numSections; i++)
+              delete this->sections.at(i);
+          if (this->backend == MAPPED_FILE)
+              this->region.unmap();
+      }
+
+      int getBackend(void) {
+          return this->backend;
+      }
+
+      // Writes item to the slot of cell (prefix, postfix) and persists it
+      // Called by thread prefix before the cell is FLUSHed
+      // Returns the offset of the slot, or NO_SLOT if the section can not grow any further
+      std::uint64_t put(const T& item, int prefix, int postfix) {
+          ChunkedArena<T>* section = this->sections.at(prefix);
+          if (!section->reserve(postfix)) return NO_SLOT;
+          T* slot = section->at(postfix);
+          *slot = item;
+          if (this->backend == MAPPED_FILE)
+              Persistence::PERSIST(slot, sizeof(T));
+          return (((std::uint64_t) prefix) << 32) | (std::uint32_t) postfix;
+      }
+
+      const T& get(std::uint64_t offset) {
+          return *this->sections.at((int) (offset >> 32))->at((long) (offset & 0xFFFFFFFFull));
+      }
+
+};
+
+// The node and the cell hold the offset of the item in heap
+template <typename T>
+struct HeapValue {
+
+      typedef T Item;
+      typedef std::uint64_t Stored;
+
+      ValueHeap<T>* heap;
+
+      // Constructor
+      HeapValue(ValueHeap<T>* heap = nullptr) {
+          this->heap = heap;
+      }
+
+      Stored store(const T& item, int prefix, int postfix) {
+          return this->heap->put(item, prefix, postfix);
+      }
+
+      T load(const Stored& stored) {
+          return this->heap->get(stored);
+      }
+
+      bool failed(const Stored& stored) {
+          return stored == ValueHeap<T>::NO_SLOT;
+      }
+
+};
+
+#endif
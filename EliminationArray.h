@@ -0,0 +1,135 @@
+#ifndef ELIMINATION_ARRAY_H
+#define ELIMINATION_ARRAY_H
+
+// Elimination Array Class
+// An insert or remove that lost its CAS on a hot key leaves an offer in the slot of that key
+// and spins for a while. An operation on the same key that found out where the key stands
+// answers it: both take effect at that moment without touching the list
+//   key absent:  remove offers fail, and insert + remove pairs both succeed (inserted, removed)
+//   key present: insert offers fail (the answering insert made the node durable first)
+// An offer nobody answered is withdrawn and its operation searches again, so nothing waits
+// for another thread
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include "PersistentMemory.h"
+#include "LockPolicies.h"
+
+static const int DEFAULT_ELIMINATION_SLOTS = 64;   // Hot keys that can have an offer at once
+static const int DEFAULT_ELIMINATION_SPINS = 256;  // Pauses an offer waits for an answer
+
+template <typename K, typename Compare = std::less<K>>
+class EliminationArray {
+
+  public:
+
+      enum OfferKind { OFFER_INSERT = 1, OFFER_REMOVE = 2 };
+
+      // One per thread id, reused by each of its offers
+      // state is a sequence number (one per offer) above a phase, key and kind belong to the sequence
+      struct alignas(CACHE_LINE_SIZE) Offer {
+          std::atomic<std::uint64_t> state;
+          K key;
+          int kind;
+      };
+
+  private:
+
+      enum Phase { IDLE = 0, WAITING = 1, ANSWERED_FALSE = 2, ANSWERED_TRUE = 3 };
+
+      struct alignas(CACHE_LINE_SIZE) Slot {
+          std::atomic<Offer*> offer;  // May still point at an offer that is no longer WAITING
+      };
+
+      std::vector<Slot> slots;
+      std::vector<Offer> offers;
+      int spins;
+
+      // Keys are trivially copyable, equal bytes always share a slot (FNV-1a)
+      Slot& slotOf(const K& key) {
+          const unsigned char* bytes = (const unsigned char*) &key;
+          std::uint64_t hash = 14695981039346656037ull;
+          for (std::size_t i = 0; i < sizeof(K); i++)
+              hash = (hash ^ bytes[i]) * 1099511628211ull;
+          return this->slots[hash % this->slots.size()];
+      }
+
+  public:
+
+      // Constructor
+      EliminationArray(int numIDs, int numSlots = DEFAULT_ELIMINATION_SLOTS, int spins = DEFAULT_ELIMINATION_SPINS)
+          : slots((numSlots > 0) ? numSlots : 1), offers(numIDs) {
+          for (std::size_t i = 0; i < this->slots.size(); i++)
+              this->slots[i].offer.store(nullptr);
+          for (int i = 0; i < numIDs; i++) {
+              this->offers[i].state.store(IDLE);
+              this->offers[i].key = K();
+              this->offers[i].kind = 0;
+          }
+          this->spins = spins;
+      }
+
+      EliminationArray(const EliminationArray&) = delete;
+      EliminationArray& operator=(const EliminationArray&) = delete;
+
+      // Offers the operation kind on key of thread id and waits for an answer
+      // Returns its result (0 or 1), -1 if it was not answered and the caller has to retry it
+      // Called inside of the caller's epoch, while its operation is under way
+      int offer(K key, int kind, int id) {
+          Offer& mine = this->offers[id];
+          std::uint64_t sequence = (mine.state.load(std::memory_order_relaxed) >> 2) + 1;
+          mine.key = key;
+          mine.kind = kind;
+          std::uint64_t waiting = (sequence << 2) | WAITING;
+          mine.state.store(waiting, std::memory_order_release);
+          Slot& slot = this->slotOf(key);
+          Offer* expected = slot.offer.load();
+          if (expected != nullptr && (expected->state.load() & 3) == WAITING) {  // Taken by another key or thread
+              mine.state.store((sequence << 2) | IDLE, std::memory_order_relaxed);
+              return -1;
+          }
+          if (!slot.offer.compare_exchange_strong(expected, &mine)) {
+              mine.state.store((sequence << 2) | IDLE, std::memory_order_relaxed);
+              return -1;
+          }
+          for (int i = 0; i < this->spins; i++) {
+              if (mine.state.load(std::memory_order_acquire) != waiting) break;
+              cpuRelax();
+          }
+          std::uint64_t answer = waiting;
+          bool withdrawn = mine.state.compare_exchange_strong(answer, (sequence << 2) | IDLE);
+          Offer* self = &mine;
+          slot.offer.compare_exchange_strong(self, nullptr);
+          if (withdrawn) return -1;
+          return ((answer & 3) == ANSWERED_TRUE) ? 1 : 0;
+      }
+
+      // The offer waiting on key with its kind and the ticket answer needs, or nullptr
+      // The ticket only matches while that very offer waits
+      Offer* peek(K key, std::uint64_t* ticket, int* kind) {
+          Offer* offer = this->slotOf(key).offer.load(std::memory_order_acquire);
+          if (offer == nullptr) return nullptr;
+          std::uint64_t state = offer->state.load(std::memory_order_acquire);
+          if ((state & 3) != WAITING) return nullptr;
+          K offered = offer->key;
+          int offeredKind = offer->kind;
+          if (offer->state.load(std::memory_order_acquire) != state) return nullptr;  // Reused meanwhile
+          if (Compare()(offered, key) || Compare()(key, offered)) return nullptr;
+          *ticket = state;
+          *kind = offeredKind;
+          return offer;
+      }
+
+      // Gives the offer of ticket its result, returns false if it was withdrawn or answered first
+      // The caller checked where the key stands after peek, while the offer was still waiting
+      bool answer(Offer* offer, std::uint64_t ticket, bool result) {
+          std::uint64_t answered = (ticket & ~(std::uint64_t) 3) | (result ? ANSWERED_TRUE : ANSWERED_FALSE);
+          return offer->state.compare_exchange_strong(ticket, answered);
+      }
+
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef EPOCH_MANAGER_H
+#define EPOCH_MANAGER_H
+
+// Epoch Based Reclamation Class
+// A node retired by a thread is handed back (reclaimed) once every thread
+// that could still hold a reference to it has left the epoch it was retired in
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "PersistentMemory.h"
+
+template <typename Node>
+class EpochManager {
+
+  private:
+
+      static const int RETIRE_THRESHOLD = 64;       // Retires between attempts to advance the epoch
+      static const std::uint64_t QUIESCENT = ~0ull; // Announced while outside of an operation
+
+      // Nodes retired by a thread during one epoch
+      struct LimboBag {
+          std::vector<Node*> nodes;
+          std::uint64_t epoch;
+      };
+
+      // Written by others only through the announcement
+      struct alignas(CACHE_LINE_SIZE) ThreadState {
+          std::atomic<std::uint64_t> announcement;  // Epoch the thread is running in
+          LimboBag bags[3];                         // Bags of the last three epochs
+          int retireCount;
+      };
+
+      alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> globalEpoch;
+      std::vector<ThreadState> threads;
+      int numIDs;
+
+      // Hands back every node of the bag
+      template <typename Reclaim>
+      void emptyBag(LimboBag& bag, Reclaim& reclaim) {
+          int numNodes = bag.nodes.size();
+          for (int i = 0; i < numNodes; i++)
+              reclaim(bag.nodes[i]);
+          bag.nodes.clear();
+      }
+
+      // Moves the global epoch forward if every active thread has seen it
+      void tryAdvance(void) {
+          std::uint64_t epoch = this->globalEpoch.load(std::memory_order_acquire);
+          for (int i = 0; i < this->numIDs; i++) {
+              std::uint64_t announced = this->threads[i].announcement.load(std::memory_order_acquire);
+              if (announced != QUIESCENT && announced != epoch) return;
+          }
+          this->globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+      }
+
+  public:
+
+      // Constructor
+      // Will not be called concurrently
+      EpochManager(int numIDs) : threads(numIDs) {
+          this->globalEpoch.store(0);
+          for (int i = 0; i < numIDs; i++) {
+              this->threads[i].announcement.store(QUIESCENT);
+              for (int j = 0; j < 3; j++)
+                  this->threads[i].bags[j].epoch = 0;
+              this->threads[i].retireCount = 0;
+          }
+          this->numIDs = numIDs;
+      }
+
+      // Called before an operation touches any node
+      // Reclaims the bags that are two or more epochs old
+      template <typename Reclaim>
+      void enter(int id, Reclaim reclaim) {
+          ThreadState& thread = this->threads[id];
+          std::uint64_t epoch = this->globalEpoch.load(std::memory_order_acquire);
+          thread.announcement.store(epoch, std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_seq_cst);  // Announce before reading nodes
+          for (int i = 0; i < 3; i++) {
+              if (!thread.bags[i].nodes.empty() && thread.bags[i].epoch + 2 <= epoch)
+                  this->emptyBag(thread.bags[i], reclaim);
+          }
+      }
+
+      // The global epoch, a node retired after this is read is labelled with it or a later one
+      // and is not reclaimed until the global epoch is two past that
+      std::uint64_t getEpoch(void) {
+          return this->globalEpoch.load();
+      }
+
+      // Called once an operation no longer holds references to nodes
+      void exit(int id) {
+          this->threads[id].announcement.store(QUIESCENT, std::memory_order_release);
+      }
+
+      // Called (inside of an operation) by the thread that unlinked node
+      // The bag is the one of the global epoch, the announcement can lag behind it
+      // (a thread that read the global epoch just before it advanced) and a node labelled with it
+      // would be reclaimed while threads that entered since still hold it
+      template <typename Reclaim>
+      void retire(int id, Node* node, Reclaim reclaim) {
+          ThreadState& thread = this->threads[id];
+          std::uint64_t epoch = this->globalEpoch.load(std::memory_order_acquire);
+          LimboBag& bag = thread.bags[epoch % 3];
+          if (bag.epoch != epoch) {  // Holds an epoch at least three behind, safe
+              this->emptyBag(bag, reclaim);
+              bag.epoch = epoch;
+          }
+          bag.nodes.push_back(node);
+          thread.retireCount += 1;
+          if (thread.retireCount >= RETIRE_THRESHOLD) {
+              thread.retireCount = 0;
+              this->tryAdvance();
+          }
+      }
+
+};
+
+#endif
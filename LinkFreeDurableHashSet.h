@@ -0,0 +1,363 @@
+#ifndef LINK_FREE_DURABLE_HASH_SET_H
+#define LINK_FREE_DURABLE_HASH_SET_H
+
+// Link-Free Durable Hash Set Class
+// Keys are sharded across buckets, each bucket is a sorted link-free list
+// Nodes and flushes are the ones of the Link-Free Durable Set
+// The bucket array is volatile and is rebuilt by recover()
+// Sharded by node, the buckets are split into one range per NUMA node with its heads on that node
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "MemoryManager.h"
+#include "NodePool.h"
+#include "Stats.h"
+#include "LinkFreeDurableSet.h"
+#include "DurablePolicy.h"
+
+template <typename T>
+class LinkFreeDurableHashSet {
+
+  public:
+
+      typedef typename LinkFreeDurableSet<T>::Node Node;
+
+  private:
+
+      std::vector<Node*> buckets;  // Head of each bucket list
+      Node* tail;                  // Shared by every bucket list
+      int bucketShift;             // Keeps the top bits of the hash
+      int numBuckets;              // Power of two
+      int numShards;               // Ranges of buckets, one per NUMA node if sharded by node
+      NodePool<Node>* headPool;    // Bucket heads, shard s takes its heads from arena s
+
+      // These are for the simulation only
+      MemoryManager<T>* mem;
+      std::atomic<bool>* abortFlag;
+      DurableStore<Node, MemoryManager<T>, LinkFreeCells> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread CAS failures and nodes traversed
+      int readMode;              // READER_FLUSH or READER_NO_FLUSH
+      int numIDs;
+
+      // Fibonacci hashing, neighbouring keys land in different buckets
+      int bucketOf(long key) {
+          return (int) ((((std::uint64_t) key) * 0x9E3779B97F4A7C15ull) >> this->bucketShift);
+      }
+
+      // Shard s holds the buckets [s * numBuckets / numShards, (s + 1) * numBuckets / numShards)
+      int shardOfBucket(int bucket) {
+          return (int) (((long) bucket * this->numShards) / this->numBuckets);
+      }
+
+      // Heads of shard s are placed on the s'th node of the placement
+      void createHeadPool(void) {
+          this->headPool = new NodePool<Node>(this->numShards, this->numBuckets / this->numShards + 1);
+          NumaTopology* topology = NumaTopology::placement();
+          for (int s = 0; s < this->numShards; s++)
+              this->headPool->setNode(s, (topology == nullptr) ? -1 : topology->nodeAt(s % topology->numNodes()));
+      }
+
+      Node* createHead(int bucket) {
+          int shard = this->shardOfBucket(bucket);
+          Node* head = this->headPool->peek(shard);
+          this->headPool->commit(shard);
+          return head;
+      }
+
+      // Creates an empty list (head -> tail) for every bucket
+      void createBuckets(void) {
+          this->createHeadPool();
+          this->buckets = std::vector<Node*>(this->numBuckets);
+          for (int i = 0; i < this->numBuckets; i++) {
+              this->buckets.at(i) = this->createHead(i);
+              this->buckets.at(i)->key = MIN_KEY;  // Make sure keys are not less than
+              this->buckets.at(i)->next.store(this->tail);
+          }
+      }
+
+      // Takes two nodes and removes current
+      // Assume current has already been marked as valid
+      // Assume current has a marked successor
+      // So a new node won't be inserted behind current
+      bool trim(Node* previous, Node* current, int id) {
+          current->FLUSH_DELETE(this->mem, id);
+          Node *successor = current->getNextRef();
+          if (previous->next.compare_exchange_strong(current, successor)) return true;
+          this->stats.add(id, TRIM_CAS_FAILURES);
+          return false;
+      }
+
+      // Common function to traverse the bucket list of key
+      // Trims logically deleted nodes that have yet to be removed
+      Node* find(Node** curr, long key, int id) {
+          Node* previous = this->buckets[this->bucketOf(key)];
+          Node* current = previous->next.load();
+          long traversed = 0;
+          while (true) {
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
+
+              if (!current->isNextMarked()) {      // Make sure not logically deleted
+                  if (current->key >= key) break;
+                  previous = current;
+              } else {                             // Remove the logically deleted node
+                  trim(previous, current, id);
+              }
+              current = current->getNextRef();
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          *curr = current;
+          return previous;
+      }
+
+  public:
+
+      // Constructor
+      // numBuckets is rounded up to a power of two
+      // shardByNode splits the buckets over the nodes of the NumaTopology placement (if there is one),
+      // shardOf(key) tells which node the bucket of key lives on
+      // Will not be called concurrently
+      LinkFreeDurableHashSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, int numBuckets,
+                             bool shardByNode = false) : store(mem, numIDs) {
+          this->stats = OperationStats(numIDs);
+          this->numBuckets = 2;  // At least two, a 64 bit shift is undefined
+          this->bucketShift = 63;
+          while (this->numBuckets < numBuckets) {
+              this->numBuckets = this->numBuckets << 1;
+              this->bucketShift -= 1;
+          }
+          this->numIDs = numIDs;
+          this->numShards = 1;
+          NumaTopology* topology = NumaTopology::placement();
+          if (shardByNode && topology != nullptr)
+              this->numShards = std::min(topology->numNodes(), this->numBuckets);
+          this->tail = new Node();
+          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+          this->createBuckets();
+          this->abortFlag = abortFlag;
+          this->mem = mem;
+          this->readMode = READER_FLUSH;
+      }
+
+      // Free the durable sets nodes
+      void FREE() {
+          delete this->headPool;
+          delete this->tail;
+          this->store.release();
+      }
+
+      // Inserts a key at a designated spot in its bucket
+      // If key already present help flush
+      // Loop until key is added or already found
+      bool insert(long key, T item, int id) {
+          Node *previous = nullptr;
+          Node *current = nullptr;
+          while (true) {
+              previous = this->find(&current, key, id);
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              if (current->key == key) {
+                  current->makeValid();
+                  current->FLUSH_INSERT(this->mem, id);
+                  return false;
+              }
+              Node* newNode = this->store.allocate(id);
+              if (newNode == nullptr) return false; // No memory available
+              newNode->flipV1();
+              std::atomic_thread_fence(std::memory_order_release);
+              newNode->key = key;
+              newNode->item = item;
+              newNode->next.store(current, std::memory_order_relaxed);
+              if (previous->next.compare_exchange_strong(current, newNode)) {  // Linearization point
+                  this->store.commit(id);
+                  newNode->makeValid();
+
+                  // Abort Check (For abort testing only)
+                  CRASH_POINT(this->abortFlag, true);
+
+                  newNode->FLUSH_INSERT(this->mem, id);
+                  return true;
+              }
+              this->stats.add(id, INSERT_CAS_FAILURES);
+          }
+      }
+
+      // READER_NO_FLUSH makes contains report the last durable state without flushing
+      // Not run concurrently with the operations
+      void setReadMode(int mode) {
+          this->readMode = mode;
+      }
+
+      int getReadMode(void) {
+          return this->readMode;
+      }
+
+      // Searched for key in its bucket
+      // Skips over logically deleted nodes
+      // If key is set for deletion will help remove
+      // Always attempts to flush the node if present (READER_FLUSH)
+      bool contains(long key, int id) {
+          Node* current = this->buckets[this->bucketOf(key)]->next.load();
+          long traversed = 0;
+          while (current->key < key) {
+              current = current->getNextRef();
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          if (current->key != key) return false;
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (this->readMode == READER_NO_FLUSH) return current->isDurablyPresent();
+          if (current->isNextMarked()) {
+              current->FLUSH_DELETE(this->mem, id);
+              return false;
+          }
+          current->makeValid();
+          current->FLUSH_INSERT(this->mem, id);
+          return true;
+      }
+
+      // Loops until node with key is removed
+      // Finds the node with the key
+      // Grabs its successor (marks)
+      // validates the node, incase needed
+      // CAS with a marked successor node
+      bool remove(long key, int id) {
+          Node* previous = nullptr;
+          Node* current = nullptr;
+          bool result = false;
+          while (!result) {
+              previous = find(&current, key, id);
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              if (current->key != key) return false;
+              Node* successor = current->getNextRef();
+              Node* markedSuccessor = successor->mark();
+              current->makeValid();
+              result = current->next.compare_exchange_strong(successor, markedSuccessor);
+              if (!result) this->stats.add(id, REMOVE_CAS_FAILURES);
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, true);
+
+          }
+          // current has been validated and logically deleted
+          trim(previous, current, id);
+          return true;
+      }
+
+      // Deletes all of the nodes
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Rebuilds the bucket array and links the valid nodes in key order in one pass
+      // Will not be called concurrently
+      void recover(void) {
+          std::vector<Node*> last;  // Last node linked in each bucket
+          this->store.recover(
+              [this](std::vector<long>* keys) {
+                  for (int i = 0; i < this->numBuckets; i++)
+                      for (Node* current = this->buckets.at(i)->getNextRef(); current != this->tail; current = current->getNextRef())
+                          if (!current->isNextMarked())
+                              keys->push_back(current->key);
+              },
+              [this, &last](void) {
+                  this->FREE();
+                  this->tail = new Node();
+                  this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+                  this->createBuckets();
+                  last = this->buckets;
+              },
+              [this, &last](Node* node, const typename MemoryManager<T>::RecoveredCell& cell) {
+                  Node*& previous = last.at(this->bucketOf(cell.key));
+                  previous->next.store(node, std::memory_order_relaxed);
+                  previous = node;
+              });
+          for (int i = 0; i < this->numBuckets; i++)
+              last.at(i)->next.store(this->tail);
+      }
+
+      // Index of the shard (node of the placement) holding the bucket of key
+      int shardOf(long key) {
+          return this->shardOfBucket(this->bucketOf(key));
+      }
+
+      int getNumShards(void) {
+          return this->numShards;
+      }
+
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
+      }
+
+      // For testing (not run concurrentlly)
+      void printSet(void) {
+          std::cout << "Set keys" << std::endl;
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* current = this->buckets.at(i)->getNextRef();
+              while (current != this->tail) {
+                  if (!current->isNextMarked())    // Make sure not logically deleted (incase)
+                      std::cout << "bucket: " << i << " key: " << current->key << std::endl;
+                  else                             // Logically deleted nodes should not be found
+                      std::cout << "bucket: " << i << " key: A marked node was found" << std::endl;
+                  current = current->getNextRef();
+              }
+          }
+      }
+
+      // For testing (not run concurrentlly)
+      void printSetSize(void) {
+          int count = 0;
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* current = this->buckets.at(i)->getNextRef();
+              while (current != this->tail) {
+                  if (!current->isNextMarked())    // Make sure not logically deleted (incase)
+                      count += 1;
+                  else                             // Logically deleted nodes should not be found
+                      std::cout << "key: A marked node was found" << std::endl;
+                  current = current->getNextRef();
+              }
+          }
+          std::cout << "Set size: " << count << std::endl;
+      }
+
+      // For testing (not run concurrentlly)
+      // Every bucket is in key order and only holds keys of that bucket
+      // bucketSizes gets the keys in each bucket (a removed node still linked is not counted)
+      bool checkBuckets(std::vector<long>* bucketSizes) {
+          bucketSizes->assign(this->numBuckets, 0);
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* previous = this->buckets.at(i);
+              for (Node* current = previous->getNextRef(); current != this->tail; current = current->getNextRef()) {
+                  if (current == nullptr || current->key <= previous->key || this->bucketOf(current->key) != i) return false;
+                  if (!current->isNextMarked()) bucketSizes->at(i) += 1;
+                  previous = current;
+              }
+          }
+          return true;
+      }
+
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
+      // For testing (not run concurrentlly) (For abort testing only)
+      void printRecovery(void) {
+          this->store.printRecovery();
+      }
+
+};
+
+#endif
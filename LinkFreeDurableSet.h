@@ -2,30 +2,43 @@
 #define LINK_FREE_DURABLE_SET_H
 
 // Link-Free Durable Set Class
+// Keys of type K are ordered by Compare, the head and tail keys come from KeyTraits<K, Compare>
+// Value decides what a node holds for its item (see DurableTypes.h), the item itself by default
+// Readers flush what they report (READER_FLUSH) or only report what is durable (READER_NO_FLUSH)
 
+#include <iostream>
 #include <atomic>
 #include <vector>
 #include <cstdint>
 #include "MemoryManager.h"
-
-long MIN_KEY = -100000;
-long MAX_KEY = 100000;
-
-template <typename T>
+#include "NodePool.h"
+#include "EpochManager.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
+#include "EliminationArray.h"
+
+template <typename T, typename K = long, typename Compare = std::less<K>, typename Value = InlineValue<T>>
 class LinkFreeDurableSet {
 
   public:
 
+      typedef typename Value::Stored Stored;  // T or the offset of an out of line T
+      typedef MemoryManager<Stored, K, Compare> Memory;
+      typedef EliminationArray<K, Compare> Eliminator;
+
       // Similar field to the node in MemoryManager
       // (except) durableAddress(Pre/Post)fix
-      struct Node {
+      // Line aligned (DurableLayout<T>) so the CAS'd next never straddles lines
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
 
-          long key;
-          T item;
+          K key;
+          Stored item;
           std::atomic<int> validBits;         // Used for validiting insert
           std::atomic<bool> insertValidFlag;  // Optimization to reduce the number of FLUSH_INSERT
           std::atomic<bool> deleteValidFlag;  // Optimization to reduce the number of FLUSH_DELETE
           std::atomic<Node*> next;            // Marked for logical delete
+          Node* nextFree;                     // Link in a free list once reclaimed
 
           // These are for the simulation only
           int durableAddressPrefix;      // Is the threads id
@@ -33,12 +46,13 @@ class LinkFreeDurableSet {
 
           // Constructor
           Node(void) {
-              this->key = 0;
-              this->item = (T) 0;
+              this->key = K();
+              this->item = Stored();
               this->validBits.store(0);
               this->insertValidFlag.store(false);
               this->deleteValidFlag.store(false);
               this->next.store(nullptr);
+              this->nextFree = nullptr;
               this->durableAddressPrefix = -1;
               this->durableAddressPostfix = -1;
           }
@@ -63,298 +77,841 @@ class LinkFreeDurableSet {
               this->validBits.store((this->validBits.load() | 2), std::memory_order_release);  // Linearization
           }
 
-          void FLUSH_INSERT(MemoryManager<T>* mem) {
+          // The node as a READER_NO_FLUSH reader sees it, without flushing
+          // Present once its insert is durable and until its remove is (flags only go false to true)
+          bool isDurablyPresent(void) {
+              if (!this->insertValidFlag.load(std::memory_order_acquire)) return false;
+              return !this->isNextMarked() || !this->deleteValidFlag.load(std::memory_order_acquire);
+          }
+
+          // The cell gets a copy, a copy taken before the mark may land after FLUSH_DELETE's own,
+          // so it is written again until the mark did not change meanwhile
+          void FLUSH_INSERT(Memory* mem, int id) {
               if (this->insertValidFlag.load() == false) {  // Optimzation
-                  mem->FLUSH(this->key,  // This call is always the same for a given node
-                             this->item,
-                             this->validBits.load(),
-                             this->insertValidFlag.load(),
-                             this->deleteValidFlag.load(),
-                             (std::uintptr_t) this->next.load(),
-                             this->durableAddressPrefix,
-                             this->durableAddressPostfix);
+                  std::uintptr_t next;
+                  do {
+                      next = (std::uintptr_t) this->next.load();
+                      mem->FLUSH(this->key,  // This call is always the same for a given node
+                                 this->item,
+                                 {this->validBits.load(),
+                                  this->insertValidFlag.load(),
+                                  this->deleteValidFlag.load(),
+                                  next},
+                                 this->durableAddressPrefix,
+                                 this->durableAddressPostfix,
+                                 id);
+                  } while ((next & 1) != ((std::uintptr_t) this->next.load() & 1));
                   this->insertValidFlag.store(true, std::memory_order_release);
+              } else {
+                  mem->elideFlush(id);
               }
           }
 
-          void FLUSH_DELETE(MemoryManager<T>* mem) {
+          void FLUSH_DELETE(Memory* mem, int id) {
               if (this->deleteValidFlag.load() == false) {  // Optimzation
                   mem->FLUSH(this->key,  // This call is always the same for a given node
                              this->item,
-                             this->validBits.load(),
-                             this->insertValidFlag.load(),
-                             this->deleteValidFlag.load(),
-                             (std::uintptr_t) this->next.load(),
+                             {this->validBits.load(),
+                              this->insertValidFlag.load(),
+                              this->deleteValidFlag.load(),
+                              (std::uintptr_t) this->next.load()},
                              this->durableAddressPrefix,
-                             this->durableAddressPostfix);
+                             this->durableAddressPostfix,
+                             id);
                   this->deleteValidFlag.store(true, std::memory_order_release);
+              } else {
+                  mem->elideFlush(id);
               }
           }
 
-      }; // aligned(cache line size);
+      };
+
+      struct ThreadContext;  // Handle of a registered thread (see registerThread)
+
+      // Ascending iterator over the keys in [lo, hi]
+      // Holds an epoch of thread id until it is destroyed, thread id may not use the set meanwhile
+      // Weakly consistent: every key comes once and in order, a key present for the whole
+      // iteration is always reached, a key reached was present (and durable) during the iteration
+      class Iterator {
+
+        private:
+
+            LinkFreeDurableSet* set;
+            Node* current;  // nullptr once past hi
+            K hi;
+            int id;
+
+            // Moves current to the first present node from node on
+            // Flushes like contains, nodes passed over are logically deleted (or not durable)
+            void settle(Node* node) {
+                long traversed = 0;
+                while (node != this->set->tail && !before(this->hi, node->key)) {
+                    if (this->set->readMode == READER_NO_FLUSH) {
+                        if (node->isDurablyPresent()) break;
+                    } else {
+                        if (!node->isNextMarked()) {
+                            node->makeValid();
+                            node->FLUSH_INSERT(this->set->mem, this->id);
+                            break;
+                        }
+                        node->FLUSH_DELETE(this->set->mem, this->id);
+                    }
+                    node = node->getNextRef();
+                    traversed += 1;
+                }
+                this->set->stats.add(this->id, NODES_TRAVERSED, traversed);
+                this->current = (node != this->set->tail && !before(this->hi, node->key)) ? node : nullptr;
+            }
+
+        public:
+
+            // Constructor
+            Iterator(LinkFreeDurableSet* set, K lo, K hi, int id) {
+                this->set = set;
+                this->hi = hi;
+                this->id = id;
+                this->set->enterEpoch(id);
+                Node* node = this->set->head->next.load();
+                long traversed = 0;
+                while (node != this->set->tail && before(node->key, lo)) {
+                    node = node->getNextRef();
+                    traversed += 1;
+                }
+                this->set->stats.add(id, NODES_TRAVERSED, traversed);
+                this->settle(node);
+            }
+
+            Iterator(const Iterator&) = delete;
+            Iterator& operator=(const Iterator&) = delete;
+
+            // Destructor
+            ~Iterator(void) {
+                this->set->exitEpoch(this->id);
+            }
+
+            bool valid(void) {
+                return this->current != nullptr;
+            }
+
+            K key(void) {
+                return this->current->key;
+            }
+
+            T item(void) {
+                return this->set->values.load(this->current->item);
+            }
+
+            void next(void) {
+                this->settle(this->current->getNextRef());
+            }
+
+      };
 
   private:
 
       Node* head;
       Node* tail;
 
+      // Reclaimed nodes (with their durable cell) waiting to be reused
+      // local is only touched by its thread, others push onto remote
+      struct alignas(CACHE_LINE_SIZE) FreeList {
+          Node* local;
+          std::atomic<Node*> remote;
+      };
+      EpochManager<Node>* epochs;
+      std::vector<FreeList> freeLists;
+      std::vector<ThreadContext> contexts;  // One per id, handed out by registerThread
+      std::atomic<int> registered;          // Ids handed out so far
+
       // These are for the simulation only
-      MemoryManager<T>* mem;
+      Memory* mem;
+      Value values;              // Stores and loads the items
       std::atomic<bool>* abortFlag;
-      std::vector<std::vector<Node*>> preAllocatedNodes;
-      std::vector<int> allocIndices;  // Points current free node for insert
-      std::vector<int> maxIndices;
-      std::vector<long> keysVolatileRecovered;
-      std::vector<long> keysDurableRecovered;
+      DurableStore<Node, Memory, LinkFreeCells, K> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread CAS failures and nodes traversed
+      int readMode;              // READER_FLUSH or READER_NO_FLUSH
+      int trimMode;              // TRIM_INLINE or TRIM_DEFERRED
+      long maxBacklog;           // Removed nodes left linked before removes trim inline (TRIM_DEFERRED)
+      alignas(CACHE_LINE_SIZE) std::atomic<long> backlog;  // Removed nodes still linked (TRIM_DEFERRED)
+      int contentionMode;        // CONTENTION_RETRY or CONTENTION_ELIMINATE
+      int searchMode;            // SEARCH_FROM_HEAD or SEARCH_FROM_FINGER
+      Eliminator eliminator;     // Offers of the operations that lost their CAS (CONTENTION_ELIMINATE)
       int numIDs;
 
-      // Gets memory address from permanent storage and ties it with prealloc node
-      Node* allocFromArea(int id) {
-          Node* newNode = this->preAllocatedNodes.at(id).at(this->allocIndices.at(id));
-          // Retrieve durable address
-          int durAddr = this->mem->retrieveAddress(id);
-          if (durAddr == -1) {
-              return nullptr;
+      // Keys are equal when neither is before the other
+      static bool before(const K& a, const K& b) {
+          return Compare()(a, b);
+      }
+
+      static bool same(const K& a, const K& b) {
+          return !Compare()(a, b) && !Compare()(b, a);
+      }
+
+      // Gives a reclaimed node back to the thread that owns its durable cell
+      void reclaim(Node* node, int id) {
+          FreeList& freeList = this->freeLists.at(node->durableAddressPrefix);
+          if (node->durableAddressPrefix == id) {
+              node->nextFree = freeList.local;
+              freeList.local = node;
+              return;
           }
-          // set the durableAddress(Pre/Post)fix
-          newNode->durableAddressPrefix = id;
-          newNode->durableAddressPostfix = durAddr;
-          return newNode;
+          Node* top = freeList.remote.load();
+          do {
+              node->nextFree = top;
+          } while (!freeList.remote.compare_exchange_weak(top, node));
+      }
+
+      // Every operation runs inside of an epoch
+      void enterEpoch(int id) {
+          this->epochs->enter(id, [this, id](Node* node) { this->reclaim(node, id); });
+      }
+
+      void exitEpoch(int id) {
+          this->epochs->exit(id);
+      }
+
+      // Called by the thread whose CAS unlinked node
+      void retire(Node* node, int id) {
+          this->epochs->retire(id, node, [this, id](Node* node) { this->reclaim(node, id); });
+      }
+
+      // Gets memory address from permanent storage and ties it with a pool node
+      // Reclaimed nodes are reused first, they keep the durable cell they were given
+      Node* allocFromArea(ThreadContext* context) {
+          int id = context->id;
+          FreeList& freeList = *context->freeList;
+          if (freeList.local == nullptr)  // Take what other threads have reclaimed
+              freeList.local = freeList.remote.exchange(nullptr);
+          if (freeList.local != nullptr) {
+              Node* reusedNode = freeList.local;
+              reusedNode->validBits.store(0, std::memory_order_relaxed);
+              reusedNode->insertValidFlag.store(false, std::memory_order_relaxed);
+              reusedNode->deleteValidFlag.store(false, std::memory_order_relaxed);
+              return reusedNode;
+          }
+          return this->store.allocate(context->pool, context->section, id);
       }
 
       // Insertion was successful move the indices
-      void updateAlloc(int id) {
-          this->allocIndices.at(id) -= 1;
-          this->mem->updateAddress(id);
+      void updateAlloc(ThreadContext* context) {
+          FreeList& freeList = *context->freeList;
+          if (freeList.local != nullptr) {  // allocFromArea handed out the reused node
+              freeList.local = freeList.local->nextFree;
+              return;
+          }
+          this->store.commit(context->pool, context->section);
+      }
+
+      // Points every context at the pool, section and free list of its id
+      // Called again once recover() rebuilt the node pool
+      void bindContexts(void) {
+          for (int i = 0; i < this->numIDs; i++) {
+              ThreadContext& context = this->contexts.at(i);
+              context.id = i;
+              context.pool = this->store.nodePool->pool(i);
+              context.section = this->mem->section(i);
+              context.freeList = &this->freeLists.at(i);
+              context.finger = nullptr;
+          }
+      }
+
+      // Where an operation of context starts (SEARCH_FROM_FINGER): its finger, unless the global
+      // epoch moved past the one leaveFinger read. Once it did, a retire of the node labelled with
+      // that epoch may be reclaimed while this thread is announced in the next one
+      // Called inside of an epoch, which keeps a node that passes protected from then on
+      Node* startOf(ThreadContext* context) {
+          if (this->searchMode != SEARCH_FROM_FINGER || context->finger == nullptr) return this->head;
+          if (this->epochs->getEpoch() != context->fingerEpoch) return this->head;
+          return context->finger;
+      }
+
+      // Leaves node (reached inside of this epoch) as the finger of context
+      // The epoch is read before node is seen unmarked, so a retire of node comes later and is
+      // labelled with that epoch or a later one
+      void leaveFinger(ThreadContext* context, Node* node) {
+          if (this->searchMode != SEARCH_FROM_FINGER) return;
+          context->fingerEpoch = this->epochs->getEpoch();
+          context->finger = node->isNextMarked() ? nullptr : node;
       }
 
       // Takes two nodes and removes current
       // Assume current has already been marked as valid
       // Assume current has a marked successor
       // So a new node won't be inserted behind current
-      bool trim(Node* previous, Node* current) {
-          current->FLUSH_DELETE(this->mem);
+      // The thread that unlinks current retires it
+      bool trim(Node* previous, Node* current, int id) {
+          current->FLUSH_DELETE(this->mem, id);
           Node *successor = current->getNextRef();
-          return previous->next.compare_exchange_strong(current, successor);
+          if (!previous->next.compare_exchange_strong(current, successor)) {
+              this->stats.add(id, TRIM_CAS_FAILURES);
+              return false;
+          }
+          this->retire(current, id);
+          this->stats.add(id, NODES_TRIMMED);
+          if (this->trimMode == TRIM_DEFERRED) this->backlog.fetch_sub(1);
+          return true;
+      }
+
+      // Unlinks the run of marked nodes [first, stop) behind previous with one CAS (TRIM_DEFERRED)
+      // Their deletes are FLUSHed first, marked nodes never change their next so the run stays put
+      // The thread that unlinks the run retires it, returns the number of nodes unlinked
+      long trimRun(Node* previous, Node* first, Node* stop, int id) {
+          long count = 0;
+          for (Node* node = first; node != stop; node = node->getNextRef()) {
+              node->FLUSH_DELETE(this->mem, id);
+              count += 1;
+          }
+          Node* expected = first;
+          if (!previous->next.compare_exchange_strong(expected, stop)) {
+              this->stats.add(id, TRIM_CAS_FAILURES);
+              return 0;
+          }
+          for (Node* node = first; node != stop; ) {
+              Node* next = node->getNextRef();
+              this->retire(node, id);
+              node = next;
+          }
+          this->stats.add(id, NODES_TRIMMED, count);
+          this->backlog.fetch_sub(count);
+          return count;
+      }
+
+      // Answers the offer waiting on key (CONTENTION_ELIMINATE) for an operation of kind that found key
+      // absent, previous->next is read again once the offer was seen to check it still is
+      // Insert + remove pairs both succeed, a remove offer fails, an insert offer is left alone
+      // Returns true if kind succeeds through the offer it answered
+      bool answerAbsent(K key, int kind, Node* previous, Node* current, int id) {
+          std::uint64_t ticket;
+          int offered;
+          typename Eliminator::Offer* offer = this->eliminator.peek(key, &ticket, &offered);
+          if (offer == nullptr || (offered == Eliminator::OFFER_INSERT && kind == Eliminator::OFFER_INSERT))
+              return false;
+          if (previous->next.load() != current) return false;  // No longer a witness of the gap
+          if (!this->eliminator.answer(offer, ticket, offered != kind)) return false;
+          if (offered != kind) this->stats.add(id, OPS_ELIMINATED);
+          return offered != kind;
+      }
+
+      // Answers an insert offer on key (CONTENTION_ELIMINATE) with false while node is still present
+      // node holds key and its insert is durable
+      void answerPresent(K key, Node* node) {
+          std::uint64_t ticket;
+          int offered;
+          typename Eliminator::Offer* offer = this->eliminator.peek(key, &ticket, &offered);
+          if (offer == nullptr || offered != Eliminator::OFFER_INSERT || node->isNextMarked()) return;
+          this->eliminator.answer(offer, ticket, false);
       }
 
       // Common function to traverse the linked list
       // Trims logically deleted nodes that have yet to be removed
-      Node* find(Node** curr, long key) {
-          Node* previous = this->head;
+      // (TRIM_DEFERRED only the run right in front of the node found, the others are left to trimBacklog)
+      // Starts from start if it is still in the list and before key, otherwise from the head
+      // start must be protected by the callers epoch
+      Node* find(Node** curr, K key, int id, Node* start) {
+          Node* previous = start;
+          if (start->isNextMarked() || !before(start->key, key)) previous = this->head;
           Node* current = previous->next.load();
+          Node* run = nullptr;  // First marked node behind previous (TRIM_DEFERRED)
+          long traversed = 0;
           while (true) {
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return nullptr;
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
 
               if (!current->isNextMarked()) {      // Make sure not logically deleted
-                  if (current->key >= key) break;
+                  if (!before(current->key, key)) break;
                   previous = current;
-              } else {                             // Remove the logically deleted node
-                  trim(previous, current);
+                  run = nullptr;
+              } else if (this->trimMode == TRIM_INLINE) {  // Remove the logically deleted node
+                  trim(previous, current, id);
+              } else if (run == nullptr) {
+                  run = current;
               }
               current = current->getNextRef();
+              traversed += 1;
           }
+          if (run != nullptr) this->trimRun(previous, run, current, id);
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           *curr = current;
           return previous;
       }
 
-  public:
-
-      // Constructor
-      // Will not be called concurrently
-      LinkFreeDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, std::vector<int>* writeOpsVector) {
-          this->allocIndices = std::vector<int>(numIDs);
-          this->maxIndices = std::vector<int>(numIDs);
-          this->preAllocatedNodes = std::vector<std::vector<Node*>>(numIDs);
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i);
-          }
-          for (int i = 0; i < numIDs; i++) {
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(writeOpsVector->at(i));
-              for (int j = 0; j < writeOpsVector->at(i); j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
-              }
-          }
-          this->numIDs = numIDs;
-          this->head = new Node();
-          this->tail = new Node();
-          this->head->next.store(this->tail);
-          this->head->key = MIN_KEY;  // Make sure keys are not less than
-          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
-          this->abortFlag = abortFlag;
-          this->mem = mem;
-          this->keysVolatileRecovered = std::vector<long>();
-          this->keysDurableRecovered = std::vector<long>();
-      }
-
-      // Free the durable sets preallocated nodes
-      void FREE() {
-          delete this->head;
-          delete this->tail;
-          for (int i = 0; i < this->numIDs; i++) {
-              for (int j = 0; j < this->maxIndices.at(i); j++) {
-                  delete this->preAllocatedNodes.at(i).at(j);
-              }
-          }
-      }
-
-      // Inserts a key at a designated spot in the list
+      // Inserts a key at a designated spot in the list, searching from start (see find)
       // If key already present help flush
       // Loop until key is added or already found
-      bool insert(long key, T item, int id) {
+      // *last is left on a node before any greater key, a batch resumes from it
+      // Called inside of an epoch
+      bool insertFrom(Node* start, K key, T item, ThreadContext* context, Node** last) {
+          int id = context->id;
           Node *previous = nullptr;
           Node *current = nullptr;
           while (true) {
-              previous = this->find(&current, key);
+              previous = this->find(&current, key, id, start);
+              *last = previous;
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return false;
+              CRASH_POINT(this->abortFlag, false);
 
-              if (current->key == key) {
+              if (same(current->key, key)) {
                   current->makeValid();
-                  current->FLUSH_INSERT(this->mem);
+                  current->FLUSH_INSERT(this->mem, id);
+                  if (this->contentionMode == CONTENTION_ELIMINATE) this->answerPresent(key, current);
                   return false;
               }
-              Node* newNode = this->allocFromArea(id);
+              if (this->contentionMode == CONTENTION_ELIMINATE &&
+                  this->answerAbsent(key, Eliminator::OFFER_INSERT, previous, current, id))
+                  return true;  // Inserted and removed at once
+              Node* newNode = this->allocFromArea(context);
               if (newNode == nullptr) return false; // No memory available
+              Stored stored = this->values.store(item, newNode->durableAddressPrefix, newNode->durableAddressPostfix);
+              if (this->values.failed(stored)) return false; // No memory available, the node is not taken
               newNode->flipV1();
               std::atomic_thread_fence(std::memory_order_release);
               newNode->key = key;
-              newNode->item = item;
+              newNode->item = stored;
               newNode->next.store(current, std::memory_order_relaxed);
               if (previous->next.compare_exchange_strong(current, newNode)) {  // Linearization point
-                  this->updateAlloc(id);
+                  this->updateAlloc(context);
                   newNode->makeValid();
 
                   // Abort Check (For abort testing only)
-                  // if (this->abortFlag->load() == true) return true;
+                  CRASH_POINT(this->abortFlag, true);
 
-                  newNode->FLUSH_INSERT(this->mem);
+                  newNode->FLUSH_INSERT(this->mem, id);
+                  if (this->contentionMode == CONTENTION_ELIMINATE) this->answerPresent(key, newNode);
+                  *last = newNode;
                   return true;
               }
+              this->stats.add(id, INSERT_CAS_FAILURES);
+              if (this->contentionMode == CONTENTION_ELIMINATE) {  // Someone on key may answer instead of a retry
+                  int result = this->eliminator.offer(key, Eliminator::OFFER_INSERT, id);
+                  if (result >= 0) {
+                      this->stats.add(id, OPS_ELIMINATED);
+                      return result == 1;
+                  }
+              }
+              start = previous;  // The retry searches on from previous, find falls back to the head once it is marked
           }
       }
 
-      // Searched for key
-      // Skips over logically deleted nodes
-      // If key is set for deletion will help remove
-      // Always attempts to flush the node if present
-      bool contains(long key) {
-          Node* current = this->head->next.load();
-          while (current->key < key) {
-              current = current->getNextRef();
-          }
-          if (current->key != key) return false;
-
-          // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return false;
-
-          if (current->isNextMarked()) {
-              current->FLUSH_DELETE(this->mem);
-              return false;
-          }
-          current->makeValid();
-          current->FLUSH_INSERT(this->mem);
-          return true;
-      }
-
       // Loops until node with key is removed
       // Finds the node with the key
       // Grabs its successor (marks)
       // validates the node, incase needed
       // CAS with a marked successor node
-      bool remove(long key) {
+      // Searches from start (see find), *last is left on a node before any greater key
+      // Called inside of an epoch
+      bool removeFrom(Node* start, K key, int id, Node** last) {
           Node* previous = nullptr;
           Node* current = nullptr;
           bool result = false;
           while (!result) {
-              previous = find(&current, key);
+              previous = find(&current, key, id, start);
+              *last = previous;
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return false;
+              CRASH_POINT(this->abortFlag, false);
 
-              if (current->key != key) return false;
+              if (!same(current->key, key)) {
+                  if (this->contentionMode != CONTENTION_ELIMINATE) return false;
+                  return this->answerAbsent(key, Eliminator::OFFER_REMOVE, previous, current, id);
+              }
               Node* successor = current->getNextRef();
               Node* markedSuccessor = successor->mark();
               current->makeValid();
               result = current->next.compare_exchange_strong(successor, markedSuccessor);
+              if (!result) {
+                  this->stats.add(id, REMOVE_CAS_FAILURES);
+                  if (this->contentionMode == CONTENTION_ELIMINATE) {  // Someone on key may answer instead of a retry
+                      int answer = this->eliminator.offer(key, Eliminator::OFFER_REMOVE, id);
+                      if (answer >= 0) {
+                          this->stats.add(id, OPS_ELIMINATED);
+                          return answer == 1;
+                      }
+                  }
+                  start = previous;  // As for insertFrom
+              }
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
+              CRASH_POINT(this->abortFlag, result);  // Only a won CAS removed key
 
           }
           // current has been validated and logically deleted
-          trim(previous, current);
+          // TRIM_DEFERRED persists the delete and leaves the node linked, unless the backlog is full
+          if (this->trimMode == TRIM_DEFERRED) {
+              current->FLUSH_DELETE(this->mem, id);
+              if (this->backlog.fetch_add(1) < this->maxBacklog) return true;
+          }
+          trim(previous, current, id);
           return true;
       }
 
-      // Deletes all of the nodes
-      // Reads and resets memory
-      // Re-adds the valid nodes read from memory
-      // Will not be called concurrently
-      void recover(std::vector<int>* writeOpsVector) {
-
-          // Read Memory Manager
-          std::vector<long>* keys = new std::vector<long>();
-          std::vector<T>* items = new std::vector<T>();
-          std::vector<int>* durableAddressPrefixes = new std::vector<int>();
-          std::vector<int>* activeNodes = new std::vector<int>(this->numIDs);
-          for (int i = 0; i < this->numIDs; i++) activeNodes->at(i) = 0;
-          int numActiveNodes = this->mem.recoverMemory(keys, items, durableAddressPrefixes, activeNodes);
-
-          // Record volatile memory (For testing only)
-          this->keysVolatileRecovered = std::vector<long>();
-          Node* current = this->head->next.load();
-          while (current->next.load() != nullptr) {  // Only tail->next == nullptr
-              if (!current->isNextMarked())
-                  this->keysVolatileRecovered.push_back(current->key);
-              current = current->getNextRef();
-          }
+      // Deletes all of the nodes and links the nodes of cells (numActiveNodes, in key order) in one pass
+      // Used by recover and restore
+      void rebuild(std::vector<typename Memory::RecoveredCell>& cells, int numActiveNodes) {
+          Node* previous = nullptr;  // Last node linked
+          this->store.rebuild(cells, numActiveNodes,
+              [this](std::vector<K>* keys) {
+                  for (Node* current = this->head->getNextRef(); current != this->tail; current = current->getNextRef())
+                      if (!current->isNextMarked())
+                          keys->push_back(current->key);
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->epochs = new EpochManager<Node>(this->numIDs);
+                  for (int i = 0; i < this->numIDs; i++) {
+                      this->freeLists.at(i).local = nullptr;
+                      this->freeLists.at(i).remote.store(nullptr);
+                  }
+                  this->head = new Node();
+                  this->tail = new Node();
+                  this->head->next.store(this->tail);
+                  this->head->key = KeyTraits<K, Compare>::minKey();  // Make sure keys are not less than
+                  this->tail->key = KeyTraits<K, Compare>::maxKey();  // Make sure keys are not greater than
+                  this->backlog.store(0);
+                  previous = this->head;
+              },
+              [&previous](Node* node, const typename Memory::RecoveredCell&) {
+                  previous->next.store(node, std::memory_order_relaxed);
+                  previous = node;
+              });
+          previous->next.store(this->tail);
+          this->bindContexts();  // The node pool was rebuilt
+      }
 
-          // Record durable memory (For testing only)
-          this->keysDurableRecovered = std::vector<long>();
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->keysDurableRecovered.push_back(keys->at(i));
-          }
+  public:
+
+      // What the hot paths of a thread touch, so they skip the per id vectors
+      // Padded to its own cache line(s), only its thread writes it
+      struct alignas(CACHE_LINE_SIZE) ThreadContext {
+          int id;
+          typename NodePool<Node>::ThreadPool* pool;  // Where its nodes come from
+          typename Memory::Section* section;          // Where their durable cells come from
+          FreeList* freeList;                         // Its reclaimed nodes
+          Node* finger;                               // Where its last operation stopped (SEARCH_FROM_FINGER)
+          std::uint64_t fingerEpoch;                  // Global epoch read before finger was seen unmarked
+      };
 
-          // Rejuvenate all of the nodes
-          this->FREE();
+      // Constructor
+      // values is only needed by policies with a state (i.e. the heap of HeapValue)
+      // Will not be called concurrently
+      LinkFreeDurableSet(Memory* mem, std::atomic<bool>* abortFlag, int numIDs, Value values = Value())
+          : store(mem, numIDs), eliminator(numIDs) {
+          this->numIDs = numIDs;
+          this->epochs = new EpochManager<Node>(numIDs);
+          this->stats = OperationStats(numIDs);
+          this->freeLists = std::vector<FreeList>(numIDs);
+          for (int i = 0; i < numIDs; i++) {
+              this->freeLists.at(i).local = nullptr;
+              this->freeLists.at(i).remote.store(nullptr);
+          }
           this->head = new Node();
           this->tail = new Node();
           this->head->next.store(this->tail);
-          this->head->key = MIN_KEY;  // Make sure keys are not less than
-          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i);
+          this->head->key = KeyTraits<K, Compare>::minKey();  // Make sure keys are not less than
+          this->tail->key = KeyTraits<K, Compare>::maxKey();  // Make sure keys are not greater than
+          this->abortFlag = abortFlag;
+          this->mem = mem;
+          this->values = values;
+          this->readMode = READER_FLUSH;
+          this->trimMode = TRIM_INLINE;
+          this->maxBacklog = DEFAULT_MAX_BACKLOG;
+          this->backlog.store(0);
+          this->contentionMode = CONTENTION_RETRY;
+          this->searchMode = SEARCH_FROM_HEAD;
+          this->contexts = std::vector<ThreadContext>(numIDs);
+          this->registered.store(0);
+          this->bindContexts();
+      }
+
+      // Hands out the context of the next free id, nullptr once all numIDs are taken
+      ThreadContext* registerThread(void) {
+          int id = this->registered.fetch_add(1);
+          if (id >= this->numIDs) return nullptr;
+          return &this->contexts[id];
+      }
+
+      // The context of a known id (i.e. a thread that was given its id up front)
+      ThreadContext* context(int id) {
+          return &this->contexts.at(id);
+      }
+
+      // Free the durable sets nodes
+      void FREE() {
+          delete this->head;
+          delete this->tail;
+          delete this->epochs;
+          this->store.release();
+      }
+
+      // Inserts a key at a designated spot in the list
+      // Returns false if key was already present
+      bool insert(K key, T item, int id) {
+          return this->insert(key, item, &this->contexts[id]);
+      }
+
+      bool insert(K key, T item, ThreadContext* context) {
+          Node* last = nullptr;
+          this->enterEpoch(context->id);
+          bool result = this->insertFrom(this->startOf(context), key, item, context, &last);
+          this->leaveFinger(context, last);
+          this->exitEpoch(context->id);
+          return result;
+      }
+
+      // Inserts keys[i] with items[i] in one forward pass, keys sorted in increasing order
+      // Each key is found from where the previous one was left, O(n + k) instead of O(n * k)
+      // Every key is inserted (and linearized) on its own, the FLUSHes are issued as one batch
+      // and are all persistent once it returns (until then the valid flags only say they were queued)
+      // Returns the number of keys inserted
+      int insertBatch(const std::vector<K>& keys, const std::vector<T>& items, int id) {
+          return this->insertBatch(keys, items, &this->contexts[id]);
+      }
+
+      int insertBatch(const std::vector<K>& keys, const std::vector<T>& items, ThreadContext* context) {
+          int id = context->id;
+          int inserted = 0;
+          int numKeys = keys.size();
+          this->enterEpoch(id);
+          Node* last = this->startOf(context);
+          this->mem->beginBatch(id);
+          for (int i = 0; i < numKeys; i++) {
+              if (this->insertFrom(last, keys[i], items[i], context, &last)) inserted += 1;
           }
-          int numNodes = 0;
-          for (int i = 0; i < numIDs; i++) {
-              numNodes = writeOpsVector->at(i) + activeNodes->at(i);
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(numNodes);
-              for (int j = 0; j < numNodes; j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
+          this->mem->endBatch(id);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return inserted;
+      }
+
+      // READER_NO_FLUSH makes contains and the scans report the last durable state without flushing
+      // Not run concurrently with the operations
+      void setReadMode(int mode) {
+          this->readMode = mode;
+      }
+
+      int getReadMode(void) {
+          return this->readMode;
+      }
+
+      // TRIM_DEFERRED leaves unlinking removed nodes to trimBacklog
+      // Not run concurrently with the operations, what is left is trimmed first so the backlog starts empty
+      void setTrimMode(int mode) {
+          this->trimBacklog(0);
+          this->trimMode = mode;
+          this->backlog.store(0);
+      }
+
+      int getTrimMode(void) {
+          return this->trimMode;
+      }
+
+      // Once more than maxNodes removed nodes are left linked removes trim their own node again,
+      // which bounds the marked nodes a traversal crosses
+      // Not run concurrently with the operations
+      void setMaxBacklog(long maxNodes) {
+          this->maxBacklog = maxNodes;
+      }
+
+      // CONTENTION_ELIMINATE lets an insert or remove that lost its CAS wait a little for an
+      // operation on the same key to complete it (see EliminationArray.h) before it searches again
+      // Not run concurrently with the operations
+      void setContentionMode(int mode) {
+          this->contentionMode = mode;
+      }
+
+      int getContentionMode(void) {
+          return this->contentionMode;
+      }
+
+      // SEARCH_FROM_FINGER starts every operation of a thread context from the node its previous
+      // operation stopped at, unless that node was removed or lies past the key
+      // Not run concurrently with the operations
+      void setSearchMode(int mode) {
+          this->searchMode = mode;
+      }
+
+      int getSearchMode(void) {
+          return this->searchMode;
+      }
+
+      // Removed nodes still linked (TRIM_DEFERRED), a hint while operations run
+      long getBacklog(void) {
+          return this->backlog.load(std::memory_order_relaxed);
+      }
+
+      // One pass over the list that unlinks every run of marked nodes it crosses
+      // Run by any thread with id (i.e. a BackgroundTrimmer), holds one epoch for the whole pass
+      // Returns the number of nodes it unlinked
+      long trimBacklog(int id) {
+          long trimmed = 0;
+          this->enterEpoch(id);
+          Node* previous = this->head;
+          while (previous != this->tail) {
+              Node* current = previous->getNextRef();
+              if (!current->isNextMarked()) {  // The tail is never marked
+                  previous = current;
+                  continue;
               }
+              Node* stop = current;
+              while (stop->isNextMarked())
+                  stop = stop->getNextRef();
+              trimmed += this->trimRun(previous, current, stop, id);
+              previous = stop;
+          }
+          this->exitEpoch(id);
+          return trimmed;
+      }
+
+      // Searched for key
+      // Skips over logically deleted nodes
+      // If key is set for deletion will help remove
+      // Always attempts to flush the node if present (READER_FLUSH)
+      bool contains(K key, int id) {
+          return this->contains(key, &this->contexts[id]);
+      }
+
+      bool contains(K key, ThreadContext* context) {
+          int id = context->id;
+          this->enterEpoch(id);
+          Node* previous = this->startOf(context);
+          if (previous->isNextMarked() || !before(previous->key, key)) previous = this->head;
+          Node* current = previous->getNextRef();
+          long traversed = 0;
+          while (before(current->key, key)) {
+              previous = current;
+              current = current->getNextRef();
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          this->leaveFinger(context, previous);
+          if (!same(current->key, key)) {
+              this->exitEpoch(id);
+              return false;
+          }
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (this->readMode == READER_NO_FLUSH) {
+              bool present = current->isDurablyPresent();
+              this->exitEpoch(id);
+              return present;
+          }
+          if (current->isNextMarked()) {
+              current->FLUSH_DELETE(this->mem, id);
+              this->exitEpoch(id);
+              return false;
+          }
+          current->makeValid();
+          current->FLUSH_INSERT(this->mem, id);
+          this->exitEpoch(id);
+          return true;
+      }
+
+      // Removes key from the list
+      // Returns false if key was not present
+      bool remove(K key, int id) {
+          return this->remove(key, &this->contexts[id]);
+      }
+
+      bool remove(K key, ThreadContext* context) {
+          int id = context->id;
+          Node* last = nullptr;
+          this->enterEpoch(id);
+          bool result = this->removeFrom(this->startOf(context), key, id, &last);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return result;
+      }
+
+      // Removes keys in one forward pass, keys sorted in increasing order
+      // Like insertBatch every key is removed on its own and the FLUSHes are issued as one batch
+      // Returns the number of keys removed
+      int removeBatch(const std::vector<K>& keys, int id) {
+          return this->removeBatch(keys, &this->contexts[id]);
+      }
+
+      int removeBatch(const std::vector<K>& keys, ThreadContext* context) {
+          int id = context->id;
+          int removed = 0;
+          int numKeys = keys.size();
+          this->enterEpoch(id);
+          Node* last = this->startOf(context);
+          this->mem->beginBatch(id);
+          for (int i = 0; i < numKeys; i++) {
+              if (this->removeFrom(last, keys.at(i), id, &last)) removed += 1;
+          }
+          this->mem->endBatch(id);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return removed;
+      }
+
+      // Calls callback(key, item) for the keys in [lo, hi] in increasing order
+      // Consistency as for Iterator, callback may not use the set as thread id
+      // Returns the number of keys visited
+      template <typename Callback>
+      long rangeScan(K lo, K hi, Callback callback, int id) {
+          long count = 0;
+          for (Iterator it(this, lo, hi, id); it.valid(); it.next()) {
+              callback(it.key(), it.item());
+              count += 1;
           }
+          return count;
+      }
+
+      // Deletes all of the nodes
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass
+      // Will not be called concurrently
+      void recover(void) {
+
+          // Read Memory Manager, every section is scanned by its own thread
+          std::vector<typename Memory::RecoveredCell> cells;
+          int numActiveNodes = this->mem->recoverMemory(&cells);
+          this->rebuild(cells, numActiveNodes);
+      }
 
-          // String the nodes together
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->insert(keys->at(i), items->at(i), durableAddressPrefixes->at(i));
+      // Writes the set to path as a key ordered image of its durable cells while the operations go on
+      // Every linked node's cell is read once it began, later FLUSHes are logged by the memory
+      // manager (enableCheckpoints first), so the image and the log hold what is durable
+      // Holds one epoch of thread id for the whole pass, as trimBacklog
+      // Returns false if a checkpoint is under way or the image could not be written
+      bool checkpoint(const char* path, int id) {
+          std::uint32_t generation = this->mem->beginCheckpoint();
+          if (generation == 0) return false;
+          std::vector<typename Memory::RecoveredCell> cells;
+          this->enterEpoch(id);
+          for (Node* node = this->head->getNextRef(); node != this->tail; node = node->getNextRef()) {
+              typename Memory::RecoveredCell cell;
+              if (this->mem->readCell(node->durableAddressPrefix, node->durableAddressPostfix, &cell))
+                  cells.push_back(cell);
           }
+          this->exitEpoch(id);
+          return this->mem->endCheckpoint(path, cells, generation);
+      }
 
-          delete keys;
-          delete items;
-          delete durableAddressPrefixes;
-          delete activeNodes;
+      // Same as recover from the image at path, only the cells FLUSHed since it was taken are read
+      // Scans the memory sections instead if there is no image (returns false then)
+      // Will not be called concurrently
+      bool restore(const char* path) {
+          std::vector<typename Memory::RecoveredCell> cells;
+          int numActiveNodes = this->mem->restoreMemory(path, &cells);
+          bool restored = numActiveNodes >= 0;
+          if (!restored) numActiveNodes = this->mem->recoverMemory(&cells);
+          this->rebuild(cells, numActiveNodes);
+          return restored;
+      }
 
-          return;
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
       }
 
       // For testing (not run concurrentlly)
       void printSet(void) {
+          this->enterEpoch(0);
           Node* previous = this->head;
           std::cout << "Set keys" << std::endl;
           std::cout << "key: " << previous->key << std::endl;
@@ -365,14 +922,16 @@ class LinkFreeDurableSet {
                   previous = current;
               } else {                             // Logically deleted nodes should not be found
                   std::cout << "key: A marked node was found" << std::endl;
-                  trim(previous, current);
+                  trim(previous, current, 0);
               }
               current = current->getNextRef();
           }
+          this->exitEpoch(0);
       }
 
       // For testing (not run concurrentlly)
       void printSetSize(void) {
+          this->enterEpoch(0);
           int count = 0;
           Node* previous = this->head;
           Node* current = previous->next.load();
@@ -382,29 +941,24 @@ class LinkFreeDurableSet {
                   previous = current;
               } else {                             // Logically deleted nodes should not be found
                   std::cout << "key: A marked node was found" << std::endl;
-                  trim(previous, current);
+                  trim(previous, current, 0);
               }
               current = current->getNextRef();
           }
           count -= 1;  // Adjust for counting the tail node
+          this->exitEpoch(0);
           std::cout << "Set size: " << count << std::endl;
       }
 
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<K>* volatileKeys, std::vector<K>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
       // For testing (not run concurrentlly) (For abort testing only)
       void printRecovery(void) {
-
-          // Print the keys recovered from volatile memory
-          std::cout << "Volatile Set keys" << std::endl;
-          int numVolatileRecovered = this->keysVolatileRecovered.size();
-          for (int i = 0; i < numVolatileRecovered; i++)
-              std::cout << "Key: " << this->keysVolatileRecovered.at(i) << std::endl;
-
-          // Print the keys recovered from durable memory
-          std::cout << "Durable Set keys" << std::endl;
-          int numDurableRecovered = this->keysDurableRecovered.size();
-          for (int i = 0; i < numDurableRecovered; i++)
-              std::cout << "Key: " << this->keysDurableRecovered.at(i) << std::endl;
-
+          this->store.printRecovery();
       }
 
 };
@@ -0,0 +1,476 @@
+#ifndef LINK_FREE_DURABLE_SKIP_LIST_H
+#define LINK_FREE_DURABLE_SKIP_LIST_H
+
+// Link-Free Durable Skip List Class
+// Only the bottom level is durable, it follows the same validity
+// scheme as the Link-Free Durable Set (validBits and the flush flags, and its read modes)
+// The index levels are volatile and are rebuilt by recover()
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <random>
+#include "MemoryManager.h"
+#include "NodePool.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
+
+template <typename T>
+class LinkFreeDurableSkipList {
+
+  public:
+
+      static const int MAX_LEVEL = 16;  // Enough levels for 2^16 keys
+
+      // Similar field to the node in MemoryManager
+      // (except) durableAddress(Pre/Post)fix
+      // (except) the volatile index levels next[1..topLevel-1]
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
+
+          long key;
+          T item;
+          std::atomic<int> validBits;         // Used for validiting insert
+          std::atomic<bool> insertValidFlag;  // Optimization to reduce the number of FLUSH_INSERT
+          std::atomic<bool> deleteValidFlag;  // Optimization to reduce the number of FLUSH_DELETE
+          std::atomic<Node*> next[MAX_LEVEL]; // next[0] is durable, all levels marked for logical delete
+          int topLevel;                       // Number of levels the node is linked in
+
+          // These are for the simulation only
+          int durableAddressPrefix;      // Is the threads id
+          int durableAddressPostfix;     // Is the element index in the memPool
+
+          // Constructor
+          Node(void) {
+              this->key = 0;
+              this->item = T();
+              this->validBits.store(0);
+              this->insertValidFlag.store(false);
+              this->deleteValidFlag.store(false);
+              for (int level = 0; level < MAX_LEVEL; level++)
+                  this->next[level].store(nullptr);
+              this->topLevel = MAX_LEVEL;
+              this->durableAddressPrefix = -1;
+              this->durableAddressPostfix = -1;
+          }
+
+          bool isNextMarked(int level) {
+              return (((std::uintptr_t) this->next[level].load()) & 1);  // Linearization (level 0)
+          }
+
+          Node* getNextRef(int level) {
+              return (Node*) (((std::uintptr_t) this->next[level].load()) & ~1);
+          }
+
+          Node* mark(void) {
+              return (Node*) (((std::uintptr_t) this) | 1);
+          }
+
+          void flipV1(void) {
+              this->validBits.store((this->validBits.load() | 1), std::memory_order_release);  // Linearization
+          }
+
+          void makeValid(void) {
+              this->validBits.store((this->validBits.load() | 2), std::memory_order_release);  // Linearization
+          }
+
+          // The node as a READER_NO_FLUSH reader sees it, without flushing
+          // Present once its insert is durable and until its remove is (flags only go false to true)
+          bool isDurablyPresent(void) {
+              if (!this->insertValidFlag.load(std::memory_order_acquire)) return false;
+              return !this->isNextMarked(0) || !this->deleteValidFlag.load(std::memory_order_acquire);
+          }
+
+          // The cell gets a copy, a copy taken before the mark may land after FLUSH_DELETE's own,
+          // so it is written again until the mark did not change meanwhile
+          void FLUSH_INSERT(MemoryManager<T>* mem, int id) {
+              if (this->insertValidFlag.load() == false) {  // Optimzation
+                  std::uintptr_t next;
+                  do {
+                      next = (std::uintptr_t) this->next[0].load();
+                      mem->FLUSH(this->key,  // This call is always the same for a given node
+                                 this->item,
+                                 {this->validBits.load(),
+                                  this->insertValidFlag.load(),
+                                  this->deleteValidFlag.load(),
+                                  next},
+                                 this->durableAddressPrefix,
+                                 this->durableAddressPostfix,
+                                 id);
+                  } while ((next & 1) != ((std::uintptr_t) this->next[0].load() & 1));
+                  this->insertValidFlag.store(true, std::memory_order_release);
+              } else {
+                  mem->elideFlush(id);
+              }
+          }
+
+          void FLUSH_DELETE(MemoryManager<T>* mem, int id) {
+              if (this->deleteValidFlag.load() == false) {  // Optimzation
+                  mem->FLUSH(this->key,  // This call is always the same for a given node
+                             this->item,
+                             {this->validBits.load(),
+                              this->insertValidFlag.load(),
+                              this->deleteValidFlag.load(),
+                              (std::uintptr_t) this->next[0].load()},
+                             this->durableAddressPrefix,
+                             this->durableAddressPostfix,
+                             id);
+                  this->deleteValidFlag.store(true, std::memory_order_release);
+              } else {
+                  mem->elideFlush(id);
+              }
+          }
+
+      };
+
+  private:
+
+      Node* head;
+      Node* tail;
+      std::vector<std::mt19937> levelGenerators;  // One per thread, picks topLevel
+
+      // These are for the simulation only
+      MemoryManager<T>* mem;
+      std::atomic<bool>* abortFlag;
+      DurableStore<Node, MemoryManager<T>, LinkFreeCells> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread CAS failures, restarts and nodes traversed
+      int readMode;              // READER_FLUSH or READER_NO_FLUSH
+      int numIDs;
+
+      // Geometric distribution, each level with half the chance of the last
+      int randomLevel(int id) {
+          std::uint32_t bits = this->levelGenerators.at(id)();
+          int level = 1;
+          while ((bits & 1) && level < MAX_LEVEL) {
+              level += 1;
+              bits = bits >> 1;
+          }
+          return level;
+      }
+
+      // Takes two nodes and removes current from one level
+      // Assume current has a marked successor at that level
+      // Only the bottom level is durable so only it is flushed
+      bool trim(Node* previous, Node* current, int level, int id) {
+          if (level == 0) current->FLUSH_DELETE(this->mem, id);
+          Node *successor = current->getNextRef(level);
+          if (previous->next[level].compare_exchange_strong(current, successor)) return true;
+          this->stats.add(id, TRIM_CAS_FAILURES);
+          return false;
+      }
+
+      // Common function to traverse the skip list
+      // Fills previous and current for every level
+      // Trims logically deleted nodes that have yet to be removed
+      // Returns true if the bottom level current has the key
+      bool find(long key, Node** previous, Node** current, int id) {
+          bool restart = true;
+          long traversed = 0;
+          while (restart) {
+              restart = false;
+              Node* left = this->head;
+              Node* right = nullptr;
+              for (int level = MAX_LEVEL - 1; level >= 0 && !restart; level--) {
+                  right = left->getNextRef(level);
+                  while (true) {
+
+                      // Abort Check (For abort testing only)
+                      CRASH_POINT(this->abortFlag, false);
+
+                      if (!right->isNextMarked(level)) {  // Make sure not logically deleted
+                          if (right->key >= key) break;
+                          left = right;
+                      } else if (!this->trim(left, right, level, id)) {  // Remove the logically deleted node
+                          restart = true;  // left changed under us, start over from the head
+                          this->stats.add(id, FIND_RESTARTS);
+                          break;
+                      }
+                      right = left->getNextRef(level);
+                      traversed += 1;
+                  }
+                  previous[level] = left;
+                  current[level] = right;
+              }
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          return (current[0]->key == key);
+      }
+
+  public:
+
+      // Constructor
+      // Will not be called concurrently
+      LinkFreeDurableSkipList(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs) : store(mem, numIDs) {
+          this->stats = OperationStats(numIDs);
+          this->levelGenerators = std::vector<std::mt19937>(numIDs);
+          for (int i = 0; i < numIDs; i++)
+              this->levelGenerators.at(i).seed(std::random_device{}());
+          this->numIDs = numIDs;
+          this->head = new Node();
+          this->tail = new Node();
+          for (int level = 0; level < MAX_LEVEL; level++)
+              this->head->next[level].store(this->tail);
+          this->head->key = MIN_KEY;  // Make sure keys are not less than
+          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+          this->abortFlag = abortFlag;
+          this->mem = mem;
+          this->readMode = READER_FLUSH;
+      }
+
+      // Free the durable sets nodes
+      void FREE() {
+          delete this->head;
+          delete this->tail;
+          this->store.release();
+      }
+
+      // Inserts a key at a designated spot in the bottom level
+      // If key already present help flush
+      // Loop until key is added or already found
+      // Once durable the index levels are linked bottom up
+      bool insert(long key, T item, int id) {
+          Node* previous[MAX_LEVEL];
+          Node* current[MAX_LEVEL];
+          int topLevel = this->randomLevel(id);
+          while (true) {
+
+              if (this->find(key, previous, current, id)) {
+                  current[0]->makeValid();
+                  current[0]->FLUSH_INSERT(this->mem, id);
+                  return false;
+              }
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              Node* newNode = this->store.allocate(id);
+              if (newNode == nullptr) return false; // No memory available
+              newNode->flipV1();
+              std::atomic_thread_fence(std::memory_order_release);
+              newNode->key = key;
+              newNode->item = item;
+              newNode->topLevel = topLevel;
+              for (int level = 0; level < topLevel; level++)
+                  newNode->next[level].store(current[level], std::memory_order_relaxed);
+              if (!previous[0]->next[0].compare_exchange_strong(current[0], newNode)) {  // Linearization point
+                  this->stats.add(id, INSERT_CAS_FAILURES);
+                  continue;
+              }
+              this->store.commit(id);
+              newNode->makeValid();
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, true);
+
+              newNode->FLUSH_INSERT(this->mem, id);
+
+              // Link the volatile index levels
+              for (int level = 1; level < topLevel; level++) {
+                  while (true) {
+                      Node* successor = newNode->next[level].load();
+                      if (newNode->isNextMarked(level)) return true;  // Already being removed
+                      if (successor != current[level] &&
+                          !newNode->next[level].compare_exchange_strong(successor, current[level]))
+                          continue;
+                      if (previous[level]->next[level].compare_exchange_strong(current[level], newNode)) {
+                          // Marked meanwhile, the find of the remove may have passed this level before the link
+                          if (newNode->isNextMarked(level)) this->find(key, previous, current, id);
+                          break;
+                      }
+                      this->find(key, previous, current, id);
+                  }
+              }
+              return true;
+          }
+      }
+
+      // READER_NO_FLUSH makes contains report the last durable state without flushing
+      // Not run concurrently with the operations
+      void setReadMode(int mode) {
+          this->readMode = mode;
+      }
+
+      int getReadMode(void) {
+          return this->readMode;
+      }
+
+      // Searched for key
+      // Skips over logically deleted nodes
+      // If key is set for deletion will help remove
+      // Always attempts to flush the node if present (READER_FLUSH)
+      bool contains(long key, int id) {
+          Node* previous = this->head;
+          Node* current = nullptr;
+          long traversed = 0;
+          for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+              current = previous->getNextRef(level);
+              while (current->key < key) {
+                  previous = current;
+                  current = current->getNextRef(level);
+                  traversed += 1;
+              }
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          if (current->key != key) return false;
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (this->readMode == READER_NO_FLUSH) return current->isDurablyPresent();
+          if (current->isNextMarked(0)) {
+              current->FLUSH_DELETE(this->mem, id);
+              return false;
+          }
+          current->makeValid();
+          current->FLUSH_INSERT(this->mem, id);
+          return true;
+      }
+
+      // Loops until node with key is removed
+      // Marks the index levels top down then the bottom level
+      // validates the node, incase needed
+      // The bottom level mark decides which remove succeeds
+      bool remove(long key, int id) {
+          Node* previous[MAX_LEVEL];
+          Node* current[MAX_LEVEL];
+          while (true) {
+              if (!this->find(key, previous, current, id)) return false;
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              Node* victim = current[0];
+              Node* successor = nullptr;
+              for (int level = victim->topLevel - 1; level > 0; level--) {
+                  successor = victim->next[level].load();
+                  while (!victim->isNextMarked(level)) {
+                      victim->next[level].compare_exchange_strong(successor, successor->mark());
+                      successor = victim->next[level].load();
+                  }
+              }
+              successor = victim->getNextRef(0);
+              victim->makeValid();
+              if (victim->next[0].compare_exchange_strong(successor, successor->mark())) {
+
+                  // Abort Check (For abort testing only)
+                  CRASH_POINT(this->abortFlag, true);
+
+                  // victim has been validated and logically deleted
+                  victim->FLUSH_DELETE(this->mem, id);
+                  this->find(key, previous, current, id);  // Unlinks victim from every level
+                  return true;
+              }
+              this->stats.add(id, REMOVE_CAS_FAILURES);
+          }
+      }
+
+      // Deletes all of the nodes
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass, rebuilding the index levels
+      // Will not be called concurrently
+      void recover(void) {
+          Node* previous[MAX_LEVEL];  // Last node linked at each level
+          this->store.recover(
+              [this](std::vector<long>* keys) {
+                  for (Node* current = this->head->getNextRef(0); current != this->tail; current = current->getNextRef(0))
+                      if (!current->isNextMarked(0))
+                          keys->push_back(current->key);
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->head = new Node();
+                  this->tail = new Node();
+                  for (int level = 0; level < MAX_LEVEL; level++)
+                      this->head->next[level].store(this->tail);
+                  this->head->key = MIN_KEY;  // Make sure keys are not less than
+                  this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+                  for (int level = 0; level < MAX_LEVEL; level++)
+                      previous[level] = this->head;
+              },
+              [this, &previous](Node* node, const typename MemoryManager<T>::RecoveredCell& cell) {
+                  node->topLevel = this->randomLevel(cell.durableAddressPrefix);
+                  for (int level = 0; level < node->topLevel; level++) {
+                      previous[level]->next[level].store(node, std::memory_order_relaxed);
+                      previous[level] = node;
+                  }
+              });
+          for (int level = 0; level < MAX_LEVEL; level++)
+              previous[level]->next[level].store(this->tail);
+      }
+
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
+      }
+
+      // For testing (not run concurrentlly)
+      void printSet(void) {
+          std::cout << "Set keys" << std::endl;
+          std::cout << "key: " << this->head->key << std::endl;
+          Node* current = this->head->next[0].load();
+          while (current != nullptr) {
+              if (!current->isNextMarked(0)) {     // Make sure not logically deleted (incase)
+                  std::cout << "key: " << current->key
+                            << " levels: " << current->topLevel << std::endl;
+              } else {                             // Logically deleted nodes should not be found
+                  std::cout << "key: A marked node was found" << std::endl;
+              }
+              current = current->getNextRef(0);
+          }
+      }
+
+      // For testing (not run concurrentlly)
+      void printSetSize(void) {
+          int count = 0;
+          Node* current = this->head->next[0].load();
+          while (current != nullptr) {
+              if (!current->isNextMarked(0)) {     // Make sure not logically deleted (incase)
+                  count += 1;
+              } else {                             // Logically deleted nodes should not be found
+                  std::cout << "key: A marked node was found" << std::endl;
+              }
+              current = current->getNextRef(0);
+          }
+          count -= 1;  // Adjust for counting the tail node
+          std::cout << "Set size: " << count << std::endl;
+      }
+
+      // For testing (not run concurrentlly)
+      // Every level is in key order and holds no removed node, nor one that is not linked at the
+      // level below or that is linked above its topLevel. levelSizes gets the nodes of each level
+      bool checkLevels(std::vector<long>* levelSizes) {
+          levelSizes->assign(MAX_LEVEL, 0);
+          std::vector<Node*> below;
+          for (int level = 0; level < MAX_LEVEL; level++) {
+              std::vector<Node*> linked;
+              std::size_t j = 0;
+              for (Node* current = this->head->getNextRef(level); current != this->tail; current = current->getNextRef(level)) {
+                  if (current == nullptr || current->isNextMarked(level) || level >= current->topLevel) return false;
+                  if (!linked.empty() && linked.back()->key >= current->key) return false;
+                  if (level > 0) {  // Both levels are in key order
+                      while (j < below.size() && below.at(j) != current) j += 1;
+                      if (j == below.size()) return false;
+                  }
+                  linked.push_back(current);
+              }
+              levelSizes->at(level) = (long) linked.size();
+              below = linked;
+          }
+          return true;
+      }
+
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
+      // For testing (not run concurrentlly) (For abort testing only)
+      void printRecovery(void) {
+          this->store.printRecovery();
+      }
+
+};
+
+#endif
@@ -2,18 +2,22 @@
 #define LOCK_DURABLE_SET_H
 
 // Lock Durable Set Class
+// Hand over hand locking of previous and current, the lock of a node is a Lock policy
+// (LockPolicies.h), a std::mutex by default
 
 #include <iostream>
 #include <atomic>
-#include <mutex>
 #include <vector>
 #include <cstdint>
 #include "MemoryManager.h"
-
-long MIN_KEY = -100000;
-long MAX_KEY = 100000;
-
-template <typename T>
+#include "NodePool.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
+#include "LockPolicies.h"
+#include "TransactionalMemory.h"
+
+template <typename T, typename Lock = MutexLock>
 class LockDurableSet {
 
   public:
@@ -21,13 +25,13 @@ class LockDurableSet {
       // Similar field to the node in MemoryManager
       // (except) durableAddress(Pre/Post)fix
       // (except) resourceID
-      struct Node {
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
 
           long key;
           T item;
           int validBits;             // Used for validiting insert
-          Node* next;                // Marked for logical delete
-          std::mutex mtx;
+          std::atomic<Node*> next;   // Marked for logical delete, read without the lock by contains
+          Lock lock;                 // Held while the node is linked, unlinked or FLUSHed
 
           // These are for the simulation only
           int durableAddressPrefix;      // Is the threads id
@@ -36,19 +40,19 @@ class LockDurableSet {
           // Constructor
           Node(void) {
               this->key = 0;
-              this->item = (T) 0;
+              this->item = T();
               this->validBits = 0;
-              this->next = nullptr;
+              this->next.store(nullptr, std::memory_order_relaxed);
               this->durableAddressPrefix = -1;
               this->durableAddressPostfix = -1;
           }
 
           bool isNextMarked(void) {
-              return ((std::uintptr_t) this->next) & 1;
+              return ((std::uintptr_t) this->next.load(std::memory_order_acquire)) & 1;
           }
 
           Node* getNextRef(void) {
-              return (Node*) (((std::uintptr_t) this->next) & ~1);
+              return (Node*) (((std::uintptr_t) this->next.load(std::memory_order_acquire)) & ~1);
           }
 
           Node* mark(void) {
@@ -64,30 +68,32 @@ class LockDurableSet {
           }
 
           // FLUSH
-          void FLUSH_INSERT(MemoryManager<T>* mem) {
+          void FLUSH_INSERT(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,   // insertValidFlag  // Memory Manager expects a bool
-                         false,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,   // insertValidFlag  // Memory Manager expects a bool
+                          false,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next.load(std::memory_order_relaxed)},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
           // FLUSH
-          void FLUSH_DELETE(MemoryManager<T>* mem) {
+          void FLUSH_DELETE(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,  // insertValidFlag  // Memory Manager expects a bool
-                         true,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,  // insertValidFlag  // Memory Manager expects a bool
+                          true,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next.load(std::memory_order_relaxed)},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
-      }; // aligned(cache line size);
+      };
 
   private:
 
@@ -97,47 +103,51 @@ class LockDurableSet {
       // These are for the simulation only
       MemoryManager<T>* mem;
       std::atomic<bool>* abortFlag;
-      std::vector<std::vector<Node*>> preAllocatedNodes;
-      std::vector<int> allocIndices;  // Points current free node for insert
-      std::vector<int> maxIndices;
-      std::vector<long> keysVolatileRecovered;
-      std::vector<long> keysDurableRecovered;
+      DurableStore<Node, MemoryManager<T>, LockedCells> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread nodes traversed and aborted transactions
+      int elisionMode;           // ELISION_OFF or ELISION_RTM
       int numIDs;
 
-      // Gets memory address from permanent storage and ties it with prealloc node
-      Node* allocFromArea(int id) {
-          Node* newNode = this->preAllocatedNodes.at(id).at(this->allocIndices.at(id));
-          // Retrieve durable address
-          int durAddr = this->mem->retrieveAddress(id);
-          if (durAddr == -1) {
-              return nullptr;
+      // Takes the locks of previous and current in one hardware transaction that also validates
+      // them (ELISION_RTM), a commit leaves both held just as lock() and the validation would
+      // Returns 1 with both held, 0 if they are no longer valid (none held), -1 to take the locks
+      int lockElided(Node* previous, Node* current, int id) {
+          if (this->elisionMode != ELISION_RTM || !HardwareTransaction::available()) return -1;
+          for (int attempt = 0; attempt < DEFAULT_ELISION_ATTEMPTS; attempt++) {
+              unsigned int status = HardwareTransaction::begin();
+              if (status == HardwareTransaction::STARTED) {
+                  if (previous->next.load(std::memory_order_relaxed) != current || current->isNextMarked()) {
+                      HardwareTransaction::end();
+                      return 0;
+                  }
+                  if (!previous->lock.tryLock() || !current->lock.tryLock()) HardwareTransaction::abort();
+                  HardwareTransaction::end();
+                  return 1;
+              }
+              this->stats.add(id, ELISION_ABORTS);
+              if (!(status & HardwareTransaction::ABORT_RETRY)) return -1;  // i.e. a lock was held
           }
-          // set the durableAddress(Pre/Post)fix
-          newNode->durableAddressPrefix = id;
-          newNode->durableAddressPostfix = durAddr;
-          return newNode;
-      }
-
-      // Insertion was successful move the indices
-      void updateAlloc(int id) {
-          this->allocIndices.at(id) -= 1;
-          this->mem->updateAddress(id);
+          return -1;
       }
 
       // Common function to traverse the linked list
-      Node* find(Node** curr, long key) {
-          Node* previous = this->head;
+      // Starts from start unless it was removed meanwhile (nodes are never reclaimed), otherwise from the head
+      Node* find(Node** curr, long key, int id, Node* start) {
+          Node* previous = start->isNextMarked() ? this->head : start;
           Node* current = previous->getNextRef();
+          long traversed = 0;
           while (true) {
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return nullptr;
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
 
               if (current->key >= key) break;
               previous = current;
               current = previous->getNextRef();
+              traversed += 1;
 
           }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           *curr = current;
           return previous;
       }
@@ -146,21 +156,10 @@ class LockDurableSet {
 
       // Constructor
       // Will not be called concurrently
-      LockDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, std::vector<int>* writeOpsVector) {
-          this->allocIndices = std::vector<int>(numIDs);
-          this->maxIndices = std::vector<int>(numIDs);
-          this->preAllocatedNodes = std::vector<std::vector<Node*>>(numIDs);
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i);
-          }
-          for (int i = 0; i < numIDs; i++) {
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(writeOpsVector->at(i));
-              for (int j = 0; j < writeOpsVector->at(i); j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
-              }
-          }
+      LockDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs) : store(mem, numIDs) {
+          this->stats = OperationStats(numIDs);
           this->numIDs = numIDs;
+          this->elisionMode = ELISION_OFF;
           this->head = new Node();
           this->tail = new Node();
           this->head->next = this->tail;
@@ -168,19 +167,13 @@ class LockDurableSet {
           this->tail->key = MAX_KEY;  // Make sure keys are not greater than
           this->abortFlag = abortFlag;
           this->mem = mem;
-          this->keysVolatileRecovered = std::vector<long>();
-          this->keysDurableRecovered = std::vector<long>();
       }
 
-      // Free the durable sets preallocated nodes
+      // Free the durable sets nodes
       void FREE() {
           delete this->head;
           delete this->tail;
-          for (int i = 0; i < this->numIDs; i++) {
-              for (int j = 0; j < this->maxIndices.at(i); j++) {
-                  delete this->preAllocatedNodes.at(i).at(j);
-              }
-          }
+          this->store.release();
       }
 
       // Inserts a key at a designated spot in the list
@@ -188,46 +181,67 @@ class LockDurableSet {
       bool insert(long key, T item, int id) {
           Node *previous = nullptr;
           Node *current = nullptr;
+          Node* start = this->head;  // A failed validation searches again from previous
           while (true) {
-              previous = this->find(&current, key);
+              previous = this->find(&current, key, id, start);
 
-              previous->mtx.lock();   // Lock previous
-              current->mtx.lock();    // Lock current
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
 
-              // Validate the nodes are still valid
-              if (previous->next != current || current->isNextMarked()) {
-                  previous->mtx.unlock();   // Unlock previous
-                  current->mtx.unlock();    // Unlock current
+              int elided = this->lockElided(previous, current, id);
+              if (elided == 0) {  // No longer valid, nothing is held
+                  start = previous;
                   continue;
               }
+              if (elided < 0) {
+                  previous->lock.lock();   // Lock previous
+                  current->lock.lock();    // Lock current
+
+                  // Validate the nodes are still valid
+                  if (previous->next.load(std::memory_order_relaxed) != current || current->isNextMarked()) {
+                      previous->lock.unlock();   // Unlock previous
+                      current->lock.unlock();    // Unlock current
+                      start = previous;
+                      continue;
+                  }
+              }
               // Already present
               if (current->key == key) {
-                  previous->mtx.unlock();   // Unlock previous
-                  current->mtx.unlock();    // Unlock current
+                  previous->lock.unlock();   // Unlock previous
+                  current->lock.unlock();    // Unlock current
                   return false;
               }
               // Insert
-              Node* newNode = this->allocFromArea(id);
+              Node* newNode = this->store.allocate(id);
               if (newNode == nullptr) {
-                  previous->mtx.unlock();   // Unlock previous
-                  current->mtx.unlock();    // Unlock current
+                  previous->lock.unlock();   // Unlock previous
+                  current->lock.unlock();    // Unlock current
                   return false; // No memory available
               }
+              newNode->lock.lock();     // Readers wait until it is durable (VersionLock)
               newNode->flipV1();
               newNode->key = key;
               newNode->item = item;
-              newNode->next = current;
-              previous->next = newNode;
-              this->updateAlloc(id);
+              newNode->next.store(current, std::memory_order_relaxed);
+              previous->next.store(newNode, std::memory_order_release);
+              this->store.commit(id);
               newNode->makeValid();
 
-              // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
+              // Abort Check (For abort testing only), the locks are let go so the other threads can stop too
+#ifdef CRASH_INJECTION
+              if (this->abortFlag->load(std::memory_order_relaxed)) {
+                  newNode->lock.unlock();
+                  previous->lock.unlock();
+                  current->lock.unlock();
+                  return true;
+              }
+#endif
 
-              newNode->FLUSH_INSERT(this->mem);
+              newNode->FLUSH_INSERT(this->mem, id);
 
-              previous->mtx.unlock();   // Unlock previous
-              current->mtx.unlock();    // Unlock current
+              newNode->lock.unlock();
+              previous->lock.unlock();   // Unlock previous
+              current->lock.unlock();    // Unlock current
 
               break;
           }
@@ -235,12 +249,22 @@ class LockDurableSet {
       }
 
       // Searched for key
-      bool contains(long key) {
+      // Does not lock, the node is read again if a writer held its lock meanwhile
+      // (with a VersionLock a key is only reported once its FLUSH is done)
+      bool contains(long key, int id) {
           Node* current = this->head->getNextRef();
-          while (current->key < key)
+          long traversed = 0;
+          while (current->key < key) {
               current = current->getNextRef();
-          if (current->key != key || current->isNextMarked()) return false;
-          return true;
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          while (true) {
+              std::uint32_t version = current->lock.readBegin();
+              bool found = (current->key == key && !current->isNextMarked());
+              if (current->lock.readValidate(version)) return found;
+              this->stats.add(id, FIND_RESTARTS);
+          }
       }
 
       // Finds the node with the key
@@ -249,36 +273,54 @@ class LockDurableSet {
           Node *previous = nullptr;
           Node *current = nullptr;
           Node* successor = nullptr;
+          Node* start = this->head;  // A failed validation searches again from previous
           while (true) {
-              previous = find(&current, key);
+              previous = find(&current, key, id, start);
 
-              previous->mtx.lock();   // Lock previous
-              current->mtx.lock();    // Lock current
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
 
-              // Validate the nodes are still valid
-              if (previous->next != current || current->isNextMarked()) {
-                  previous->mtx.unlock();   // Unlock previous
-                  current->mtx.unlock();    // Unlock current
+              int elided = this->lockElided(previous, current, id);
+              if (elided == 0) {  // No longer valid, nothing is held
+                  start = previous;
                   continue;
               }
+              if (elided < 0) {
+                  previous->lock.lock();   // Lock previous
+                  current->lock.lock();    // Lock current
+
+                  // Validate the nodes are still valid
+                  if (previous->next.load(std::memory_order_relaxed) != current || current->isNextMarked()) {
+                      previous->lock.unlock();   // Unlock previous
+                      current->lock.unlock();    // Unlock current
+                      start = previous;
+                      continue;
+                  }
+              }
               // Not present
               if (current->key != key) {
-                  previous->mtx.unlock();   // Unlock previous
-                  current->mtx.unlock();    // Unlock current
+                  previous->lock.unlock();   // Unlock previous
+                  current->lock.unlock();    // Unlock current
                   return false;
               }
               // Remove
-              successor = current->next;
-              current->next = successor->mark();
-              previous->next = successor;
-
-              // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
+              successor = current->getNextRef();
+              current->next.store(successor->mark(), std::memory_order_release);
+              previous->next.store(successor, std::memory_order_release);
+
+              // Abort Check (For abort testing only), the locks are let go so the other threads can stop too
+#ifdef CRASH_INJECTION
+              if (this->abortFlag->load(std::memory_order_relaxed)) {
+                  previous->lock.unlock();
+                  current->lock.unlock();
+                  return true;
+              }
+#endif
 
-              current->FLUSH_DELETE(this->mem);
+              current->FLUSH_DELETE(this->mem, id);
 
-              previous->mtx.unlock();   // Unlock previous
-              current->mtx.unlock();    // Unlock current
+              previous->lock.unlock();   // Unlock previous
+              current->lock.unlock();    // Unlock current
 
               break;
           }
@@ -286,63 +328,46 @@ class LockDurableSet {
       }
 
       // Deletes all of the nodes
-      // Reads and resets memory
-      // Re-adds the valid nodes read from memory
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass
       // Will not be called concurrently
-      void recover(std::vector<int>* writeOpsVector) {
-
-          // Read Memory Manager
-          std::vector<long>* keys = new std::vector<long>();
-          std::vector<T>* items = new std::vector<T>();
-          std::vector<int>* durableAddressPrefixes = new std::vector<int>();
-          std::vector<int>* activeNodes = new std::vector<int>(this->numIDs);
-          for (int i = 0; i < this->numIDs; i++) activeNodes->at(i) = 0;
-          int numActiveNodes = this->mem.recoverMemory(keys, items, durableAddressPrefixes, activeNodes);
-
-          // Record volatile memory (For testing only)
-          this->keysVolatileRecovered = std::vector<long>();
-          Node* current = this->head->next.load();
-          while (current->next.load() != nullptr) {  // Only tail->next == nullptr
-              this->keysVolatileRecovered.push_back(current->key);
-              current = current->getNextRef();
-          }
-
-          // Record durable memory (For testing only)
-          this->keysDurableRecovered = std::vector<long>();
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->keysDurableRecovered.push_back(keys->at(i));
-          }
-
-          // Rejuvenate all of the nodes
-          this->FREE();
-          this->head = new Node();
-          this->tail = new Node();
-          this->head->next = this->tail;
-          this->head->key = MIN_KEY;  // Make sure keys are not less than
-          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i);
-          }
-          int numNodes = 0;
-          for (int i = 0; i < this->numIDs; i++) {
-              numNodes = writeOpsVector->at(i) + activeNodes->at(i);
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(numNodes);
-              for (int j = 0; j < numNodes; j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
-              }
-          }
+      void recover(void) {
+          Node* previous = nullptr;  // Last node linked
+          this->store.recover(
+              [this](std::vector<long>* keys) {
+                  for (Node* current = this->head->next; current != this->tail; current = current->getNextRef())
+                      keys->push_back(current->key);
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->head = new Node();
+                  this->tail = new Node();
+                  this->head->next = this->tail;
+                  this->head->key = MIN_KEY;  // Make sure keys are not less than
+                  this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+                  previous = this->head;
+              },
+              [&previous](Node* node, const typename MemoryManager<T>::RecoveredCell&) {
+                  previous->next = node;
+                  previous = node;
+              });
+          previous->next = this->tail;
+      }
 
-          // String the nodes together
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->insert(keys->at(i), items->at(i), durableAddressPrefixes->at(i));
-          }
+      // Read once the threads are done
+      // ELISION_RTM takes the two locks of an update inside of a hardware transaction first,
+      // the FLUSH still runs under them once it committed. Without RTM the locks are taken as usual
+      // Not run concurrently with the operations
+      void setElisionMode(int mode) {
+          this->elisionMode = mode;
+      }
 
-          delete keys;
-          delete items;
-          delete durableAddressPrefixes;
-          delete activeNodes;
+      int getElisionMode(void) {
+          return this->elisionMode;
+      }
 
+      OperationStats* getStats(void) {
+          return &this->stats;
       }
 
       // For testing (not run concurrentlly)
@@ -372,21 +397,15 @@ class LockDurableSet {
           std::cout << "Set size: " << count << std::endl;
       }
 
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
       // For testing (not run concurrentlly) (For abort testing only)
       void printRecovery(void) {
-
-          // Print the keys recovered from volatile memory
-          std::cout << "Volatile Set keys" << std::endl;
-          int numVolatileRecovered = this->keysVolatileRecovered.size();
-          for (int i = 0; i < numVolatileRecovered; i++)
-              std::cout << "Key: " << this->keysVolatileRecovered.at(i) << std::endl;
-
-          // Print the keys recovered from durable memory
-          std::cout << "Durable Set keys" << std::endl;
-          int numDurableRecovered = this->keysDurableRecovered.size();
-          for (int i = 0; i < numDurableRecovered; i++)
-              std::cout << "Key: " << this->keysDurableRecovered.at(i) << std::endl;
-
+          this->store.printRecovery();
       }
 
 };
@@ -0,0 +1,150 @@
+#ifndef LOCK_POLICIES_H
+#define LOCK_POLICIES_H
+
+// Per Node Lock Policies (LockDurableSet)
+// MutexLock    std::mutex, may sleep in the kernel (baseline)
+// SpinLock     one byte, test and test-and-set
+// VersionLock  four bytes, odd while held, readers validate the version instead of locking
+// A policy has lock/unlock, tryLock and readBegin/readValidate, a read is retried until it validates
+// tryLock never waits, so a hardware transaction can take the lock (ELISION_RTM)
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+class MutexLock {
+
+  private:
+
+      std::mutex mtx;
+
+  public:
+
+      void lock(void) {
+          this->mtx.lock();
+      }
+
+      bool tryLock(void) {
+          return this->mtx.try_lock();
+      }
+
+      void unlock(void) {
+          this->mtx.unlock();
+      }
+
+      // Readers do not wait for writers
+      std::uint32_t readBegin(void) {
+          return 0;
+      }
+
+      bool readValidate(std::uint32_t version) {
+          (void) version;
+          return true;
+      }
+
+};
+
+class SpinLock {
+
+  private:
+
+      std::atomic<bool> held;
+
+  public:
+
+      // Constructor
+      SpinLock(void) {
+          this->held.store(false, std::memory_order_relaxed);
+      }
+
+      // Spins on a plain load so waiters do not bounce the line
+      void lock(void) {
+          while (this->held.exchange(true, std::memory_order_acquire)) {
+              while (this->held.load(std::memory_order_relaxed))
+                  cpuRelax();
+          }
+      }
+
+      bool tryLock(void) {
+          return !this->held.load(std::memory_order_relaxed) && !this->held.exchange(true, std::memory_order_acquire);
+      }
+
+      void unlock(void) {
+          this->held.store(false, std::memory_order_release);
+      }
+
+      // Readers do not wait for writers
+      std::uint32_t readBegin(void) {
+          return 0;
+      }
+
+      bool readValidate(std::uint32_t version) {
+          (void) version;
+          return true;
+      }
+
+};
+
+class VersionLock {
+
+  private:
+
+      std::atomic<std::uint32_t> version;  // Odd while held
+
+  public:
+
+      // Constructor
+      VersionLock(void) {
+          this->version.store(0, std::memory_order_relaxed);
+      }
+
+      void lock(void) {
+          while (true) {
+              std::uint32_t current = this->version.load(std::memory_order_relaxed);
+              if ((current & 1) == 0 &&
+                  this->version.compare_exchange_weak(current, current + 1, std::memory_order_acquire))
+                  return;
+              cpuRelax();
+          }
+      }
+
+      bool tryLock(void) {
+          std::uint32_t current = this->version.load(std::memory_order_relaxed);
+          return (current & 1) == 0 &&
+                 this->version.compare_exchange_strong(current, current + 1, std::memory_order_acquire);
+      }
+
+      void unlock(void) {
+          this->version.store(this->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+      // Waits out a writer, returns the (even) version the read starts at
+      std::uint32_t readBegin(void) {
+          std::uint32_t current = this->version.load(std::memory_order_acquire);
+          while (current & 1) {
+              cpuRelax();
+              current = this->version.load(std::memory_order_acquire);
+          }
+          return current;
+      }
+
+      // True if no writer held the lock since readBegin
+      bool readValidate(std::uint32_t version) {
+          std::atomic_thread_fence(std::memory_order_acquire);
+          return this->version.load(std::memory_order_relaxed) == version;
+      }
+
+};
+
+#endif
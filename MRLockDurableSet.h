@@ -2,18 +2,27 @@
 #define MRLOCK_DURABLE_SET_H
 
 // MRLock Durable Set Class
+// Nodes are hashed onto the stripes of a wide resource space (numResources bits of Resources),
+// an update locks the stripes of previous and current with one MRLock request
+// Resources is a StaticBitset (SIMD conflict checks) by default, or the run time sized Bitset
+// Wait is how a blocked request waits (BackoffWait, YieldWait or ParkWait, see mrlock.h)
 
 #include <iostream>
 #include <atomic>
 #include <vector>
 #include <cstdint>
 #include "MemoryManager.h"
+#include "NodePool.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
 #include "mrlock.h"
+#include "TransactionalMemory.h"
 
-long MIN_KEY = -100000;
-long MAX_KEY = 100000;
+static const int DEFAULT_MRLOCK_RESOURCES = 1024;  // Stripes of the resource space
 
-template <typename T>
+template <typename T, typename Resources = StaticBitset<DEFAULT_MRLOCK_RESOURCES>,
+          typename Wait = YieldWait>
 class MRLockDurableSet {
 
   public:
@@ -21,25 +30,25 @@ class MRLockDurableSet {
       // Similar field to the node in MemoryManager
       // (except) durableAddress(Pre/Post)fix
       // (except) resourceID
-      struct Node {
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
 
           long key;
           T item;
           int validBits;             // Used for validiting insert
           Node* next;                // Marked for logical delete
-          std::uint32_t resourceID;  // Used by the MRLock (every 32 nodes has a unique ID)
+          int resource;              // Stripe of the MRLock resource space, -1 until assigned
 
           // These are for the simulation only
           int durableAddressPrefix;      // Is the threads id
           int durableAddressPostfix;     // Is the element index in the memPool
 
           // Constructor
-          Node(std::uint32_t resourceID) {
+          Node(int resource = -1) {
               this->key = 0;
-              this->item = (T) 0;
+              this->item = T();
               this->validBits = 0;
               this->next = nullptr;
-              this->resourceID = resourceID;
+              this->resource = resource;
               this->durableAddressPrefix = -1;
               this->durableAddressPostfix = -1;
           }
@@ -48,6 +57,10 @@ class MRLockDurableSet {
               return ((std::uintptr_t) this->next) & 1;
           }
 
+          Node* getNextRef(void) {
+              return (Node*) (((std::uintptr_t) this->next) & ~1);
+          }
+
           Node* mark(void) {
               return (Node*) (((std::uintptr_t) this) | 1);
           }
@@ -61,81 +74,139 @@ class MRLockDurableSet {
           }
 
           // FLUSH
-          void FLUSH_INSERT(MemoryManager<T>* mem) {
+          void FLUSH_INSERT(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,   // insertValidFlag  // Memory Manager expects a bool
-                         false,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,   // insertValidFlag  // Memory Manager expects a bool
+                          false,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
           // FLUSH
-          void FLUSH_DELETE(MemoryManager<T>* mem) {
+          void FLUSH_DELETE(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,  // insertValidFlag  // Memory Manager expects a bool
-                         true,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,  // insertValidFlag  // Memory Manager expects a bool
+                          true,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
-      }; // aligned(cache line size);
+      };
 
   private:
 
       Node* head;
       Node* tail;
-      MRLock<std::uint32_t>* mrLock;
+      MRLock<Resources, Wait>* mrLock;
+      int numResources;
+
+      // The request of each thread, only its own two bits are ever set
+      struct alignas(CACHE_LINE_SIZE) Request {
+          Resources bits;
+      };
+      std::vector<Request> requests;
 
       // These are for the simulation only
       MemoryManager<T>* mem;
       std::atomic<bool>* abortFlag;
-      std::vector<std::vector<Node*>> preAllocatedNodes;
-      std::vector<int> allocIndices;  // Points current free node for insert
-      std::vector<int> maxIndices;
-      std::vector<long> keysVolatileRecovered;
-      std::vector<long> keysDurableRecovered;
+      DurableStore<Node, MemoryManager<T>, LockedCells> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread nodes traversed and aborted transactions
+      int elisionMode;           // ELISION_OFF or ELISION_RTM
       int numIDs;
 
-      // Gets memory address from permanent storage and ties it with prealloc node
-      Node* allocFromArea(int id) {
-          Node* newNode = this->preAllocatedNodes.at(id).at(this->allocIndices.at(id));
-          // Retrieve durable address
-          int durAddr = this->mem->retrieveAddress(id);
-          if (durAddr == -1) {
-              return nullptr;
+      // Head and Tail own stripes 0 and 1, the other nodes are hashed onto [2, numResources)
+      // by address (Fibonacci hashing), nodes are never reused so a stripe never changes
+      int stripeOf(Node* node) {
+          std::uint64_t hash = ((std::uint64_t) (std::uintptr_t) node) * 0x9E3779B97F4A7C15ull;
+          return 2 + (int) ((hash >> 32) % (std::uint64_t) (this->numResources - 2));
+      }
+
+      // Creates the lock and the requests, every bitset is numResources wide
+      // A thread queues one request at a time, so a ring of numIDs cells never fills up
+      void createLock(void) {
+          this->mrLock = new MRLock<Resources, Wait>(this->numResources, this->numIDs);
+          this->requests = std::vector<Request>(this->numIDs);
+          for (int i = 0; i < this->numIDs; i++)
+              this->requests.at(i).bits.Resize(this->numResources);
+      }
+
+      // One request for both nodes, it only waits on requests that share one of the stripes
+      // Returns the handle to unlock
+      std::uint32_t lockNodes(Node* previous, Node* current, int id) {
+          Resources& request = this->requests.at(id).bits;
+          request.Set(previous->resource);
+          request.Set(current->resource);
+          std::uint32_t handle = this->mrLock->Lock(request);  // Copies the request into the queue
+          request.Reset(previous->resource);
+          request.Reset(current->resource);
+          return handle;
+      }
+
+      // The request of lockNodes queued inside of one hardware transaction that also validates
+      // previous and current (ELISION_RTM), it commits only if no queued request conflicts
+      // Returns 1 with the request held (*handle), 0 if they are no longer valid (none held),
+      // -1 to queue it as usual
+      int lockElided(Node* previous, Node* current, std::uint32_t* handle, int id) {
+          if (this->elisionMode != ELISION_RTM || !HardwareTransaction::available()) return -1;
+          Resources& request = this->requests.at(id).bits;
+          request.Set(previous->resource);
+          request.Set(current->resource);
+          int result = -1;
+          for (int attempt = 0; attempt < DEFAULT_ELISION_ATTEMPTS; attempt++) {
+              unsigned int status = HardwareTransaction::begin();
+              if (status == HardwareTransaction::STARTED) {
+                  if (previous->next != current || current->isNextMarked()) {
+                      HardwareTransaction::end();
+                      result = 0;
+                      break;
+                  }
+                  if (!this->mrLock->LockInTransaction(request, handle)) HardwareTransaction::abort();
+                  HardwareTransaction::end();
+                  result = 1;
+                  break;
+              }
+              this->stats.add(id, ELISION_ABORTS);
+              if (!(status & HardwareTransaction::ABORT_RETRY)) break;  // i.e. a request conflicts
           }
-          // set the durableAddress(Pre/Post)fix
-          newNode->durableAddressPrefix = id;
-          newNode->durableAddressPostfix = durAddr;
-          return newNode;
+          request.Reset(previous->resource);
+          request.Reset(current->resource);
+          return result;
       }
 
-      // Insertion was successful move the indices
-      void updateAlloc(int id) {
-          this->allocIndices.at(id) -= 1;
-          this->mem->updateAddress(id);
+      // A node of the store with its stripe
+      Node* allocFromArea(int id) {
+          Node* newNode = this->store.allocate(id);
+          if (newNode == nullptr) return nullptr;
+          if (newNode->resource == -1) newNode->resource = this->stripeOf(newNode);
+          return newNode;
       }
 
       // Common function to traverse the linked list
-      Node* find(Node** curr, long key) {
-          Node* previous = this->head;
-          Node* current = previous->next;
+      // Starts from start unless it was removed meanwhile (nodes are never reclaimed), otherwise from the head
+      Node* find(Node** curr, long key, int id, Node* start) {
+          Node* previous = start->isNextMarked() ? this->head : start;
+          Node* current = previous->getNextRef();
+          long traversed = 0;
           while (true) {
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return nullptr;
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
 
               if (current->key >= key) break;
               previous = current;
-              current = current->next;
+              current = current->getNextRef();
+              traversed += 1;
 
           }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           *curr = current;
           return previous;
       }
@@ -143,116 +214,72 @@ class MRLockDurableSet {
   public:
 
       // Constructor
+      // numResources stripes (at least 3, at most what Resources holds),
+      // two updates only serialize if their nodes share one
       // Will not be called concurrently
-      MRLockDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, std::vector<int>* writeOpsVector) {
-          this->allocIndices = std::vector<int>(numIDs);
-          this->maxIndices = std::vector<int>(numIDs);
-          this->preAllocatedNodes = std::vector<std::vector<Node*>>(numIDs);
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i);
-          }
-          // No resources can have an ID of 0
-          unsigned int resourceNum = 3;
-          unsigned int pointBit = 3;
-          std::uint32_t resourceID = 4;  // Head and Tail have IDs 1 and 2 respectively
-          for (int i = 0; i < numIDs; i++) {
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(writeOpsVector->at(i));
-              for (int j = 0; j < writeOpsVector->at(i); j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node((std::uint32_t) resourceID);
-                  resourceID = resourceID << 1;
-                  pointBit += 1;
-                  if (pointBit > 31) {
-                      pointBit = 1;
-                      resourceID = 1;
-                  }
-                  resourceNum += 1;
-              }
-          }
+      MRLockDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs,
+                       int numResources = DEFAULT_MRLOCK_RESOURCES) : store(mem, numIDs) {
+          this->stats = OperationStats(numIDs);
           this->numIDs = numIDs;
-          this->head = new Node((std::uint32_t) 1);
-          this->tail = new Node((std::uint32_t) 2);
+          this->elisionMode = ELISION_OFF;
+          this->numResources = (numResources > 3) ? numResources : 3;
+          if (this->numResources > BitsetCapacity<Resources>::value)
+              this->numResources = BitsetCapacity<Resources>::value;
+          this->head = new Node(0);
+          this->tail = new Node(1);
           this->head->next = this->tail;
           this->head->key = MIN_KEY;  // Make sure keys are not less than
           this->tail->key = MAX_KEY;  // Make sure keys are not greater than
           this->abortFlag = abortFlag;
-          this->mrLock = new MRLock<std::uint32_t>(resourceID);  // Contains the number of resources+1
+          this->createLock();
           this->mem = mem;
-          this->keysVolatileRecovered = std::vector<long>();
-          this->keysDurableRecovered = std::vector<long>();
       }
 
-      // Free the durable sets preallocated nodes
+      // Free the durable sets nodes
       void FREE() {
           delete this->head;
           delete this->tail;
           delete this->mrLock;
-          for (int i = 0; i < this->numIDs; i++) {
-              for (int j = 0; j < this->maxIndices.at(i); j++) {
-                  delete this->preAllocatedNodes.at(i).at(j);
-              }
-          }
+          this->store.release();
       }
 
       // Inserts a key at a designated spot in the list
       // Between previous and current
       bool insert(long key, T item, int id) {
           Node *previous = nullptr;
-          std::uint32_t previousBitPattern;
-          std::uint32_t previousHandle;
           Node *current = nullptr;
-          std::uint32_t currentBitPattern;
-          std::uint32_t currentHandle;
+          std::uint32_t handle;
+          Node* start = this->head;  // A failed validation searches again from previous
           while (true) {
-              previous = this->find(&current, key);
-
-              previousBitPattern = previous->resourceID;  // Will not change
-              currentBitPattern = current->resourceID;    // Will not change
-
-              // Lock nodes
-              if (previousBitPattern == currentBitPattern) {
-                  // Only need to lock one
-                  previousHandle = this->mrLock->Lock(previousBitPattern);
-              } else {
-                  previousHandle = this->mrLock->Lock(previousBitPattern);
-                  currentHandle = this->mrLock->Lock(currentBitPattern);
-              }
+              previous = this->find(&current, key, id, start);
 
-              // Validate the nodes are still valid
-              if (previous->next != current || current->isNextMarked()) {
-                  // UnLock nodes
-                  if (previousBitPattern == currentBitPattern) {
-                      // Only need to Unlock one
-                      this->mrLock->Unlock(previousHandle);
-                  } else {
-                      this->mrLock->Unlock(previousHandle);
-                      this->mrLock->Unlock(currentHandle);
-                  }
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              int elided = this->lockElided(previous, current, &handle, id);
+              if (elided == 0) {  // No longer valid, nothing is held
+                  start = previous;
                   continue;
               }
+              if (elided < 0) {
+                  handle = this->lockNodes(previous, current, id);
+
+                  // Validate the nodes are still valid
+                  if (previous->next != current || current->isNextMarked()) {
+                      this->mrLock->Unlock(handle);
+                      start = previous;
+                      continue;
+                  }
+              }
               // Already present
               if (current->key == key) {
-                  // UnLock nodes
-                  if (previousBitPattern == currentBitPattern) {
-                      // Only need to Unlock one
-                      this->mrLock->Unlock(previousHandle);
-                  } else {
-                      this->mrLock->Unlock(previousHandle);
-                      this->mrLock->Unlock(currentHandle);
-                  }
+                  this->mrLock->Unlock(handle);
                   return false;
               }
               // Insert
               Node* newNode = this->allocFromArea(id);
               if (newNode == nullptr) {
-                  // UnLock nodes
-                  if (previousBitPattern == currentBitPattern) {
-                      // Only need to Unlock one
-                      this->mrLock->Unlock(previousHandle);
-                  } else {
-                      this->mrLock->Unlock(previousHandle);
-                      this->mrLock->Unlock(currentHandle);
-                  }
+                  this->mrLock->Unlock(handle);
                   return false; // No memory available
               }
               newNode->flipV1();
@@ -260,33 +287,34 @@ class MRLockDurableSet {
               newNode->item = item;
               newNode->next = current;
               previous->next = newNode;
-              this->updateAlloc(id);
+              this->store.commit(id);
               newNode->makeValid();
 
-              // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
-
-              newNode->FLUSH_INSERT(this->mem);
-
-              // UnLock nodes
-              if (previousBitPattern == currentBitPattern) {
-                  // Only need to Unlock one
-                  this->mrLock->Unlock(previousHandle);
-              } else {
-                  this->mrLock->Unlock(previousHandle);
-                  this->mrLock->Unlock(currentHandle);
+              // Abort Check (For abort testing only), the locks are let go so the other threads can stop too
+#ifdef CRASH_INJECTION
+              if (this->abortFlag->load(std::memory_order_relaxed)) {
+                  this->mrLock->Unlock(handle);
+                  return true;
               }
+#endif
 
+              newNode->FLUSH_INSERT(this->mem, id);
+
+              this->mrLock->Unlock(handle);
               break;
           }
           return true;
       }
 
       // Searched for key
-      bool contains(long key) {
+      bool contains(long key, int id) {
           Node* current = this->head->next;
-          while (current->key < key)
-              current = current->next;
+          long traversed = 0;
+          while (current->key < key) {
+              current = current->getNextRef();  // A removed node's next is marked
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           if (current->key != key || current->isNextMarked()) return false;
           return true;
       }
@@ -295,49 +323,34 @@ class MRLockDurableSet {
       // Remove current between previous and successor
       bool remove(long key, int id) {
           Node *previous = nullptr;
-          std::uint32_t previousBitPattern;
-          std::uint32_t previousHandle;
           Node *current = nullptr;
-          std::uint32_t currentBitPattern;
-          std::uint32_t currentHandle;
           Node* successor = nullptr;
+          std::uint32_t handle;
+          Node* start = this->head;  // A failed validation searches again from previous
           while (true) {
-              previous = find(&current, key);
-
-              previousBitPattern = previous->resourceID;  // Will not change
-              currentBitPattern = current->resourceID;    // Will not change
-
-              // Lock nodes
-              if (previousBitPattern == currentBitPattern) {
-                  // Only need to lock one
-                  previousHandle = this->mrLock->Lock(previousBitPattern);
-              } else {
-                  previousHandle = this->mrLock->Lock(previousBitPattern);
-                  currentHandle = this->mrLock->Lock(currentBitPattern);
-              }
+              previous = find(&current, key, id, start);
 
-              // Validate the nodes are still valid
-              if (previous->next != current || current->isNextMarked()) {
-                  // UnLock nodes
-                  if (previousBitPattern == currentBitPattern) {
-                      // Only need to Unlock one
-                      this->mrLock->Unlock(previousHandle);
-                  } else {
-                      this->mrLock->Unlock(previousHandle);
-                      this->mrLock->Unlock(currentHandle);
-                  }
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              int elided = this->lockElided(previous, current, &handle, id);
+              if (elided == 0) {  // No longer valid, nothing is held
+                  start = previous;
                   continue;
               }
+              if (elided < 0) {
+                  handle = this->lockNodes(previous, current, id);
+
+                  // Validate the nodes are still valid
+                  if (previous->next != current || current->isNextMarked()) {
+                      this->mrLock->Unlock(handle);
+                      start = previous;
+                      continue;
+                  }
+              }
               // Not present
               if (current->key != key) {
-                  // UnLock nodes
-                  if (previousBitPattern == currentBitPattern) {
-                      // Only need to Unlock one
-                      this->mrLock->Unlock(previousHandle);
-                  } else {
-                      this->mrLock->Unlock(previousHandle);
-                      this->mrLock->Unlock(currentHandle);
-                  }
+                  this->mrLock->Unlock(handle);
                   return false;
               }
               // Remove
@@ -345,95 +358,65 @@ class MRLockDurableSet {
               current->next = successor->mark();
               previous->next = successor;
 
-              // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
-
-              current->FLUSH_DELETE(this->mem);
-
-              // UnLock nodes
-              if (previousBitPattern == currentBitPattern) {
-                  // Only need to Unlock one
-                  this->mrLock->Unlock(previousHandle);
-              } else {
-                  this->mrLock->Unlock(previousHandle);
-                  this->mrLock->Unlock(currentHandle);
+              // Abort Check (For abort testing only), the locks are let go so the other threads can stop too
+#ifdef CRASH_INJECTION
+              if (this->abortFlag->load(std::memory_order_relaxed)) {
+                  this->mrLock->Unlock(handle);
+                  return true;
               }
+#endif
 
+              current->FLUSH_DELETE(this->mem, id);
+
+              this->mrLock->Unlock(handle);
               break;
           }
           return true;
       }
 
       // Deletes all of the nodes
-      // Reads and resets memory
-      // Re-adds the valid nodes read from memory
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass
       // Will not be called concurrently
-      void recover(std::vector<int>* writeOpsVector) {
-
-          // Read Memory Manager
-          std::vector<long>* keys = new std::vector<long>();
-          std::vector<T>* items = new std::vector<T>();
-          std::vector<int>* durableAddressPrefixes = new std::vector<int>();
-          std::vector<int>* activeNodes = new std::vector<int>(this->numIDs);
-          for (int i = 0; i < this->numIDs; i++) activeNodes->at(i) = 0;
-          int numActiveNodes = this->mem.recoverMemory(keys, items, durableAddressPrefixes, activeNodes);
-
-          // Record volatile memory (For testing only)
-          this->keysVolatileRecovered = std::vector<long>();
-          Node* current = this->head->next.load();
-          while (current->next.load() != nullptr) {  // Only tail->next == nullptr
-              this->keysVolatileRecovered.push_back(current->key);
-              current = current->getNextRef();
-          }
-
-          // Record durable memory (For testing only)
-          this->keysDurableRecovered = std::vector<long>();
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->keysDurableRecovered.push_back(keys->at(i));
-          }
-
-          // Rejuvenate all of the nodes
-          this->FREE();
-          // No resources can have an ID of 0
-          unsigned int resourceNum = 3;
-          unsigned int pointBit = 3;
-          std::uint32_t resourceID = 4;  // Head and Tail have IDs 1 and 2 respectively
-          this->head = new Node((std::uint32_t) 1);
-          this->tail = new Node((std::uint32_t) 2);
-          this->head->next = this->tail;
-          this->head->key = MIN_KEY;  // Make sure keys are not less than
-          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i);
-          }
-          int numNodes = 0;
-          for (int i = 0; i < this->numIDs; i++) {
-              numNodes = writeOpsVector->at(i) + activeNodes->at(i);
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(numNodes);
-              for (int j = 0; j < numNodes; j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node((std::uint32_t) resourceID);
-                  resourceID = resourceID << 1;
-                  pointBit += 1;
-                  if (pointBit > 31) {
-                      pointBit = 1;
-                      resourceID = 1;
-                  }
-                  resourceNum += 1;
-              }
-          }
-          this->mrLock = new MRLock<std::uint32_t>(resourceID);  // Contains the number of resources+1
+      void recover(void) {
+          Node* previous = nullptr;  // Last node linked
+          this->store.recover(
+              [this](std::vector<long>* keys) {
+                  for (Node* current = this->head->next; current != this->tail; current = current->getNextRef())
+                      keys->push_back(current->key);
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->head = new Node(0);
+                  this->tail = new Node(1);
+                  this->head->next = this->tail;
+                  this->head->key = MIN_KEY;  // Make sure keys are not less than
+                  this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+                  this->createLock();
+                  previous = this->head;
+              },
+              [this, &previous](Node* node, const typename MemoryManager<T>::RecoveredCell&) {
+                  if (node->resource == -1) node->resource = this->stripeOf(node);
+                  previous->next = node;
+                  previous = node;
+              });
+          previous->next = this->tail;
+      }
 
-          // String the nodes together
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->insert(keys->at(i), items->at(i), durableAddressPrefixes->at(i));
-          }
+      // Read once the threads are done
+      // ELISION_RTM queues the request of an update inside of a hardware transaction first,
+      // the FLUSH still runs under it once it committed. Without RTM it is queued as usual
+      // Not run concurrently with the operations
+      void setElisionMode(int mode) {
+          this->elisionMode = mode;
+      }
 
-          delete keys;
-          delete items;
-          delete durableAddressPrefixes;
-          delete activeNodes;
+      int getElisionMode(void) {
+          return this->elisionMode;
+      }
 
+      OperationStats* getStats(void) {
+          return &this->stats;
       }
 
       // For testing (not run concurrentlly)
@@ -463,21 +446,15 @@ class MRLockDurableSet {
           std::cout << "Set size: " << count << std::endl;
       }
 
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
       // For testing (not run concurrentlly) (For abort testing only)
       void printRecovery(void) {
-
-          // Print the keys recovered from volatile memory
-          std::cout << "Volatile Set keys" << std::endl;
-          int numVolatileRecovered = this->keysVolatileRecovered.size();
-          for (int i = 0; i < numVolatileRecovered; i++)
-              std::cout << "Key: " << this->keysVolatileRecovered.at(i) << std::endl;
-
-          // Print the keys recovered from durable memory
-          std::cout << "Durable Set keys" << std::endl;
-          int numDurableRecovered = this->keysDurableRecovered.size();
-          for (int i = 0; i < numDurableRecovered; i++)
-              std::cout << "Key: " << this->keysDurableRecovered.at(i) << std::endl;
-
+          this->store.printRecovery();
       }
 
 };
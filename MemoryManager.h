@@ -2,145 +2,560 @@
 #define MEMORY_MANAGER_H
 
 // Memory Management Class
+// Cells hold a key of type K (ordered by Compare) and an item of type T, both trivially copyable
 
 #include <vector>
 #include <cstdint>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include "PersistentMemory.h"
+#include "NodePool.h"
+#include "Stats.h"
+#include "Checkpoint.h"
+#include "DurablePolicy.h"
 
-template <typename T>
+// Protocol (see DurablePolicy.h) maps the flags a node FLUSHes to the state of its cell
+// LinkFreeCells for the link-free, lock based and sequential sets, SOFTCells for the SOFT sets
+template <typename T, typename K = long, typename Compare = std::less<K>, typename Protocol = LinkFreeCells>
 class MemoryManager {
 
   public:
 
-      // Similar fields to the node in MemoryManager
-      // (except) durableAddress(Pre/Post)fix
-      struct MemCell {
+      // Key and item of a node, FLUSH sets state from the flags of the node (Protocol::state)
+      typedef DurableCell<K, T> MemCell;
 
-          long key;
+      // A valid cell found by recoverMemory, it is left where it is
+      struct RecoveredCell {
+          K key;
           T item;
-          int validBits;
-          bool insertValidFlag;  // Not needed to be stored
-          bool deleteValidFlag;  // Not needed to be stored
-          std::uintptr_t next;        // Used to indicate logical delete
-
-          // Constructor
-          MemCell(void) {
-              this->key = 0;
-              this->item = (T) 0;
-              this->validBits = 0;
-              this->insertValidFlag = false;
-              this->deleteValidFlag = false;
-              this->next = (std::uintptr_t) nullptr;
-          }
-
-          // Used by FLUSH to update the cell
-          void COPY(long key,
-                    T item,
-                    int validBits,
-                    bool insertValidFlag,
-                    bool deleteValidFlag,
-                    std::uintptr_t next) {
-              this->key = key;
-              this->item = item;
-              this->validBits = validBits;
-              this->insertValidFlag = insertValidFlag;
-              this->deleteValidFlag = deleteValidFlag;
-              this->next = next;
-          }
-
-          // Used by readResetMemory to determine the cells that
-          // have been successful inserted or removed
-          bool isValid(void) {
-              if ((this->validBits & 3) != 3)  // Cell incomplete or blank
-                  return false;
-              if ((bool) ((this->next) | 0))   // Cell logically deleted
-                  return false;
-              return true;
-          }
+          int durableAddressPrefix;
+          int durableAddressPostfix;
+      };
 
+      // Allocation cursor of the section of a thread, padded so threads never share its line
+      // Only touched by its own thread (and by recovery)
+      struct alignas(CACHE_LINE_SIZE) Section {
+          ChunkedArena<MemCell>* cells;
+          int freeListIndex;           // Next cell never handed out
+          std::vector<int> freeCells;  // Handed out before freeListIndex (after recovery)
       };
 
   private:
 
+      static const long PERSIST_SAMPLE_RATE = 64;  // One in every 64 write backs is timed
+
+      // Cells a thread FLUSHed that are not written back yet (GROUP_COMMIT or a batch)
+      // Only touched by its own thread
+      struct alignas(CACHE_LINE_SIZE) FlushRing {
+          std::vector<MemCell*> cells;
+          int count;
+          bool batching;  // Between beginBatch and endBatch
+      };
+
       int numMemPoolSections;
-      int memPoolSectionSize;
-      std::vector<std::vector<MemCell>> memPool;
-      std::vector<int> freeListIndex;
+      std::vector<ChunkedArena<MemCell>*> memPool;  // Each threads section (read only once built)
+      std::vector<Section> sections;                // Allocation cursor of each section
+      int backend;
+      PersistentRegion region;        // Only used by MAPPED_FILE
+      OperationStats stats;           // FLUSHes issued and elided by each thread
+      int flushMode;
+      std::vector<FlushRing> rings;   // One per thread id
+      CheckpointLog checkpoints;      // Cells FLUSHed since the last checkpoint began
+
+      // Queues cell on the ring of thread id, a full ring is written back
+      // A cell FLUSHed again right away (i.e. insert then remove) is queued once
+      void enqueue(MemCell* cell, int id) {
+          FlushRing& ring = this->rings[id];
+          if (ring.count > 0 && ring.cells[ring.count - 1] == cell) return;
+          ring.cells[ring.count] = cell;
+          ring.count += 1;
+          if (ring.count == (int) ring.cells.size()) this->sync(id);
+      }
+
+      // Blanks a valid cell recovery dropped (a duplicate key) before it is handed out again,
+      // so a crash before it is reused does not bring the key back. The caller fences
+      void discard(const RecoveredCell& cell) {
+          MemCell* lost = this->memPool[cell.durableAddressPrefix]->at(cell.durableAddressPostfix);
+          lost->state = 0;  // A blank cell
+          std::int32_t* logged = this->checkpoints.record(cell.durableAddressPrefix, cell.durableAddressPostfix);
+          if (this->backend == MAPPED_FILE) {
+              Persistence::WRITEBACK(lost, sizeof(MemCell));
+              if (logged != nullptr) Persistence::WRITEBACK(logged, sizeof(std::int32_t));
+          }
+      }
 
   public:
 
-      // Constructor
-      MemoryManager(int numIDs, int numOps) {
+      // Constructor (DRAM_SIMULATION backend)
+      // Each section starts with chunkSize cells and grows on demand
+      MemoryManager(int numIDs, long chunkSize = DEFAULT_CHUNK_SIZE) {
 
           // Create vectors of size numIDs
-          this->memPool = std::vector<std::vector<MemCell>>(numIDs);
-          this->freeListIndex = std::vector<int>(numIDs);
+          this->memPool = std::vector<ChunkedArena<MemCell>*>(numIDs);
+          this->sections = std::vector<Section>(numIDs);
+          this->backend = DRAM_SIMULATION;
 
-          // Allocate the memPool
+          // Allocate the memPool, on the NUMA node of each thread if placed
           for (int i = 0; i < numIDs; i++) {
-              this->memPool.at(i) = std::vector<MemCell>(numOps);
-              for (int j = 0; j < numOps; j++)
-                  this->memPool.at(i).at(j) = MemCell();
+              this->memPool.at(i) = new ChunkedArena<MemCell>(chunkSize);
+              this->memPool.at(i)->setNode(NumaTopology::placedNode(i));
           }
 
           // Set the current index for each thread
-          for (int i = 0; i < numIDs; i++)
-              this->freeListIndex.at(i) = numOps - 1;
+          for (int i = 0; i < numIDs; i++) {
+              this->sections.at(i).cells = this->memPool.at(i);
+              this->sections.at(i).freeListIndex = 0;
+          }
 
           this->numMemPoolSections = numIDs;
-          this->memPoolSectionSize = numOps;
+          this->stats = OperationStats(numIDs);
+          this->flushMode = SYNC_FLUSH;
+          this->rings = std::vector<FlushRing>(numIDs);
+          for (int i = 0; i < numIDs; i++) {
+              this->rings.at(i).cells = std::vector<MemCell*>(DEFAULT_GROUP_SIZE);
+              this->rings.at(i).count = 0;
+              this->rings.at(i).batching = false;
+          }
+          this->checkpoints.create(numIDs, chunkSize);
 
       }
 
+      // Constructor (MAPPED_FILE backend)
+      // poolPath may be a regular file or a file on a DAX mounted PMEM device
+      // The file is sized up front, each section holds numCells cells and does not grow
+      // If clearPool is false the cells already in the file are kept for recovery
+      // The checkpoint logs of the sections follow the cells in the file (see enableCheckpoints)
+      // Falls back to DRAM_SIMULATION if the file can not be mapped (see getBackend)
+      MemoryManager(int numIDs, long numCells, const char* poolPath, bool clearPool = true) {
+
+          // Create vectors of size numIDs
+          this->memPool = std::vector<ChunkedArena<MemCell>*>(numIDs);
+          this->sections = std::vector<Section>(numIDs);
+          this->backend = MAPPED_FILE;
+
+          // Map the memPool, each thread owns a contiguous section
+          std::size_t sectionBytes = sizeof(MemCell) * (std::size_t) numCells;
+          std::size_t logBytes = CheckpointLog::regionBytes(numIDs, numCells);
+          if (this->region.map(poolPath, sectionBytes * numIDs + logBytes, clearPool)) {
+              MemCell* cells = (MemCell*) this->region.address();
+              this->checkpoints.adopt(numIDs, (std::int32_t*) (cells + (std::size_t) numIDs * numCells), numCells);
+              for (int i = 0; i < numIDs; i++) {
+                  this->memPool.at(i) = new ChunkedArena<MemCell>(cells + (std::size_t) i * numCells, numCells);
+                  // The pages were touched by the mapping thread, move them to the node of the section
+                  if (NumaTopology::placedNode(i) >= 0)
+                      NumaTopology::bindMemory(cells + (std::size_t) i * numCells, sectionBytes,
+                                               NumaTopology::placedNode(i), true);
+              }
+          } else {
+              this->backend = DRAM_SIMULATION;
+              for (int i = 0; i < numIDs; i++) {
+                  this->memPool.at(i) = new ChunkedArena<MemCell>(numCells);
+                  this->memPool.at(i)->setNode(NumaTopology::placedNode(i));
+              }
+              this->checkpoints.create(numIDs, numCells);
+          }
+
+          // Set the current index for each thread
+          for (int i = 0; i < numIDs; i++) {
+              this->sections.at(i).cells = this->memPool.at(i);
+              this->sections.at(i).freeListIndex = 0;
+          }
+
+          this->numMemPoolSections = numIDs;
+          this->stats = OperationStats(numIDs);
+          this->flushMode = SYNC_FLUSH;
+          this->rings = std::vector<FlushRing>(numIDs);
+          for (int i = 0; i < numIDs; i++) {
+              this->rings.at(i).cells = std::vector<MemCell*>(DEFAULT_GROUP_SIZE);
+              this->rings.at(i).count = 0;
+              this->rings.at(i).batching = false;
+          }
+
+      }
+
+      // Destructor
+      // Whatever is still queued is written back
+      ~MemoryManager(void) {
+          this->syncAll();
+          for (int i = 0; i < this->numMemPoolSections; i++)
+              delete this->memPool.at(i);
+          if (this->backend == MAPPED_FILE)
+              this->region.unmap();
+      }
+
+      // DRAM_SIMULATION or MAPPED_FILE
+      int getBackend(void) {
+          return this->backend;
+      }
+
+      OperationStats* getStats(void) {
+          return &this->stats;
+      }
+
+      // SYNC_FLUSH or GROUP_COMMIT, a thread's ring is written back once groupSize cells are queued
+      // Under GROUP_COMMIT an operation is durable once its thread calls sync (or the ring fills),
+      // the valid flags of a node only say its FLUSH was queued
+      // Will not be called concurrently
+      void setFlushMode(int mode, int groupSize = DEFAULT_GROUP_SIZE) {
+          this->syncAll();
+          this->flushMode = mode;
+          for (int i = 0; i < this->numMemPoolSections; i++) {
+              this->rings.at(i).cells = std::vector<MemCell*>((groupSize > 0) ? groupSize : 1);
+              this->rings.at(i).count = 0;
+          }
+      }
+
+      int getFlushMode(void) {
+          return this->flushMode;
+      }
+
       // Each thread recieves from their own section of cells
-      // Once a cell is used it is never reused
+      // A cell stays tied to the node it was given to, it is reused along
+      // with that node once the node is reclaimed (see EpochManager)
+      // Returns -1 if the section can not grow any further
       int retrieveAddress(int sectionID) {
-          return this->freeListIndex.at(sectionID);
+          return this->retrieveAddress(&this->sections.at(sectionID));
+      }
+
+      // Same through the section handle of a thread (see section)
+      int retrieveAddress(Section* section) {
+          if (!section->freeCells.empty())
+              return section->freeCells.back();
+          if (!section->cells->reserve(section->freeListIndex))
+              return -1;
+          if (this->checkpoints.isEnabled() &&
+              !this->checkpoints.reserve((int) (section - this->sections.data()), section->freeListIndex))
+              return -1;
+          return section->freeListIndex;
       }
 
       // On successful insert, update index to next cell
       void updateAddress(int sectionID) {
-          this->freeListIndex.at(sectionID) -= 1;
+          this->updateAddress(&this->sections.at(sectionID));
+      }
+
+      void updateAddress(Section* section) {
+          if (!section->freeCells.empty())
+              section->freeCells.pop_back();
+          else
+              section->freeListIndex += 1;
+      }
+
+      // The allocation cursor of thread id, a thread may keep it in its context
+      // Stays valid for the lifetime of the memory manager
+      Section* section(int id) {
+          return &this->sections.at(id);
       }
 
       // Update Memory on both Insert and Remove
-      void FLUSH(long key,
+      void FLUSH(K key,
                  T item,
-                 int validBits,
-                 bool insertValidFlag,
-                 bool deleteValidFlag,
-                 std::uintptr_t next,
+                 typename Protocol::Flags flags,
                  int durableAddressPrefix,
-                 int durableAddressPostfix) {
-          this->memPool.at(durableAddressPrefix)
-                       .at(durableAddressPostfix).COPY(key, item, validBits,
-                                                       insertValidFlag, deleteValidFlag, next);
+                 int durableAddressPostfix,
+                 int id) {
+          MemCell* cell = this->memPool[durableAddressPrefix]->at(durableAddressPostfix);
+          cell->COPY(key, item, Protocol::state(flags));
+          std::int32_t* logged = this->checkpoints.record(durableAddressPrefix, durableAddressPostfix);
+          if (logged != nullptr && this->backend == MAPPED_FILE)  // Durable along with the cell
+              Persistence::WRITEBACK(logged, sizeof(std::int32_t));
+          if (this->flushMode == GROUP_COMMIT || this->rings[id].batching) {
+              this->enqueue(cell, id);
+              this->stats.add(id, FLUSHES_ISSUED);
+              return;
+          }
+          if (this->backend == MAPPED_FILE) {
+              this->stats.add(id, FENCES_ISSUED);
+              if (this->stats.every(id, FLUSHES_ISSUED, PERSIST_SAMPLE_RATE)) {  // Time a few of them
+                  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                  Persistence::PERSIST(cell, sizeof(MemCell));
+                  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin;
+                  this->stats.add(id, PERSIST_SAMPLES);
+                  this->stats.add(id, PERSIST_NANOSECONDS, elapsed.count());
+              } else {
+                  Persistence::PERSIST(cell, sizeof(MemCell));
+              }
+          }
+          this->stats.add(id, FLUSHES_ISSUED);
+      }
+
+      // A FLUSH thread id did not need to issue
+      void elideFlush(int id) {
+          this->stats.add(id, FLUSHES_ELIDED);
       }
 
-      // Reads all of the cells of memory and checks if the cell is valid or not
-      // If the cell is valid, store it, in any case reset the values of the cell
+      // Durability barrier, every FLUSH thread id issued is persistent once it returns
+      // Does nothing under SYNC_FLUSH outside of a batch
+      void sync(int id) {
+          FlushRing& ring = this->rings.at(id);
+          if (ring.count == 0) return;
+          if (this->backend == MAPPED_FILE) {  // Every batch is timed, there are few of them
+              std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+              for (int i = 0; i < ring.count; i++)
+                  Persistence::WRITEBACK(ring.cells[i], sizeof(MemCell));
+              Persistence::FENCE();
+              std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin;
+              this->stats.add(id, FENCES_ISSUED);
+              this->stats.add(id, PERSIST_SAMPLES);
+              this->stats.add(id, PERSIST_NANOSECONDS, elapsed.count());
+          }
+          ring.count = 0;
+      }
+
+      // Queues the FLUSHes of thread id until endBatch, whatever the flush mode
+      // Used by the batch operations of the sets, one fence per ring instead of one per FLUSH
+      void beginBatch(int id) {
+          this->rings.at(id).batching = true;
+      }
+
+      // Every FLUSH thread id issued since beginBatch is persistent once it returns
+      void endBatch(int id) {
+          this->sync(id);
+          this->rings.at(id).batching = false;
+      }
+
+      // Syncs every thread (not run concurrently)
+      void syncAll(void) {
+          for (int i = 0; i < this->numMemPoolSections; i++)
+              this->sync(i);
+      }
+
+      // Scans one section, valid cells are left in place and returned in key order
+      // Invalid cells below the last valid one are handed out before fresh cells
+      // (they are not rewritten, every FLUSH writes a whole cell)
+      // Each section may be recovered by its own thread
+      void recoverSection(int sectionID, std::vector<RecoveredCell>* recovered) {
+          ChunkedArena<MemCell>* section = this->memPool.at(sectionID);
+          std::vector<int>& freeCells = this->sections.at(sectionID).freeCells;
+          long numCells = section->capacity();
+          int lastValid = -1;
+          for (long j = 0; j < numCells; j++) {
+              MemCell* cell = section->at(j);
+              if (cell->isValid()) {
+                  recovered->push_back({cell->key, cell->item, sectionID, (int) j});
+                  lastValid = (int) j;
+              }
+          }
+          freeCells.clear();
+          for (int j = lastValid - 1; j >= 0; j--) {  // Lowest index is handed out first
+              if (!section->at(j)->isValid())
+                  freeCells.push_back(j);
+          }
+          this->sections.at(sectionID).freeListIndex = lastValid + 1;
+          std::sort(recovered->begin(), recovered->end(),
+                    [](const RecoveredCell& a, const RecoveredCell& b) { return Compare()(a.key, b.key); });
+      }
+
+      // Recovers every section in parallel and merges them into one key ordered vector
+      // Of two valid cells with the same key only the first is kept, the other is blanked and handed out again
+      // Returns the number of recovered cells
+      // Will not be called concurrently
+      int recoverMemory(std::vector<RecoveredCell>* recovered) {
+          this->syncAll();  // Nothing queued is left behind the scan
+          std::vector<std::vector<RecoveredCell>> sections(this->numMemPoolSections);
+          std::vector<std::thread> scanners;
+          for (int i = 0; i < this->numMemPoolSections; i++)
+              scanners.push_back(std::thread(&MemoryManager::recoverSection, this, i, &sections.at(i)));
+          for (int i = 0; i < this->numMemPoolSections; i++)
+              scanners.at(i).join();
+
+          // Merge the sorted sections pairwise
+          auto byKey = [](const RecoveredCell& a, const RecoveredCell& b) { return Compare()(a.key, b.key); };
+          std::vector<std::size_t> runs;
+          recovered->clear();
+          for (int i = 0; i < this->numMemPoolSections; i++) {
+              runs.push_back(recovered->size());
+              recovered->insert(recovered->end(), sections.at(i).begin(), sections.at(i).end());
+          }
+          runs.push_back(recovered->size());
+          while (runs.size() > 2) {
+              std::vector<std::size_t> merged;
+              for (std::size_t r = 0; r + 2 < runs.size(); r += 2) {
+                  std::inplace_merge(recovered->begin() + runs.at(r),
+                                     recovered->begin() + runs.at(r + 1),
+                                     recovered->begin() + runs.at(r + 2), byKey);
+                  merged.push_back(runs.at(r));
+              }
+              if (runs.size() % 2 == 0) merged.push_back(runs.at(runs.size() - 2));  // Unpaired run
+              merged.push_back(runs.back());
+              runs = merged;
+          }
+
+          // Drop duplicate keys, the cell of a dropped one is blanked before it is handed out again
+          std::size_t count = 0;
+          bool discarded = false;
+          for (std::size_t i = 0; i < recovered->size(); i++) {
+              RecoveredCell cell = recovered->at(i);
+              if (count > 0 && !Compare()(recovered->at(count - 1).key, cell.key)) {  // Sorted, so equal
+                  this->discard(cell);
+                  this->sections.at(cell.durableAddressPrefix).freeCells.push_back(cell.durableAddressPostfix);
+                  discarded = true;
+                  continue;
+              }
+              recovered->at(count) = cell;
+              count += 1;
+          }
+          recovered->resize(count);
+          if (discarded && this->backend == MAPPED_FILE) Persistence::FENCE();
+          return (int) count;
+      }
+
+      // Simulated crash (crash injection), every cell still queued by a thread (FLUSHed but not
+      // synced) is left torn: it fails its checksum and recovery drops it, along with any older
+      // durable state of the cell. Returns the number of torn cells
+      // Not run concurrently
+      long tearUnsynced(void) {
+          long torn = 0;
+          for (int i = 0; i < this->numMemPoolSections; i++) {
+              FlushRing& ring = this->rings.at(i);
+              for (int j = 0; j < ring.count; j++) {
+                  ring.cells[j]->state ^= 1u << 31;  // A checksum bit
+                  if (this->backend == MAPPED_FILE) Persistence::WRITEBACK(ring.cells[j], sizeof(MemCell));
+              }
+              torn += ring.count;
+              ring.count = 0;
+              ring.batching = false;
+          }
+          if (this->backend == MAPPED_FILE) Persistence::FENCE();
+          return torn;
+      }
+
+      // Logs the cells FLUSHed from the first checkpoint on (see Checkpoint.h)
+      // A mapped pool that has an image must be opened with checkpoints enabled again,
+      // restoreMemory can not tell what was FLUSHed while they were not
       // Will not be called concurrently
-      int readResetMemory(std::vector<long>* keys,
-                          std::vector<T>* items,
-                          std::vector<int>* durableAddressPrefixes,
-                          std::vector<int>* activeNodes) {
-          int count = 0;
-          // Scan through memPool sections
+      void enableCheckpoints(void) {
           for (int i = 0; i < this->numMemPoolSections; i++) {
-              this->freeListIndex.at(i) = 0;
-              for (int j = 0; j < this->memPoolSectionSize; i++) {
-                  if (this->memPool.at(i).at(j).isValid()) {
-                      // Collect the indices of valid nodes
-                      keys->push_back(this->memPool.at(i).at(j).key);
-                      items->push_back(this>memPool.at(i).at(j).item);
-                      durableAddressPrefixes->push_back(i);
-                      activeNodes->at(i) += 1;  // Records active cells for a thread
-                      count += 1;               // Records active cells for all threads
+              long capacity = this->memPool.at(i)->capacity();
+              if (capacity > 0) this->checkpoints.reserve(i, capacity - 1);
+          }
+          this->checkpoints.enable();
+      }
+
+      bool checkpointsEnabled(void) {
+          return this->checkpoints.isEnabled();
+      }
+
+      // Every FLUSH from now on is logged until the image is written (endCheckpoint)
+      // Returns the generation of the checkpoint, 0 if checkpoints are not enabled or one is under way
+      std::uint32_t beginCheckpoint(void) {
+          return this->checkpoints.begin();
+      }
+
+      // Copies the cell at durableAddress, returns false if it does not hold a key
+      // Runs alongside FLUSHes, a torn copy fails its checksum (and its FLUSH is logged)
+      bool readCell(int durableAddressPrefix, int durableAddressPostfix, RecoveredCell* cell) {
+          MemCell copy;
+          std::memcpy((void*) &copy, this->memPool[durableAddressPrefix]->at(durableAddressPostfix), sizeof(MemCell));
+          if (!copy.isValid()) return false;
+          *cell = {copy.key, copy.item, durableAddressPrefix, durableAddressPostfix};
+          return true;
+      }
+
+      // Writes cells (read by readCell, in key order) to path as the image of generation
+      // Returns false if it could not be written, path is removed then and a restore scans every section
+      // The previous generation's log is only cleared once the new image (or the removal) is durable.
+      // If neither is, the old image may still be on disk: both logs are kept for it, and the
+      // checkpoint is left under way, so no later one begins
+      bool endCheckpoint(const char* path, const std::vector<RecoveredCell>& cells, std::uint32_t generation) {
+          bool written = CheckpointImage<RecoveredCell>::write(path, cells, this->numMemPoolSections, generation);
+          if (!written && !CheckpointImage<RecoveredCell>::remove(path)) return false;
+          this->checkpoints.end(generation);
+          return written;
+      }
+
+      // Same result as recoverMemory from the image at path, only the cells logged since it was
+      // taken are read from the sections. The restored cells are written as a new image
+      // Returns -1 if checkpoints are not enabled or there is no image of this memory manager
+      // Will not be called concurrently
+      int restoreMemory(const char* path, std::vector<RecoveredCell>* recovered) {
+          this->syncAll();  // Nothing queued is left behind
+          std::uint32_t generation = 0;
+          recovered->clear();
+          if (!this->checkpoints.isEnabled() ||
+              !CheckpointImage<RecoveredCell>::read(path, this->numMemPoolSections, recovered, &generation)) {
+              recovered->clear();
+              return -1;
+          }
+
+          // The logged cells are read again, the image holds what they were when it was taken
+          auto byKey = [](const RecoveredCell& a, const RecoveredCell& b) { return Compare()(a.key, b.key); };
+          std::vector<std::vector<long>> logged(this->numMemPoolSections);
+          std::vector<RecoveredCell> replayed;
+          for (int i = 0; i < this->numMemPoolSections; i++) {
+              std::vector<long>& indices = logged.at(i);
+              this->checkpoints.logged(i, &indices);
+              std::sort(indices.begin(), indices.end());
+              indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+              ChunkedArena<MemCell>* section = this->memPool.at(i);
+              for (long j : indices) {
+                  if (j < section->capacity() && section->at(j)->isValid())
+                      replayed.push_back({section->at(j)->key, section->at(j)->item, i, (int) j});
+              }
+          }
+          std::size_t count = 0;
+          for (std::size_t i = 0; i < recovered->size(); i++) {
+              RecoveredCell cell = recovered->at(i);
+              if (cell.durableAddressPrefix < 0 || cell.durableAddressPrefix >= this->numMemPoolSections ||
+                  cell.durableAddressPostfix >= this->memPool.at(cell.durableAddressPrefix)->capacity())
+                  continue;
+              std::vector<long>& indices = logged.at(cell.durableAddressPrefix);
+              if (std::binary_search(indices.begin(), indices.end(), (long) cell.durableAddressPostfix))
+                  continue;
+              recovered->at(count) = cell;
+              count += 1;
+          }
+          recovered->resize(count);
+          std::sort(replayed.begin(), replayed.end(), byKey);
+          recovered->insert(recovered->end(), replayed.begin(), replayed.end());
+          std::inplace_merge(recovered->begin(), recovered->begin() + count, recovered->end(), byKey);
+
+          // Drop duplicate keys, as recoverMemory does
+          count = 0;
+          bool discarded = false;
+          for (std::size_t i = 0; i < recovered->size(); i++) {
+              RecoveredCell cell = recovered->at(i);
+              if (count > 0 && !Compare()(recovered->at(count - 1).key, cell.key)) {
+                  this->discard(cell);
+                  discarded = true;
+                  continue;
+              }
+              recovered->at(count) = cell;
+              count += 1;
+          }
+          recovered->resize(count);
+          if (discarded && this->backend == MAPPED_FILE) Persistence::FENCE();
+
+          // Cells below the last one kept in a section are handed out first, as after recoverSection
+          std::vector<std::vector<int>> kept(this->numMemPoolSections);
+          for (std::size_t i = 0; i < count; i++)
+              kept.at(recovered->at(i).durableAddressPrefix).push_back(recovered->at(i).durableAddressPostfix);
+          for (int i = 0; i < this->numMemPoolSections; i++) {
+              std::vector<int>& indices = kept.at(i);
+              std::sort(indices.begin(), indices.end());
+              std::vector<int>& freeCells = this->sections.at(i).freeCells;
+              freeCells.clear();
+              int lastValid = indices.empty() ? -1 : indices.back();
+              for (int j = lastValid - 1, k = (int) indices.size() - 2; j >= 0; j--) {  // Lowest index is handed out first
+                  if (k >= 0 && indices.at(k) == j) {
+                      k -= 1;
+                      continue;
                   }
-                  this->memPool.at(i).at(j).COPY(0, (T) 0, 0, false, false, (std::uintptr_t) nullptr);
-                  this->freeListIndex.at(i) += 1;
+                  freeCells.push_back(j);
               }
+              this->sections.at(i).freeListIndex = lastValid + 1;
           }
-          return count;
+
+          // The restored cells become the image of a new generation, then the logs start over
+          // (a crash in between leaves the new image with the old logs, which are only read again)
+          std::uint32_t next = std::max(generation, this->checkpoints.getGeneration()) + 1;
+          if (!CheckpointImage<RecoveredCell>::write(path, *recovered, this->numMemPoolSections, next))
+              CheckpointImage<RecoveredCell>::remove(path);
+          this->enableCheckpoints();
+          this->checkpoints.restart(next);
+          return (int) count;
       }
 
 };
@@ -0,0 +1,212 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+// Chunked Arena and Node Pool Classes
+// Elements are handed out by index from chunks that double in size
+// (firstChunkSize, 2 * firstChunkSize, 4 * firstChunkSize, ...)
+// Chunks are created on demand by the owning thread and never move, so an
+// index (and the address behind it) stays valid while the arena grows
+// An arena placed on a NUMA node maps its chunks there, whichever thread creates them
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <new>
+#include "PersistentMemory.h"
+#include "NumaTopology.h"
+
+static const long DEFAULT_CHUNK_SIZE = 1024;
+
+template <typename T>
+class ChunkedArena {
+
+  public:
+
+      static const int MAX_CHUNKS = 40;  // firstChunkSize * 2^40 elements
+
+  private:
+
+      std::atomic<T*> chunks[MAX_CHUNKS];  // Read by every thread, grown by the owner
+      long firstChunkSize;
+      int numChunks;
+      bool growable;                       // False if the arena adopted a fixed region
+      int node;                            // NUMA node of the chunks, -1 for first touch
+      std::uint64_t mappedChunks;          // Chunks mapped on node (bit k is chunk k)
+
+      // Chunk k holds the indices [firstChunkSize * (2^k - 1), firstChunkSize * (2^(k+1) - 1))
+      int chunkOf(long index) {
+          std::uint64_t block = (std::uint64_t) (index / this->firstChunkSize) + 1;
+          return 63 - __builtin_clzll(block);
+      }
+
+      long chunkStart(int chunk) {
+          return this->firstChunkSize * ((1l << chunk) - 1);
+      }
+
+      // Value initialized like new T[size](), on node if the arena is placed
+      T* createChunk(long size) {
+          if (this->node >= 0) {
+              T* cells = (T*) NumaTopology::allocate(sizeof(T) * (std::size_t) size, this->node);
+              if (cells != nullptr) {
+                  for (long i = 0; i < size; i++)
+                      new (cells + i) T();
+                  this->mappedChunks |= 1ull << this->numChunks;
+                  return cells;
+              }
+          }
+          return new T[size]();
+      }
+
+  public:
+
+      // Constructor (grows on demand)
+      ChunkedArena(long firstChunkSize) {
+          for (int i = 0; i < MAX_CHUNKS; i++)
+              this->chunks[i].store(nullptr, std::memory_order_relaxed);
+          this->firstChunkSize = (firstChunkSize > 0) ? firstChunkSize : DEFAULT_CHUNK_SIZE;
+          this->numChunks = 0;
+          this->growable = true;
+          this->node = -1;
+          this->mappedChunks = 0;
+      }
+
+      // Constructor (a fixed region, i.e. a mapped file section, it never grows)
+      ChunkedArena(T* region, long size) {
+          for (int i = 0; i < MAX_CHUNKS; i++)
+              this->chunks[i].store(nullptr, std::memory_order_relaxed);
+          this->chunks[0].store(region, std::memory_order_relaxed);
+          this->firstChunkSize = size;
+          this->numChunks = 1;
+          this->growable = false;
+          this->node = -1;
+          this->mappedChunks = 0;
+      }
+
+      ChunkedArena(const ChunkedArena&) = delete;
+      ChunkedArena& operator=(const ChunkedArena&) = delete;
+
+      // Destructor
+      ~ChunkedArena(void) {
+          if (!this->growable) return;  // The region belongs to someone else
+          for (int i = 0; i < this->numChunks; i++) {
+              T* cells = this->chunks[i].load(std::memory_order_relaxed);
+              if ((this->mappedChunks >> i) & 1) {
+                  long size = this->firstChunkSize << i;
+                  for (long j = 0; j < size; j++)
+                      cells[j].~T();
+                  NumaTopology::release(cells, sizeof(T) * (std::size_t) size);
+              } else {
+                  delete[] cells;
+              }
+          }
+      }
+
+      // Chunks created from now on are placed on node (-1 leaves them to first touch)
+      // Only called by the owner of the arena
+      void setNode(int node) {
+          this->node = node;
+      }
+
+      // Assumes index is below capacity()
+      T* at(long index) {
+          int chunk = this->chunkOf(index);
+          return this->chunks[chunk].load(std::memory_order_acquire) + (index - this->chunkStart(chunk));
+      }
+
+      // Creates the chunks up to index
+      // Returns false if index can never be held
+      // Only called by the owner of the arena
+      bool reserve(long index) {
+          if (index < 0) return false;
+          if (index < this->capacity()) return true;
+          if (!this->growable) return false;
+          int chunk = this->chunkOf(index);
+          if (chunk >= MAX_CHUNKS) return false;
+          while (this->numChunks <= chunk) {
+              T* cells = this->createChunk(this->firstChunkSize << this->numChunks);
+              this->chunks[this->numChunks].store(cells, std::memory_order_release);
+              this->numChunks += 1;
+          }
+          return true;
+      }
+
+      long capacity(void) {
+          return this->chunkStart(this->numChunks);
+      }
+
+};
+
+// Each thread takes nodes from its own arena, nodes of a chunk are contiguous
+// Under a NumaTopology placement the arena of thread id lives on its node
+template <typename Node>
+class NodePool {
+
+  public:
+
+      // The arena of a thread, a thread may keep it in its context
+      struct alignas(CACHE_LINE_SIZE) ThreadPool {
+          ChunkedArena<Node>* arena;
+          long nextIndex;              // Next node that was never handed out
+      };
+
+  private:
+
+      std::vector<ThreadPool> pools;
+      int numIDs;
+
+  public:
+
+      // Constructor
+      // Will not be called concurrently
+      NodePool(int numIDs, long chunkSize = DEFAULT_CHUNK_SIZE) : pools(numIDs) {
+          for (int i = 0; i < numIDs; i++) {
+              this->pools.at(i).arena = new ChunkedArena<Node>(chunkSize);
+              this->pools.at(i).arena->setNode(NumaTopology::placedNode(i));
+              this->pools.at(i).nextIndex = 0;
+          }
+          this->numIDs = numIDs;
+      }
+
+      // Destructor (frees every node handed out)
+      ~NodePool(void) {
+          for (int i = 0; i < this->numIDs; i++)
+              delete this->pools.at(i).arena;
+      }
+
+      // Next free node of thread id, it is not taken until commit
+      // Returns nullptr if no memory is available
+      Node* peek(int id) {
+          return this->peek(&this->pools.at(id));
+      }
+
+      Node* peek(ThreadPool* pool) {
+          if (!pool->arena->reserve(pool->nextIndex)) return nullptr;
+          return pool->arena->at(pool->nextIndex);
+      }
+
+      // The node returned by peek is now in use
+      void commit(int id) {
+          this->pools.at(id).nextIndex += 1;
+      }
+
+      void commit(ThreadPool* pool) {
+          pool->nextIndex += 1;
+      }
+
+      // Stays valid for the lifetime of the pool
+      ThreadPool* pool(int id) {
+          return &this->pools.at(id);
+      }
+
+      // Places the nodes thread id takes from now on (-1 leaves them to first touch)
+      void setNode(int id, int node) {
+          this->pools.at(id).arena->setNode(node);
+      }
+
+      long allocated(int id) {
+          return this->pools.at(id).nextIndex;
+      }
+
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+// NUMA Topology and Placement
+// The nodes and their CPUs are read from /sys/devices/system/node (no libnuma needed),
+// a machine without it is a single node holding every CPU the process may run on
+// Thread id i runs on the i'th CPU, taken node by node (COMPACT) or round robin over the nodes (SCATTER)
+// Memory is placed on a node with mbind, before it is first touched where possible
+// Once setPlacement is called the memory managers and node pools created afterwards
+// put the section and the pool of thread id on nodeOf(id)
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+enum ThreadPlacement {
+    COMPACT = 0,  // Fill a node before using the next one (least cross node traffic)
+    SCATTER = 1   // Spread the ids over the nodes (most memory bandwidth)
+};
+
+class NumaTopology {
+
+  private:
+
+      static const int MPOL_PREFERRED_MODE = 1;  // <numaif.h> values, it may not be installed
+      static const int MPOL_MF_MOVE_FLAG = 1 << 1;
+
+      std::vector<std::vector<int>> nodeCPUs;  // CPUs of each node this process may run on
+      std::vector<int> nodeIDs;                // System id of each of those nodes
+      std::vector<int> cpus;                   // CPU of thread id (modulo the number of CPUs)
+      std::vector<int> nodes;                  // Node of thread id
+
+      static NumaTopology*& current(void) {
+          static NumaTopology* topology = nullptr;
+          return topology;
+      }
+
+      // Parses a cpulist such as "0-3,8-11"
+      static std::vector<int> parseList(const std::string& list) {
+          std::vector<int> values;
+          std::stringstream ranges(list);
+          std::string range;
+          while (std::getline(ranges, range, ',')) {
+              if (range.empty() || range == "\n") continue;
+              std::size_t dash = range.find('-');
+              int first = std::stoi(range.substr(0, dash));
+              int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+              for (int cpu = first; cpu <= last; cpu++)
+                  values.push_back(cpu);
+          }
+          return values;
+      }
+
+      // Reads the nodes, leaving out the CPUs the process may not run on and nodes without CPUs
+      void detect(void) {
+          cpu_set_t allowed;
+          CPU_ZERO(&allowed);
+          bool masked = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+          std::ifstream online("/sys/devices/system/node/online");
+          std::string onlineList;
+          if (online.is_open()) std::getline(online, onlineList);
+          std::vector<int> onlineNodes = parseList(onlineList);  // Node ids may have holes
+          for (int node : onlineNodes) {
+              std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+              std::string list;
+              if (file.is_open()) std::getline(file, list);
+              std::vector<int> usable;
+              std::vector<int> listed = parseList(list);
+              for (int cpu : listed) {
+                  if (!masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                      usable.push_back(cpu);
+              }
+              if (!usable.empty()) {
+                  this->nodeCPUs.push_back(usable);
+                  this->nodeIDs.push_back(node);
+              }
+          }
+          if (this->nodeCPUs.empty()) {  // No sysfs, one node
+              std::vector<int> usable;
+              for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                  if (masked ? CPU_ISSET(cpu, &allowed) : cpu < (int) sysconf(_SC_NPROCESSORS_ONLN))
+                      usable.push_back(cpu);
+              }
+              if (usable.empty()) usable.push_back(0);
+              this->nodeCPUs.push_back(usable);
+              this->nodeIDs.push_back(0);
+          }
+      }
+
+      // Orders the CPUs the thread ids are bound to
+      void place(int placement) {
+          int numNodes = this->nodeCPUs.size();
+          if (placement == SCATTER) {
+              for (int round = 0; ; round++) {
+                  bool placed = false;
+                  for (int node = 0; node < numNodes; node++) {
+                      if (round >= (int) this->nodeCPUs.at(node).size()) continue;
+                      this->cpus.push_back(this->nodeCPUs.at(node).at(round));
+                      this->nodes.push_back(this->nodeIDs.at(node));
+                      placed = true;
+                  }
+                  if (!placed) break;
+              }
+          } else {
+              for (int node = 0; node < numNodes; node++) {
+                  for (int cpu : this->nodeCPUs.at(node)) {
+                      this->cpus.push_back(cpu);
+                      this->nodes.push_back(this->nodeIDs.at(node));
+                  }
+              }
+          }
+      }
+
+  public:
+
+      // Constructor
+      NumaTopology(int placement = COMPACT) {
+          this->detect();
+          this->place(placement);
+      }
+
+      int numNodes(void) {
+          return this->nodeCPUs.size();
+      }
+
+      int numCPUs(void) {
+          return this->cpus.size();
+      }
+
+      // Ids beyond the number of CPUs wrap around
+      int cpuOf(int id) {
+          return this->cpus.at(id % this->cpus.size());
+      }
+
+      // System id of the index'th node, in [0, numNodes())
+      int nodeAt(int index) {
+          return this->nodeIDs.at(index);
+      }
+
+      // System id of the node, as used by mbind
+      int nodeOf(int id) {
+          return this->nodes.at(id % this->nodes.size());
+      }
+
+      // Binds the calling thread to the CPU of id
+      // Returns false if the thread could not be bound
+      bool bindThread(int id) {
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          CPU_SET(this->cpuOf(id), &set);
+          return sched_setaffinity(0, sizeof(set), &set) == 0;
+      }
+
+      // Prefers node for the pages of [address, address + length), only whole pages are bound
+      // If move is set pages already touched are migrated too
+      // Returns false if the range could not be bound (i.e. no NUMA support)
+      static bool bindMemory(void* address, std::size_t length, int node, bool move) {
+#if defined(__linux__) && defined(SYS_mbind)
+          std::uintptr_t page = (std::uintptr_t) sysconf(_SC_PAGESIZE);
+          std::uintptr_t start = ((std::uintptr_t) address + page - 1) & ~(page - 1);
+          std::uintptr_t end = ((std::uintptr_t) address + length) & ~(page - 1);
+          if (node < 0 || end <= start) return false;
+          std::vector<unsigned long> mask(node / (8 * sizeof(unsigned long)) + 1, 0);
+          mask.at(node / (8 * sizeof(unsigned long))) |= 1ul << (node % (8 * sizeof(unsigned long)));
+          unsigned long maxNode = mask.size() * 8 * sizeof(unsigned long) + 1;
+          return syscall(SYS_mbind, (void*) start, (unsigned long) (end - start), MPOL_PREFERRED_MODE,
+                         mask.data(), maxNode, move ? MPOL_MF_MOVE_FLAG : 0) == 0;
+#else
+          (void) address; (void) length; (void) node; (void) move;
+          return false;
+#endif
+      }
+
+      // Zeroed pages that are first touched on node (falls back to any node)
+      // Returns nullptr if no memory is available
+      static void* allocate(std::size_t length, int node) {
+          void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (address == MAP_FAILED) return nullptr;
+          bindMemory(address, length, node, false);
+          return address;
+      }
+
+      static void release(void* address, std::size_t length) {
+          if (address != nullptr) ::munmap(address, length);
+      }
+
+      // The topology used by the memory managers and node pools created from now on
+      // nullptr (the default) leaves the placement to first touch
+      // Not run concurrently, topology has to outlive them
+      static void setPlacement(NumaTopology* topology) {
+          current() = topology;
+      }
+
+      static NumaTopology* placement(void) {
+          return current();
+      }
+
+      // Node of thread id under the placement, -1 if there is none
+      static int placedNode(int id) {
+          NumaTopology* topology = current();
+          return (topology == nullptr) ? -1 : topology->nodeOf(id);
+      }
+
+};
+
+#endif
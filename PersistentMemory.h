@@ -0,0 +1,329 @@
+#ifndef PERSISTENT_MEMORY_H
+#define PERSISTENT_MEMORY_H
+
+// Persistent Memory Backend
+// Maps the memPool onto a file (or a DAX/PMEM region) and persists
+// cache lines with clwb/clflushopt/clflush followed by a store fence
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Not every libc exposes the DAX mapping flags
+#ifndef MAP_SHARED_VALIDATE
+#define MAP_SHARED_VALIDATE 0x03
+#endif
+#ifndef MAP_SYNC
+#define MAP_SYNC 0x80000
+#endif
+
+static const std::size_t CACHE_LINE_SIZE = 64;
+
+// Layout of the durable cells and nodes that store an item of type T
+// CACHE_LINE_LAYOUT gives every PNode and Node its own cache line
+// so neighbouring nodes never false share (the durable cells are packed, see CellAlignment)
+// Specialize for a T to get the PACKED_LAYOUT back, i.e.
+// template <> struct DurableLayout<int> { static const std::size_t ALIGNMENT = PACKED_LAYOUT; };
+static const std::size_t PACKED_LAYOUT = 0;  // alignas(0) is ignored
+static const std::size_t CACHE_LINE_LAYOUT = CACHE_LINE_SIZE;
+
+template <typename T>
+struct DurableLayout {
+    static const std::size_t ALIGNMENT = CACHE_LINE_LAYOUT;
+};
+
+// State word of a durable cell, stored next to its key and item
+// The two low bits say whether the cell holds a completed insert and whether it was removed,
+// the rest is a checksum of the key, the item and those bits
+// A cell only part of which reached the media (a torn write back) fails the checksum
+struct CellState {
+
+      static const std::uint32_t VALID = 1;    // Insert completed
+      static const std::uint32_t DELETED = 2;  // Removed
+      static const std::uint32_t FLAGS = VALID | DELETED;
+
+      // FNV-1a over the bytes of key and item, seeded with the flags
+      template <typename K, typename T>
+      static std::uint32_t checksum(const K& key, const T& item, std::uint32_t flags) {
+          std::uint32_t hash = 2166136261u ^ flags;
+          const unsigned char* bytes = (const unsigned char*) &key;
+          for (std::size_t i = 0; i < sizeof(K); i++)
+              hash = (hash ^ bytes[i]) * 16777619u;
+          bytes = (const unsigned char*) &item;
+          for (std::size_t i = 0; i < sizeof(T); i++)
+              hash = (hash ^ bytes[i]) * 16777619u;
+          return hash & ~FLAGS;
+      }
+
+      template <typename K, typename T>
+      static std::uint32_t seal(const K& key, const T& item, std::uint32_t flags) {
+          return checksum(key, item, flags) | (flags & FLAGS);
+      }
+
+      // A completed insert that was not removed and whose write back was not torn
+      // A blank cell (all zero) has no VALID bit
+      template <typename K, typename T>
+      static bool present(const K& key, const T& item, std::uint32_t state) {
+          if ((state & FLAGS) != VALID) return false;
+          return (state & ~FLAGS) == checksum(key, item, state & FLAGS);
+      }
+
+};
+
+// Durable cells are aligned to the next power of two of their size (at most a line)
+// so two or four of them share a line and none straddles two, i.e. one write back per FLUSH
+template <std::size_t Bytes>
+struct CellAlignment {
+    static const std::size_t VALUE = (Bytes <= 8) ? 8 : (Bytes <= 16) ? 16 :
+                                     (Bytes <= 32) ? 32 : CACHE_LINE_SIZE;
+};
+
+// Durable cell of every memory manager, a key of type K, an item of type T and their CellState
+// The protocol of the set decides the flags a FLUSH seals into state (see DurablePolicy.h)
+// Two or four cells share a line (CellAlignment), a torn cell fails its checksum
+template <typename K, typename T>
+struct alignas(CellAlignment<sizeof(K) + sizeof(T) + sizeof(std::uint32_t)>::VALUE) DurableCell {
+
+      K key;
+      T item;
+      std::uint32_t state;  // CellState
+
+      // Constructor
+      DurableCell(void) {
+          this->key = K();
+          this->item = T();
+          this->state = 0;
+      }
+
+      // Used by FLUSH to update the cell
+      void COPY(K key, T item, std::uint32_t flags) {
+          this->key = key;
+          this->item = item;
+          this->state = CellState::seal(this->key, this->item, flags);
+      }
+
+      // Used by recoverSection to determine the cells that
+      // have been successful inserted or removed
+      bool isValid(void) {
+          return CellState::present(this->key, this->item, this->state);
+      }
+
+};
+
+// Where the durable cells of a Memory Manager live
+enum PersistBackend {
+    DRAM_SIMULATION = 0,  // Cells are a plain DRAM copy (baseline)
+    MAPPED_FILE = 1       // Cells are mmap'd and written back on every FLUSH
+};
+
+// When a FLUSH is written back
+enum FlushMode {
+    SYNC_FLUSH = 0,    // Written back and fenced before FLUSH returns (baseline)
+    GROUP_COMMIT = 1   // Queued per thread, a batch is written back under one fence
+};
+
+// What a reader of a link-free set does with a node whose FLUSH is not done yet
+// Writers always FLUSH before they return, so a reader can instead report the last durable state
+enum ReadMode {
+    READER_FLUSH = 0,    // Flushes the node and reports it as it is (baseline)
+    READER_NO_FLUSH = 1  // Never flushes, a node is present from its durable insert to its durable remove
+};
+
+// Who unlinks the nodes removed from a link-free or SOFT list
+// A remove always persists its own delete before it returns, only the unlinking is deferred
+enum TrimMode {
+    TRIM_INLINE = 0,   // The remove and every find that crosses a removed node (baseline)
+    TRIM_DEFERRED = 1  // trimBacklog (e.g. a BackgroundTrimmer), a find only unlinks the run in front of its key
+};
+
+static const long DEFAULT_MAX_BACKLOG = 256;  // Removed nodes left linked before removes trim inline again
+
+// What an insert or remove of a link-free list does once it lost its CAS
+enum ContentionMode {
+    CONTENTION_RETRY = 0,     // Searches again right away (baseline)
+    CONTENTION_ELIMINATE = 1  // Offers itself to the other operations on its key first (EliminationArray.h)
+};
+
+// Where an operation of a link-free or SOFT list starts its search
+enum SearchMode {
+    SEARCH_FROM_HEAD = 0,   // Always the head (baseline)
+    SEARCH_FROM_FINGER = 1  // The node the previous operation of the thread stopped at, if it is still usable
+};
+
+// How LockDurableSet and MRLockDurableSet take the locks of an update
+enum ElisionMode {
+    ELISION_OFF = 0,  // Always the locks (baseline)
+    ELISION_RTM = 1   // In a hardware transaction along with the validation first (TransactionalMemory.h)
+};
+
+static const int DEFAULT_GROUP_SIZE = 64;  // Cells queued by a thread before its batch is written back
+
+// Crash points of the sets (the Abort Checks), built with -DCRASH_INJECTION an operation returns
+// result at the next one once abortFlag is set, as if its thread had stopped there
+// Without CRASH_INJECTION they compile to nothing, CRASH_INJECTION_ENABLED tells which it is
+#ifdef CRASH_INJECTION
+#define CRASH_POINT(abortFlag, result) do { if ((abortFlag)->load(std::memory_order_relaxed)) return result; } while (0)
+static const bool CRASH_INJECTION_ENABLED = true;
+#else
+#define CRASH_POINT(abortFlag, result) do { } while (0)
+static const bool CRASH_INJECTION_ENABLED = false;
+#endif
+
+class Persistence {
+
+  private:
+
+      // Write back instruction chosen once from cpuid
+      enum WriteBack { NONE = 0, CLFLUSH = 1, CLFLUSHOPT = 2, CLWB = 3 };
+
+      static int detectWriteBack(void) {
+#if defined(__x86_64__) || defined(__i386__)
+          unsigned int eax, ebx, ecx, edx;
+          if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+              if (ebx & (1u << 24)) return CLWB;
+              if (ebx & (1u << 23)) return CLFLUSHOPT;
+          }
+          return CLFLUSH;
+#else
+          return NONE;
+#endif
+      }
+
+  public:
+
+      static int writeBack(void) {
+          static const int instruction = detectWriteBack();
+          return instruction;
+      }
+
+      // Writes back a single cache line (does not order it)
+      static inline void WRITEBACK_LINE(const void* line) {
+#if defined(__x86_64__) || defined(__i386__)
+          switch (writeBack()) {
+              case CLWB:  // Encoded by hand so no -mclwb is needed
+                  asm volatile(".byte 0x66; xsaveopt %0" : "+m" (*(volatile char*) line));
+                  break;
+              case CLFLUSHOPT:
+                  asm volatile(".byte 0x66; clflush %0" : "+m" (*(volatile char*) line));
+                  break;
+              default:
+                  _mm_clflush(line);
+                  break;
+          }
+#else
+          (void) line;
+#endif
+      }
+
+      // Writes back every cache line covering [address, address + length)
+      static inline void WRITEBACK(const void* address, std::size_t length) {
+          std::uintptr_t line = ((std::uintptr_t) address) & ~(CACHE_LINE_SIZE - 1);
+          std::uintptr_t end = ((std::uintptr_t) address) + length;
+          for (; line < end; line += CACHE_LINE_SIZE)
+              WRITEBACK_LINE((const void*) line);
+      }
+
+      // Orders the write backs before any later store
+      static inline void FENCE(void) {
+#if defined(__x86_64__) || defined(__i386__)
+          _mm_sfence();
+#else
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+      }
+
+      static inline void PERSIST(const void* address, std::size_t length) {
+          WRITEBACK(address, length);
+          FENCE();
+      }
+
+};
+
+// A file backed region that holds the memPool
+// Uses MAP_SYNC when the file is on a DAX file system
+class PersistentRegion {
+
+  private:
+
+      void* base;
+      std::size_t length;
+      int fd;
+      bool dax;
+
+  public:
+
+      // Constructor
+      PersistentRegion(void) {
+          this->base = nullptr;
+          this->length = 0;
+          this->fd = -1;
+          this->dax = false;
+      }
+
+      // Maps length bytes of the file at path (creating it if needed)
+      // If clear is set the region is zeroed and persisted
+      // Returns false if the region could not be mapped
+      bool map(const char* path, std::size_t length, bool clear) {
+          this->fd = ::open(path, O_RDWR | O_CREAT, 0644);
+          if (this->fd < 0) return false;
+          struct stat info;
+          if (::fstat(this->fd, &info) != 0 ||
+              ((std::size_t) info.st_size < length && ::ftruncate(this->fd, (off_t) length) != 0)) {
+              ::close(this->fd);
+              this->fd = -1;
+              return false;
+          }
+          void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED_VALIDATE | MAP_SYNC, this->fd, 0);
+          this->dax = (address != MAP_FAILED);
+          if (!this->dax)  // Not DAX, fall back to a page cache mapping
+              address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+          if (address == MAP_FAILED) {
+              ::close(this->fd);
+              this->fd = -1;
+              return false;
+          }
+          this->base = address;
+          this->length = length;
+          if (clear) {
+              std::memset(this->base, 0, this->length);
+              Persistence::PERSIST(this->base, this->length);
+          }
+          return true;
+      }
+
+      void unmap(void) {
+          if (this->base != nullptr) {
+              if (!this->dax) ::msync(this->base, this->length, MS_SYNC);
+              ::munmap(this->base, this->length);
+          }
+          if (this->fd >= 0) ::close(this->fd);
+          this->base = nullptr;
+          this->length = 0;
+          this->fd = -1;
+      }
+
+      void* address(void) {
+          return this->base;
+      }
+
+      std::size_t size(void) {
+          return this->length;
+      }
+
+      bool isDAX(void) {
+          return this->dax;
+      }
+
+};
+
+#endif
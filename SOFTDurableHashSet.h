@@ -0,0 +1,433 @@
+#ifndef SOFT_DURABLE_HASH_SET_H
+#define SOFT_DURABLE_HASH_SET_H
+
+// SOFT Durable Hash Set Class
+// Keys are sharded across buckets, each bucket is a sorted SOFT list
+// Nodes, PNodes and flushes are the ones of the SOFT Durable Set
+// The bucket array is volatile and is rebuilt by recover()
+// Sharded by node, the buckets are split into one range per NUMA node with its heads on that node
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "SOFTMemoryManager.h"
+#include "NodePool.h"
+#include "Stats.h"
+#include "SOFTDurableSet.h"
+#include "DurablePolicy.h"
+
+template <typename T>
+class SOFTDurableHashSet {
+
+  public:
+
+      typedef typename SOFTDurableSet<T>::PNode PNode;
+      typedef typename SOFTDurableSet<T>::Node Node;
+
+  private:
+
+      std::vector<Node*> buckets;  // Head of each bucket list
+      Node* tailOne;               // Shared by every bucket list
+      Node* tailTwo;
+      int bucketShift;             // Keeps the top bits of the hash
+      int numBuckets;              // Power of two
+      int numShards;               // Ranges of buckets, one per NUMA node if sharded by node
+      NodePool<Node>* headPool;    // Bucket heads, shard s takes its heads from arena s
+      int INTEND_TO_INSERT = 0;
+      int INSERTED = 1;
+      int INTEND_TO_DELETE = 2;
+      int DELETED = 3;
+
+      // These are for the simulation only
+      SOFTMemoryManager<T>* mem;
+      std::atomic<bool>* abortFlag;
+      DurableStore<Node, SOFTMemoryManager<T>, SOFTCells> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread CAS failures, restarts and nodes traversed
+      int numIDs;
+
+      // Fibonacci hashing, neighbouring keys land in different buckets
+      int bucketOf(long key) {
+          return (int) ((((std::uint64_t) key) * 0x9E3779B97F4A7C15ull) >> this->bucketShift);
+      }
+
+      // Shard s holds the buckets [s * numBuckets / numShards, (s + 1) * numBuckets / numShards)
+      int shardOfBucket(int bucket) {
+          return (int) (((long) bucket * this->numShards) / this->numBuckets);
+      }
+
+      // Heads of shard s are placed on the s'th node of the placement
+      void createHeadPool(void) {
+          this->headPool = new NodePool<Node>(this->numShards, this->numBuckets / this->numShards + 1);
+          NumaTopology* topology = NumaTopology::placement();
+          for (int s = 0; s < this->numShards; s++)
+              this->headPool->setNode(s, (topology == nullptr) ? -1 : topology->nodeAt(s % topology->numNodes()));
+      }
+
+      Node* createHead(int bucket) {
+          int shard = this->shardOfBucket(bucket);
+          Node* head = this->headPool->peek(shard);
+          this->headPool->commit(shard);
+          return head;
+      }
+
+      // Creates the shared tails and an empty list (head -> tails) for every bucket
+      void createBuckets(void) {
+          this->tailOne = new Node();
+          this->tailTwo = new Node();
+          this->tailOne->key = MAX_KEY;    // Make sure keys are not greater than
+          this->tailTwo->key = MAX_KEY+1;  // Make sure keys are not greater than
+          this->tailOne->next.store(this->createRef(this->tailTwo, this->INSERTED));
+          this->createHeadPool();
+          this->buckets = std::vector<Node*>(this->numBuckets);
+          for (int i = 0; i < this->numBuckets; i++) {
+              this->buckets.at(i) = this->createHead(i);
+              this->buckets.at(i)->key = MIN_KEY;  // Make sure keys are not less than
+              this->buckets.at(i)->next.store(this->createRef(this->tailOne, this->INSERTED));
+          }
+      }
+
+      // Gets memory address from permanent storage and ties it with a pool node
+      Node* allocFromArea(long key, T item, int id) {
+          Node* newNode = this->store.allocate(id);
+          if (newNode == nullptr) return nullptr;
+          // Set the newNode
+          newNode->key = key;
+          newNode->item = item;
+          return newNode;
+      }
+
+      Node* createRef(Node* node, int state) {
+          return (Node*) (((std::uintptr_t) node) | state);
+      }
+
+      Node* getRef(Node* node) {
+          return (Node*) (((std::uintptr_t) node) & ~3);
+      }
+
+      int getState(Node* node) {
+          return (int) (((std::uintptr_t) node) & 3);
+      }
+
+      // node is assumed to be a valid reference
+      bool stateCAS(Node* node, int oldState, int newState) {
+          Node* successorReference = this->getRef(node->next.load());
+          Node* oldStateReference = this->createRef(successorReference, oldState);
+          Node* newStateReference = this->createRef(successorReference, newState);
+          return node->next.compare_exchange_strong(oldStateReference, newStateReference);
+      }
+
+      // Takes two nodes and removes current
+      bool trim(Node* previous, Node* current, int id) {
+          int previousState = this->getState(current);
+          Node* previousReference = this->getRef(previous);
+          Node* currentReference = this->getRef(current);
+          Node* successor = currentReference->next.load();
+          Node* successorReference = this->getRef(successor);
+          if (previousReference->next.compare_exchange_strong(current, this->createRef(successorReference, previousState)))
+              return true;
+          this->stats.add(id, TRIM_CAS_FAILURES);
+          return false;
+      }
+
+      // Common function to traverse the bucket list of key
+      // Trims logically deleted nodes that have yet to be removed
+      Node* find(Node** curr, long key, int* currentStatePtr, int id) {
+          Node* previous = this->buckets[this->bucketOf(key)];
+          Node* previousReference = this->getRef(previous);
+          Node* current = previousReference->next.load();
+          Node* currentReference = this->getRef(current);
+          Node* successor = nullptr;
+          int currentState = 0;
+          long traversed = 0;
+          while (true) {
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
+
+              if (this->getState(current) == this->DELETED) {  // previous was deleted, restart
+                  this->stats.add(id, FIND_RESTARTS);
+                  previous = this->buckets[this->bucketOf(key)];
+                  previousReference = this->getRef(previous);
+                  current = previousReference->next.load();
+                  currentReference = this->getRef(current);
+                  continue;
+              }
+              successor = currentReference->next.load();
+              currentState = this->getState(successor);
+              if (currentState != this->DELETED) {
+                  if (currentReference->key >= key) {
+                      break;
+                  }
+                  // Move current forward
+                  previous = current;
+                  previousReference = currentReference;
+                  current = previousReference->next.load();
+                  currentReference = this->getRef(current);
+                  traversed += 1;
+              }
+              else {
+                  this->trim(previous, current, id);
+                  current = previousReference->next.load();
+                  currentReference = this->getRef(current);
+              }
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          *currentStatePtr = currentState;
+          *curr = current;
+          return previous;
+      }
+
+  public:
+
+      // Constructor
+      // numBuckets is rounded up to a power of two
+      // shardByNode splits the buckets over the nodes of the NumaTopology placement (if there is one),
+      // shardOf(key) tells which node the bucket of key lives on
+      // Will not be called concurrently
+      SOFTDurableHashSet(SOFTMemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, int numBuckets,
+                         bool shardByNode = false) : store(mem, numIDs) {
+          this->stats = OperationStats(numIDs);
+          this->numBuckets = 2;  // At least two, a 64 bit shift is undefined
+          this->bucketShift = 63;
+          while (this->numBuckets < numBuckets) {
+              this->numBuckets = this->numBuckets << 1;
+              this->bucketShift -= 1;
+          }
+          this->numIDs = numIDs;
+          this->numShards = 1;
+          NumaTopology* topology = NumaTopology::placement();
+          if (shardByNode && topology != nullptr)
+              this->numShards = std::min(topology->numNodes(), this->numBuckets);
+          this->createBuckets();
+          this->abortFlag = abortFlag;
+          this->mem = mem;
+      }
+
+      // Free the durable sets nodes
+      void FREE() {
+          delete this->headPool;
+          delete this->tailOne;
+          delete this->tailTwo;
+          this->store.release();
+      }
+
+      // Inserts a key at a designated spot in its bucket
+      bool insert(long key, T item, int id) {
+          Node* previous = nullptr;
+          Node* previousReference = nullptr;
+          Node* current = nullptr;
+          Node* currentReference = nullptr;
+          Node* resultNode = nullptr;
+          int previousState;
+          int currentState;
+          bool result = false;
+          while (true) {
+              previous = this->find(&current, key, &currentState, id);
+              previousReference = this->getRef(previous);
+              currentReference = this->getRef(current);
+              previousState = this->getState(current);
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, false);
+
+              if (currentReference->key == key) {
+                  if (currentState != this->INTEND_TO_INSERT)
+                      return false;
+                  resultNode = currentReference;
+                  break;
+              }
+              else {
+                  Node* newNode = this->allocFromArea(key, item, id);
+                  if (newNode == nullptr) return false; // No memory available
+                  newNode->next.store(this->createRef(currentReference, this->INTEND_TO_INSERT), std::memory_order_relaxed);
+                  if (!previousReference->next.compare_exchange_strong(current, this->createRef(newNode, previousState))) {
+                      this->stats.add(id, INSERT_CAS_FAILURES);
+                      continue;
+                  }
+                  resultNode = newNode;
+                  this->store.commit(id);
+                  result = true;
+                  break;
+              }
+          }
+          // resultNode will always be a valid reference
+          resultNode->PNodePointer->create(resultNode->key, resultNode->item, this->mem, id);
+          while (this->getState(resultNode->next.load()) == this->INTEND_TO_INSERT)
+              this->stateCAS(resultNode, this->INTEND_TO_INSERT, this->INSERTED);
+          return result;
+      }
+
+      // Searched for key in its bucket
+      // Doesn't help with trimming logically deleted nodes or flushing
+      bool contains(long key, int id) {
+
+          Node* currentReference = this->getRef(this->buckets[this->bucketOf(key)]->next.load());
+          int currentState = 0;
+          long traversed = 0;
+          while (currentReference->key < key) {
+              currentReference = this->getRef(currentReference->next.load());
+              traversed += 1;
+          }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+
+          currentState = this->getState(currentReference->next.load());
+          if (currentReference->key != key) return false;
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (currentState == this->DELETED || currentState == this->INTEND_TO_INSERT) {
+              return false;
+          }
+          return true;
+
+      }
+
+      // Loops until node with key is removed
+      bool remove(long key, int id) {
+          Node* previous = nullptr;
+          Node* current = nullptr;
+          Node* currentReference = nullptr;
+          int currentState;
+          bool result = false;
+
+          previous = this->find(&current, key, &currentState, id);
+          currentReference = this->getRef(current);
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (currentReference->key != key) return false;
+          if (currentState == this->INTEND_TO_INSERT) return false;
+
+          // Makes INTEND_TO_DELETE result becomes true
+          while (!result && this->getState(currentReference->next.load()) == this->INSERTED) {
+              result = this->stateCAS(currentReference, this->INSERTED, this->INTEND_TO_DELETE);
+              if (!result) this->stats.add(id, REMOVE_CAS_FAILURES);
+
+              // Abort Check (For abort testing only)
+              CRASH_POINT(this->abortFlag, true);
+          }
+
+          // Help flush and then flip the state to deleted
+          currentReference->PNodePointer->destroy(this->mem, id);
+          while (this->getState(currentReference->next.load()) == this->INTEND_TO_DELETE)
+             this->stateCAS(currentReference, this->INTEND_TO_DELETE, this->DELETED);
+
+          if (result) this->trim(previous, current, id);
+          return result;
+      }
+
+      // Deletes all of the nodes
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Rebuilds the bucket array and links the valid nodes in key order in one pass
+      // Will not be called concurrently
+      void recover(void) {
+          std::vector<Node*> last;  // Last node linked in each bucket
+          this->store.recover(
+              // Element is in the set if its state is INSERTED or INTEND_TO_DELETE
+              [this](std::vector<long>* keys) {
+                  for (int i = 0; i < this->numBuckets; i++) {
+                      Node* currentReference = this->getRef(this->buckets.at(i)->next.load());
+                      while (currentReference != this->tailOne) {
+                          int currentState = this->getState(currentReference->next.load());
+                          if (currentState == this->INSERTED || currentState == this->INTEND_TO_DELETE)
+                              keys->push_back(currentReference->key);
+                          currentReference = this->getRef(currentReference->next.load());
+                      }
+                  }
+              },
+              [this, &last](void) {
+                  this->FREE();
+                  this->createBuckets();
+                  last = this->buckets;
+              },
+              [this, &last](Node* node, const typename SOFTMemoryManager<T>::RecoveredCell& cell) {
+                  Node*& previous = last.at(this->bucketOf(cell.key));
+                  previous->next.store(this->createRef(node, this->INSERTED), std::memory_order_relaxed);
+                  previous = node;
+              });
+          for (int i = 0; i < this->numBuckets; i++)
+              last.at(i)->next.store(this->createRef(this->tailOne, this->INSERTED));
+      }
+
+      // Index of the shard (node of the placement) holding the bucket of key
+      int shardOf(long key) {
+          return this->shardOfBucket(this->bucketOf(key));
+      }
+
+      int getNumShards(void) {
+          return this->numShards;
+      }
+
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
+      }
+
+      // For testing (not run concurrentlly)
+      // Element is in the set if its state is INSERTED or INTEND_TO_DELETE
+      void printSet(void) {
+          std::cout << "Set keys" << std::endl;
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* currentReference = this->getRef(this->buckets.at(i)->next.load());
+              while (currentReference != this->tailOne) {
+                  Node* successor = currentReference->next.load();
+                  std::cout << "bucket: " << i << " key: " << currentReference->key
+                            << " state: " << this->getState(successor) << std::endl;
+                  currentReference = this->getRef(successor);
+              }
+          }
+      }
+
+      // For testing (not run concurrentlly)
+      // Element is in the set if its state is INSERTED or INTEND_TO_DELETE
+      void printSetSize(void) {
+          int count = 0;
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* currentReference = this->getRef(this->buckets.at(i)->next.load());
+              while (currentReference != this->tailOne) {
+                  count += 1;
+                  currentReference = this->getRef(currentReference->next.load());
+              }
+          }
+          std::cout << "Set size: " << count << std::endl;
+      }
+
+      // For testing (not run concurrentlly)
+      // Every bucket is in key order and only holds keys of that bucket
+      // bucketSizes gets the keys in each bucket (INSERTED or INTEND_TO_DELETE, as recover counts them)
+      bool checkBuckets(std::vector<long>* bucketSizes) {
+          bucketSizes->assign(this->numBuckets, 0);
+          for (int i = 0; i < this->numBuckets; i++) {
+              Node* previousReference = this->buckets.at(i);
+              Node* currentReference = this->getRef(previousReference->next.load());
+              while (currentReference != this->tailOne) {
+                  if (currentReference == nullptr || currentReference->key <= previousReference->key ||
+                      this->bucketOf(currentReference->key) != i)
+                      return false;
+                  int currentState = this->getState(currentReference->next.load());
+                  if (currentState == this->INSERTED || currentState == this->INTEND_TO_DELETE)
+                      bucketSizes->at(i) += 1;
+                  previousReference = currentReference;
+                  currentReference = this->getRef(currentReference->next.load());
+              }
+          }
+          return true;
+      }
+
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
+      // For testing (not run concurrentlly) (For abort testing only)
+      void printRecovery(void) {
+          this->store.printRecovery();
+      }
+
+};
+
+#endif
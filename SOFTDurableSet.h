@@ -1,26 +1,35 @@
 #ifndef SOFT_DURABLE_SET_H
 #define SOFT_DURABLE_SET_H
 
-// Link-Free Durable Set Class
+// SOFT Durable Set Class
+// Keys of type K are ordered by Compare, the head and tail keys come from KeyTraits<K, Compare>
+// Value decides what a node holds for its item (see DurableTypes.h), the item itself by default
 
+#include <iostream>
 #include <atomic>
 #include <vector>
 #include <cstdint>
 #include "SOFTMemoryManager.h"
+#include "NodePool.h"
+#include "EpochManager.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
 
-long MIN_KEY = -100000;
-long MAX_KEY = 100000;
-
-template <typename T>
+template <typename T, typename K = long, typename Compare = std::less<K>, typename Value = InlineValue<T>>
 class SOFTDurableSet {
 
   public:
 
-      // Similar field to the MemCell in MemoryManager
-      struct PNode {
+      typedef typename Value::Stored Stored;  // T or the offset of an out of line T
+      typedef SOFTMemoryManager<Stored, K, Compare> Memory;
+
+      // Holds what is flushed to its MemCell (the flags are packed there)
+      // Line aligned (DurableLayout<T>)
+      struct alignas(DurableLayout<T>::ALIGNMENT) PNode {
 
-          std::atomic<long> key;
-          std::atomic<T> item;
+          std::atomic<K> key;
+          std::atomic<Stored> item;
           std::atomic<bool> validStart;
           std::atomic<bool> validEnd;
           std::atomic<bool> deleted;
@@ -30,8 +39,8 @@ class SOFTDurableSet {
           int durableAddressPostfix;     // Is the element index in the memPool
 
           PNode (void) {
-              this->key.store(0);
-              this->item.store((T) 0);
+              this->key.store(K());
+              this->item.store(Stored());
               this->validStart.store(false);
               this->validEnd.store(false);
               this->deleted.store(false);
@@ -39,49 +48,131 @@ class SOFTDurableSet {
               this->durableAddressPostfix = -1;
           }
 
-          void FLUSH(SOFTMemoryManager<T>* mem) {
-              mem->FLUSH(this->key.load(),  // This call is always the same for a given node
-                         this->item.load(),
-                         this->validStart.load(),
-                         this->validEnd.load(),
-                         this->deleted.load(),
-                         this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+          // The cell gets a copy, a copy taken before a destroy may land after the destroy's own,
+          // so it is written again until deleted did not change meanwhile
+          void FLUSH(Memory* mem, int id) {
+              bool deleted;
+              do {
+                  deleted = this->deleted.load();
+                  mem->FLUSH(this->key.load(),  // This call is always the same for a given node
+                             this->item.load(),
+                             {this->validStart.load(),
+                              this->validEnd.load(),
+                              deleted},
+                             this->durableAddressPrefix,
+                             this->durableAddressPostfix,
+                             id);
+              } while (deleted != this->deleted.load());
           }
 
-          void create(long key, T item, SOFTMemoryManager<T>* mem) {
+          void create(K key, Stored item, Memory* mem, int id) {
               this->validStart.store(true, std::memory_order_relaxed);
               std::atomic_thread_fence(std::memory_order_release);
               this->key.store(key, std::memory_order_relaxed);
               this->item.store(item, std::memory_order_relaxed);
               this->validEnd.store(true, std::memory_order_release);
-              this->FLUSH(mem);
+              this->FLUSH(mem, id);
           }
 
-          void destroy(SOFTMemoryManager<T>* mem) {
+          void destroy(Memory* mem, int id) {
               this->deleted.store(true, std::memory_order_release);
-              this->FLUSH(mem);
+              this->FLUSH(mem, id);
           }
 
-      }; // aligned(cache line size);
+      };
 
-      struct Node {
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
 
-          long key;
-          T item;
+          K key;
+          Stored item;
           PNode* PNodePointer;      // bool validity of pnodes is true
           std::atomic<Node*> next;  // Marked for logical delete
+          Node* nextFree;           // Link in a free list once reclaimed
 
           // Constructor
           Node(void) {
-              this->key = 0;
-              this->item = (T) 0;
+              this->key = K();
+              this->item = Stored();
               this->PNodePointer = new PNode();  // Each Node has an associated pNode
               this->next.store(nullptr);
+              this->nextFree = nullptr;
           }
 
       };
 
+      struct ThreadContext;  // Handle of a registered thread (see registerThread)
+
+      // Ascending iterator over the keys in [lo, hi]
+      // Holds an epoch of thread id until it is destroyed, thread id may not use the set meanwhile
+      // Weakly consistent: every key comes once and in order, a key present for the whole
+      // iteration is always reached, a key reached was present (and durable) during the iteration
+      class Iterator {
+
+        private:
+
+            SOFTDurableSet* set;
+            Node* current;  // A reference, nullptr once past hi
+            K hi;
+            int id;
+
+            // Moves current to the first present node from node on
+            // Present as in contains (INSERTED or INTEND_TO_DELETE), nothing is flushed
+            void settle(Node* node) {
+                long traversed = 0;
+                while (node != this->set->tailOne && !before(this->hi, node->key)) {
+                    int state = this->set->getState(node->next.load());
+                    if (state == this->set->INSERTED || state == this->set->INTEND_TO_DELETE) break;
+                    node = this->set->getRef(node->next.load());
+                    traversed += 1;
+                }
+                this->set->stats.add(this->id, NODES_TRAVERSED, traversed);
+                this->current = (node != this->set->tailOne && !before(this->hi, node->key)) ? node : nullptr;
+            }
+
+        public:
+
+            // Constructor
+            Iterator(SOFTDurableSet* set, K lo, K hi, int id) {
+                this->set = set;
+                this->hi = hi;
+                this->id = id;
+                this->set->enterEpoch(id);
+                Node* node = this->set->getRef(this->set->head->next.load());
+                long traversed = 0;
+                while (node != this->set->tailOne && before(node->key, lo)) {
+                    node = this->set->getRef(node->next.load());
+                    traversed += 1;
+                }
+                this->set->stats.add(id, NODES_TRAVERSED, traversed);
+                this->settle(node);
+            }
+
+            Iterator(const Iterator&) = delete;
+            Iterator& operator=(const Iterator&) = delete;
+
+            // Destructor
+            ~Iterator(void) {
+                this->set->exitEpoch(this->id);
+            }
+
+            bool valid(void) {
+                return this->current != nullptr;
+            }
+
+            K key(void) {
+                return this->current->key;
+            }
+
+            T item(void) {
+                return this->set->values.load(this->current->item);
+            }
+
+            void next(void) {
+                this->settle(this->set->getRef(this->current->next.load()));
+            }
+
+      };
+
   private:
 
       Node* head;
@@ -92,37 +183,133 @@ class SOFTDurableSet {
       int INTEND_TO_DELETE = 2;
       int DELETED = 3;
 
+      // Reclaimed nodes (with their pNode) waiting to be reused
+      // local is only touched by its thread, others push onto remote
+      struct alignas(CACHE_LINE_SIZE) FreeList {
+          Node* local;
+          std::atomic<Node*> remote;
+      };
+      EpochManager<Node>* epochs;
+      std::vector<FreeList> freeLists;
+      std::vector<ThreadContext> contexts;  // One per id, handed out by registerThread
+      std::atomic<int> registered;          // Ids handed out so far
+
       // These are for the simulation only
-      SOFTMemoryManager<T>* mem;
+      Memory* mem;
+      Value values;              // Stores and loads the items
       std::atomic<bool>* abortFlag;
-      std::vector<std::vector<Node*>> preAllocatedNodes;
-      std::vector<int> allocIndices;  // Points current free node for insert
-      std::vector<int> maxIndices;
-      std::vector<long> keysVolatileRecovered;
-      std::vector<long> keysDurableRecovered;
+      DurableStore<Node, Memory, SOFTCells, K> store;  // Node pool, allocation and recovery
+      OperationStats stats;      // Per thread CAS failures, restarts and nodes traversed
+      int trimMode;              // TRIM_INLINE or TRIM_DEFERRED
+      int searchMode;            // SEARCH_FROM_HEAD or SEARCH_FROM_FINGER
+      long maxBacklog;           // Removed nodes left linked before removes trim inline (TRIM_DEFERRED)
+      alignas(CACHE_LINE_SIZE) std::atomic<long> backlog;  // Removed nodes still linked (TRIM_DEFERRED)
       int numIDs;
 
-      // Gets memory address from permanent storage and ties it with prealloc node
-      Node* allocFromArea(long key, T item, int id) {
-          Node* newNode = this->preAllocatedNodes.at(id).at(this->allocIndices.at(id));
-          // Retrieve durable address
-          int durAddr = this->mem->retrieveAddress(id);
-          if (durAddr == -1) {
-              return nullptr;
+      // Keys are equal when neither is before the other
+      static bool before(const K& a, const K& b) {
+          return Compare()(a, b);
+      }
+
+      static bool same(const K& a, const K& b) {
+          return !Compare()(a, b) && !Compare()(b, a);
+      }
+
+      // Gives a reclaimed node back to the thread that owns its durable cell
+      void reclaim(Node* node, int id) {
+          FreeList& freeList = this->freeLists.at(node->PNodePointer->durableAddressPrefix);
+          if (node->PNodePointer->durableAddressPrefix == id) {
+              node->nextFree = freeList.local;
+              freeList.local = node;
+              return;
+          }
+          Node* top = freeList.remote.load();
+          do {
+              node->nextFree = top;
+          } while (!freeList.remote.compare_exchange_weak(top, node));
+      }
+
+      // Every operation runs inside of an epoch
+      void enterEpoch(int id) {
+          this->epochs->enter(id, [this, id](Node* node) { this->reclaim(node, id); });
+      }
+
+      void exitEpoch(int id) {
+          this->epochs->exit(id);
+      }
+
+      // Called by the thread whose CAS unlinked node
+      void retire(Node* node, int id) {
+          this->epochs->retire(id, node, [this, id](Node* node) { this->reclaim(node, id); });
+      }
+
+      // Gets memory address from permanent storage and ties it with a pool node
+      // Reclaimed nodes are reused first, their pNode keeps its durable cell
+      Node* allocFromArea(K key, T item, ThreadContext* context) {
+          int id = context->id;
+          FreeList& freeList = *context->freeList;
+          if (freeList.local == nullptr)  // Take what other threads have reclaimed
+              freeList.local = freeList.remote.exchange(nullptr);
+          if (freeList.local != nullptr) {
+              Node* reusedNode = freeList.local;
+              reusedNode->PNodePointer->validStart.store(false, std::memory_order_relaxed);
+              reusedNode->PNodePointer->validEnd.store(false, std::memory_order_relaxed);
+              reusedNode->PNodePointer->deleted.store(false, std::memory_order_relaxed);
+              reusedNode->key = key;
+              reusedNode->item = this->values.store(item, reusedNode->PNodePointer->durableAddressPrefix,
+                                                    reusedNode->PNodePointer->durableAddressPostfix);
+              if (this->values.failed(reusedNode->item)) return nullptr;  // Stays on the free list
+              return reusedNode;
           }
-          // Set the durableAddress(Pre/Post)fix
-          newNode->PNodePointer->durableAddressPrefix = id;
-          newNode->PNodePointer->durableAddressPostfix = durAddr;
+          Node* newNode = this->store.allocate(context->pool, context->section, id);
+          if (newNode == nullptr) return nullptr;
           // Set the newNode
           newNode->key = key;
-          newNode->item = item;
+          newNode->item = this->values.store(item, id, newNode->PNodePointer->durableAddressPostfix);
+          if (this->values.failed(newNode->item)) return nullptr;  // The node is not taken
           return newNode;
       }
 
       // Insertion was successful move the indices
-      void updateAlloc(int id) {
-          this->allocIndices.at(id) -= 1;
-          this->mem->updateAddress(id);
+      void updateAlloc(ThreadContext* context) {
+          FreeList& freeList = *context->freeList;
+          if (freeList.local != nullptr) {  // allocFromArea handed out the reused node
+              freeList.local = freeList.local->nextFree;
+              return;
+          }
+          this->store.commit(context->pool, context->section);
+      }
+
+      // Points every context at the pool, section and free list of its id
+      // Called again once recover() rebuilt the node pool
+      void bindContexts(void) {
+          for (int i = 0; i < this->numIDs; i++) {
+              ThreadContext& context = this->contexts.at(i);
+              context.id = i;
+              context.pool = this->store.nodePool->pool(i);
+              context.section = this->mem->section(i);
+              context.freeList = &this->freeLists.at(i);
+              context.finger = nullptr;
+          }
+      }
+
+      // Where an operation of context starts (SEARCH_FROM_FINGER): its finger, unless the global
+      // epoch moved past the one leaveFinger read. Once it did, a retire of the node labelled with
+      // that epoch may be reclaimed while this thread is announced in the next one
+      // Called inside of an epoch, which keeps a node that passes protected from then on
+      Node* startOf(ThreadContext* context) {
+          if (this->searchMode != SEARCH_FROM_FINGER || context->finger == nullptr) return this->head;
+          if (this->epochs->getEpoch() != context->fingerEpoch) return this->head;
+          return context->finger;
+      }
+
+      // Leaves node (a reference reached inside of this epoch) as the finger of context
+      // The epoch is read before node is seen not DELETED, so a retire of node comes later and is
+      // labelled with that epoch or a later one
+      void leaveFinger(ThreadContext* context, Node* node) {
+          if (this->searchMode != SEARCH_FROM_FINGER) return;
+          context->fingerEpoch = this->epochs->getEpoch();
+          context->finger = (this->getState(node->next.load()) == this->DELETED) ? nullptr : node;
       }
 
       Node* createRef(Node* node, int state) {
@@ -146,103 +333,128 @@ class SOFTDurableSet {
       }
 
       // Takes two nodes and removes current
-      bool trim(Node* previous, Node* current) {
+      // The thread that unlinks current retires it
+      // A DELETED previous may already be unlinked, current is trimmed from its live predecessor
+      bool trim(Node* previous, Node* current, int id) {
           int previousState = this->getState(current);
+          if (previousState == this->DELETED) return false;
           Node* previousReference = this->getRef(previous);
           Node* currentReference = this->getRef(current);
           Node* successor = currentReference->next.load();
           Node* successorReference = this->getRef(successor);
-          return previousReference->next.compare_exchange_strong(current, this->createRef(successorReference, previousState));
+          if (!previousReference->next.compare_exchange_strong(current, this->createRef(successorReference, previousState))) {
+              this->stats.add(id, TRIM_CAS_FAILURES);
+              return false;
+          }
+          this->retire(currentReference, id);
+          this->stats.add(id, NODES_TRIMMED);
+          if (this->trimMode == TRIM_DEFERRED) this->backlog.fetch_sub(1);
+          return true;
+      }
+
+      // Unlinks the run of DELETED nodes from first up to stop with one CAS (TRIM_DEFERRED)
+      // first is previous->next as it was read, so its state is the one of previous
+      // DELETED nodes never change their next so the run stays put
+      // The thread that unlinks the run retires it, returns the number of nodes unlinked
+      long trimRun(Node* previous, Node* first, Node* stop, int id) {
+          int previousState = this->getState(first);
+          if (previousState == this->DELETED) return 0;
+          Node* previousReference = this->getRef(previous);
+          Node* expected = first;
+          if (!previousReference->next.compare_exchange_strong(expected, this->createRef(stop, previousState))) {
+              this->stats.add(id, TRIM_CAS_FAILURES);
+              return 0;
+          }
+          long count = 0;
+          for (Node* node = this->getRef(first); node != stop; count++) {
+              Node* next = this->getRef(node->next.load());
+              this->retire(node, id);
+              node = next;
+          }
+          this->stats.add(id, NODES_TRIMMED, count);
+          this->backlog.fetch_sub(count);
+          return count;
       }
 
       // Common function to traverse the linked list
       // Trims logically deleted nodes that have yet to be removed
-      Node* find(Node** curr, long key, int* currentStatePtr) {
-          Node* previous = this->head;
+      // (TRIM_DEFERRED only the run right in front of the node found, the others are left to trimBacklog)
+      // Starts from start (a reference) if it is not DELETED and before key, otherwise from the head
+      // A restart goes back to where the search started while that node is not DELETED
+      // start must be protected by the callers epoch
+      Node* find(Node** curr, K key, int* currentStatePtr, int id, Node* start) {
+          Node* previous = start;
+          if (this->getState(start->next.load()) == this->DELETED || !before(start->key, key)) previous = this->head;
+          Node* entry = previous;
           Node* previousReference = this->getRef(previous);
           Node* current = previousReference->next.load();
           Node* currentReference = this->getRef(current);
-          int previousState = this->getState(current);
           Node* successor = nullptr;
           Node* successorReference = nullptr;
           int currentState = 0;
+          Node* run = nullptr;  // previous->next once a DELETED node behind previous is crossed (TRIM_DEFERRED)
+          long traversed = 0;
           while (true) {
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return nullptr;
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
 
+              if (this->getState(current) == this->DELETED) {  // previous was deleted, restart
+                  this->stats.add(id, FIND_RESTARTS);
+                  previous = (this->getState(entry->next.load()) == this->DELETED) ? this->head : entry;
+                  previousReference = this->getRef(previous);
+                  current = previousReference->next.load();
+                  currentReference = this->getRef(current);
+                  run = nullptr;
+                  continue;
+              }
               successor = currentReference->next.load();
               successorReference = this->getRef(successor);
               currentState = this->getState(successor);
               if (currentState != this->DELETED) {
-                  if (currentReference->key >= key) {
-                      break;
+                  if (!before(currentReference->key, key)) {
+                      if (run == nullptr) break;
+                      if (this->trimRun(previous, run, currentReference, id) > 0) {
+                          current = this->createRef(currentReference, this->getState(run));
+                          break;
+                      }
+                      run = nullptr;  // The run moved, restart
+                      this->stats.add(id, FIND_RESTARTS);
+                      previous = (this->getState(entry->next.load()) == this->DELETED) ? this->head : entry;
+                      previousReference = this->getRef(previous);
+                      current = previousReference->next.load();
+                      currentReference = this->getRef(current);
+                      continue;
                   }
                   // Move current forward
-                  previous = current;
+                  previous = currentReference;
                   previousReference = currentReference;
-                  previousState = currentState;
                   current = previousReference->next.load();;
                   currentReference = this->getRef(current);
+                  run = nullptr;
+                  traversed += 1;
               }
-              else {
-                  this->trim(previous, current);
+              else if (this->trimMode == TRIM_INLINE) {
+                  this->trim(previous, current, id);
                   current = previousReference->next.load();
                   currentReference = this->getRef(current);
               }
+              else {  // Crossed, left to trimBacklog
+                  if (run == nullptr) run = current;
+                  currentReference = successorReference;
+                  traversed += 1;
+              }
           }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           *currentStatePtr = currentState;
           *curr = current;
           return previous;
       }
 
-  public:
-
-      // Constructor
-      // Will not be called concurrently
-      SOFTDurableSet(SOFTMemoryManager<T>* mem, std::atomic<bool>* abortFlag, int numIDs, std::vector<int>* writeOpsVector) {
-          this->allocIndices = std::vector<int>(numIDs);
-          this->maxIndices = std::vector<int>(numIDs);
-          this->preAllocatedNodes = std::vector<std::vector<Node*>>(numIDs);
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i);
-          }
-          for (int i = 0; i < numIDs; i++) {
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(writeOpsVector->at(i));
-              for (int j = 0; j < writeOpsVector->at(i); j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
-              }
-          }
-          this->numIDs = numIDs;
-          this->head = new Node();
-          this->tailOne = new Node();
-          this->tailTwo = new Node();
-          this->head->key = MIN_KEY;     // Make sure keys are not less than
-          this->tailOne->key = MAX_KEY;  // Make sure keys are not greater than
-          this->tailTwo->key = MAX_KEY+1;  // Make sure keys are not greater than
-
-          this->tailOne->next.store(this->createRef(this->tailTwo, this->INSERTED));
-          this->head->next.store(this->createRef(this->tailOne, this->INSERTED));
-          this->abortFlag = abortFlag;
-          this->mem = mem;
-          this->keysVolatileRecovered = std::vector<long>();
-          this->keysDurableRecovered = std::vector<long>();
-      }
-
-      // Free the durable sets preallocated nodes
-      void FREE() {
-          delete this->head;
-          delete this->tailOne;
-          delete this->tailTwo;
-          for (int i = 0; i < this->numIDs; i++) {
-              for (int j = 0; j < this->maxIndices.at(i); j++) {
-                  delete this->preAllocatedNodes.at(i).at(j);
-              }
-          }
-      }
-
-      // Inserts a key at a designated spot in the list
-      bool insert(long key, T item, int id) {
+      // Inserts a key at a designated spot in the list, searching from start (see find)
+      // *last is left on a node before any greater key, a batch resumes from it
+      // Called inside of an epoch
+      bool insertFrom(Node* start, K key, T item, ThreadContext* context, Node** last) {
+          int id = context->id;
           Node* previous = nullptr;
           Node* previousReference = nullptr;
           Node* current = nullptr;
@@ -252,157 +464,432 @@ class SOFTDurableSet {
           int currentState;
           bool result = false;
           while (true) {
-              previous = this->find(&current, key, &currentState);
+              previous = this->find(&current, key, &currentState, id, start);
               previousReference = this->getRef(previous);
               currentReference = this->getRef(current);
               previousState = this->getState(current);
+              *last = previousReference;
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return false;
+              CRASH_POINT(this->abortFlag, false);
 
-              if (currentReference->key == key) {
-                  if (currentState != this->INTEND_TO_INSERT)
+              if (same(currentReference->key, key)) {
+                  if (currentState != this->INTEND_TO_INSERT) {
+                      *last = currentReference;
                       return false;
+                  }
                   resultNode = currentReference;
                   break;
               }
               else {
-                  Node* newNode = this->allocFromArea(key, item, id);
-                  if (newNode == nullptr) return false; // No memory available
+                  Node* newNode = this->allocFromArea(key, item, context);
+                  if (newNode == nullptr) {
+                      *last = previousReference;
+                      return false; // No memory available
+                  }
                   newNode->next.store(this->createRef(currentReference, this->INTEND_TO_INSERT), std::memory_order_relaxed);
-                  if (!previousReference->next.compare_exchange_strong(current, this->createRef(newNode, previousState)))
+                  if (!previousReference->next.compare_exchange_strong(current, this->createRef(newNode, previousState))) {
+                      this->stats.add(id, INSERT_CAS_FAILURES);
+                      start = previousReference;  // The retry searches on from previous, find falls back to the head once it is DELETED
                       continue;
+                  }
                   resultNode = newNode;
-                  this->updateAlloc(id);
+                  this->updateAlloc(context);
                   result = true;
                   break;
               }
           }
           // resultNode will always be a valid reference
-          resultNode->PNodePointer->create(resultNode->key, resultNode->item, this->mem);
+          resultNode->PNodePointer->create(resultNode->key, resultNode->item, this->mem, id);
           while (this->getState(resultNode->next.load()) == this->INTEND_TO_INSERT)
               this->stateCAS(resultNode, this->INTEND_TO_INSERT, this->INSERTED);
+          *last = resultNode;
           return result;
       }
 
-      // Searched for key
-      // Doesn't help with trimming logically deleted nodes or flushing
-      bool contains(long key) {
-
-          Node* currentReference = this->getRef(this->head->next.load());
-          int currentState = 0;
-          while (currentReference->key < key)
-              currentReference = this->getRef(currentReference->next.load());
-
-          currentState = this->getState(currentReference->next.load());
-          if (currentReference->key != key) return false;
-
-          // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return false;
-
-          if (currentState == this->DELETED || currentState == this->INTEND_TO_INSERT) {
-              return false;
-          }
-          return true;
-
-      }
-
-      // Loops until node with key is removed
-      bool remove(long key) {
+      // Loops until node with key is removed, searching from start (see find)
+      // *last is left on a node before any greater key, a batch resumes from it
+      // Called inside of an epoch
+      bool removeFrom(Node* start, K key, int id, Node** last) {
           Node* previous = nullptr;
-          Node* previousReference = nullptr;
           Node* current = nullptr;
           Node* currentReference = nullptr;
-          int previousState;
           int currentState;
           bool result = false;
 
-          previous = this->find(&current, key, &currentState);
+          previous = this->find(&current, key, &currentState, id, start);
           currentReference = this->getRef(current);
+          *last = this->getRef(previous);
 
-          if (currentReference->key != key) return false;
-          if (currentState == this->INTEND_TO_INSERT) return false;
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (!same(currentReference->key, key) || currentState == this->INTEND_TO_INSERT) return false;
 
           // Makes INTEND_TO_DELETE result becomes true
           while (!result && this->getState(currentReference->next.load()) == this->INSERTED) {
               result = this->stateCAS(currentReference, this->INSERTED, this->INTEND_TO_DELETE);
+              if (!result) this->stats.add(id, REMOVE_CAS_FAILURES);
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return true;
+              CRASH_POINT(this->abortFlag, result);  // Only a won CAS removed key
           }
 
           // Help flush and then flip the state to deleted
-          currentReference->PNodePointer->destroy(this->mem);
+          currentReference->PNodePointer->destroy(this->mem, id);
           while (this->getState(currentReference->next.load()) == this->INTEND_TO_DELETE)
              this->stateCAS(currentReference, this->INTEND_TO_DELETE, this->DELETED);
 
-          if (result) this->trim(previous, current);
+          // TRIM_DEFERRED leaves the node linked (its delete is durable already), unless the backlog is full
+          if (result && (this->trimMode == TRIM_INLINE || this->backlog.fetch_add(1) >= this->maxBacklog))
+              this->trim(previous, current, id);
           return result;
       }
 
-      // Deletes all of the nodes
-      // Reads and resets memory
-      // Re-adds the valid nodes read from memory
-      // Will not be called concurrently
-      void recover(std::vector<int>* writeOpsVector) {
-
-          // Read Memory Manager
-          std::vector<long>* keys = new std::vector<long>();
-          std::vector<T>* items = new std::vector<T>();
-          std::vector<int>* durableAddressPrefixes = new std::vector<int>();
-          std::vector<int>* activeNodes = new std::vector<int>(this->numIDs);
-          for (int i = 0; i < this->numIDs; i++) activeNodes->at(i) = 0;
-          int numActiveNodes = this->mem.recoverMemory(keys, items, durableAddressPrefixes, activeNodes);
-
-          // Record volatile memory (For testing only)
-          this->keysVolatileRecovered = std::vector<long>();
-          Node* current = this->head->next.load();
-          while (current->next.load() != nullptr) {  // Only tail->next == nullptr
-              if (!current->isNextMarked())
-                  this->keysVolatileRecovered.push_back(current->key);
-              current = current->getNextRef();
-          }
+      // Deletes all of the nodes and links the nodes of cells (numActiveNodes, in key order) in one pass
+      // Used by recover and restore
+      void rebuild(std::vector<typename Memory::RecoveredCell>& cells, int numActiveNodes) {
+          Node* previous = nullptr;  // Last node linked
+          this->store.rebuild(cells, numActiveNodes,
+              // Element is in the set if its state is INSERTED or INTEND_TO_DELETE
+              [this](std::vector<K>* keys) {
+                  Node* currentReference = this->getRef(this->head->next.load());
+                  while (currentReference != this->tailOne) {
+                      int currentState = this->getState(currentReference->next.load());
+                      if (currentState == this->INSERTED || currentState == this->INTEND_TO_DELETE)
+                          keys->push_back(currentReference->key);
+                      currentReference = this->getRef(currentReference->next.load());
+                  }
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->epochs = new EpochManager<Node>(this->numIDs);
+                  for (int i = 0; i < this->numIDs; i++) {
+                      this->freeLists.at(i).local = nullptr;
+                      this->freeLists.at(i).remote.store(nullptr);
+                  }
+                  this->head = new Node();
+                  this->tailOne = new Node();
+                  this->tailTwo = new Node();
+                  this->head->key = KeyTraits<K, Compare>::minKey();     // Make sure keys are not less than
+                  this->tailOne->key = KeyTraits<K, Compare>::maxKey();  // Make sure keys are not greater than
+                  this->tailTwo->key = KeyTraits<K, Compare>::maxKey();  // Never reached, tailOne stops every search
+                  this->tailOne->next.store(this->createRef(this->tailTwo, this->INSERTED));
+                  this->head->next.store(this->createRef(this->tailOne, this->INSERTED));
+                  this->backlog.store(0);
+                  previous = this->head;
+              },
+              [this, &previous](Node* node, const typename Memory::RecoveredCell&) {
+                  previous->next.store(this->createRef(node, this->INSERTED), std::memory_order_relaxed);
+                  previous = node;
+              });
+          previous->next.store(this->createRef(this->tailOne, this->INSERTED));
+          this->bindContexts();  // The node pool was rebuilt
+      }
 
-          // Record durable memory (For testing only)
-          this->keysDurableRecovered = std::vector<long>();
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->keysDurableRecovered.push_back(keys->at(i));
-          }
+  public:
 
-          // Rejuvenate all of the nodes
-          this->FREE();
+      // What the hot paths of a thread touch, so they skip the per id vectors
+      // Padded to its own cache line(s), only its thread writes it
+      struct alignas(CACHE_LINE_SIZE) ThreadContext {
+          int id;
+          typename NodePool<Node>::ThreadPool* pool;  // Where its nodes come from
+          typename Memory::Section* section;          // Where their durable cells come from
+          FreeList* freeList;                         // Its reclaimed nodes
+          Node* finger;                               // Where its last operation stopped (SEARCH_FROM_FINGER)
+          std::uint64_t fingerEpoch;                  // Global epoch read before finger was seen not DELETED
+      };
+
+      // Constructor
+      // values is only needed by policies with a state (i.e. the heap of HeapValue)
+      // Will not be called concurrently
+      SOFTDurableSet(Memory* mem, std::atomic<bool>* abortFlag, int numIDs, Value values = Value())
+          : store(mem, numIDs) {
+          this->numIDs = numIDs;
+          this->epochs = new EpochManager<Node>(numIDs);
+          this->stats = OperationStats(numIDs);
+          this->freeLists = std::vector<FreeList>(numIDs);
+          for (int i = 0; i < numIDs; i++) {
+              this->freeLists.at(i).local = nullptr;
+              this->freeLists.at(i).remote.store(nullptr);
+          }
           this->head = new Node();
           this->tailOne = new Node();
           this->tailTwo = new Node();
-          this->head->key = MIN_KEY;     // Make sure keys are not less than
-          this->tailOne->key = MAX_KEY;  // Make sure keys are not greater than
-          this->tailTwo->key = MAX_KEY;  // Make sure keys are not greater than
+          this->head->key = KeyTraits<K, Compare>::minKey();     // Make sure keys are not less than
+          this->tailOne->key = KeyTraits<K, Compare>::maxKey();  // Make sure keys are not greater than
+          this->tailTwo->key = KeyTraits<K, Compare>::maxKey();  // Never reached, tailOne stops every search
+
           this->tailOne->next.store(this->createRef(this->tailTwo, this->INSERTED));
           this->head->next.store(this->createRef(this->tailOne, this->INSERTED));
-          for (int i = 0; i < numIDs; i++) {
-              this->allocIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i) - 1;
-              this->maxIndices.at(i) = writeOpsVector->at(i) + activeNodes->at(i);
+          this->abortFlag = abortFlag;
+          this->mem = mem;
+          this->values = values;
+          this->trimMode = TRIM_INLINE;
+          this->searchMode = SEARCH_FROM_HEAD;
+          this->maxBacklog = DEFAULT_MAX_BACKLOG;
+          this->backlog.store(0);
+          this->contexts = std::vector<ThreadContext>(numIDs);
+          this->registered.store(0);
+          this->bindContexts();
+      }
+
+      // Hands out the context of the next free id, nullptr once all numIDs are taken
+      ThreadContext* registerThread(void) {
+          int id = this->registered.fetch_add(1);
+          if (id >= this->numIDs) return nullptr;
+          return &this->contexts[id];
+      }
+
+      // The context of a known id (i.e. a thread that was given its id up front)
+      ThreadContext* context(int id) {
+          return &this->contexts.at(id);
+      }
+
+      // Free the durable sets nodes
+      void FREE() {
+          delete this->head;
+          delete this->tailOne;
+          delete this->tailTwo;
+          delete this->epochs;
+          this->store.release();
+      }
+
+      // Inserts a key at a designated spot in the list
+      // Returns false if key was already present
+      bool insert(K key, T item, int id) {
+          return this->insert(key, item, &this->contexts[id]);
+      }
+
+      bool insert(K key, T item, ThreadContext* context) {
+          Node* last = nullptr;
+          this->enterEpoch(context->id);
+          bool result = this->insertFrom(this->startOf(context), key, item, context, &last);
+          this->leaveFinger(context, last);
+          this->exitEpoch(context->id);
+          return result;
+      }
+
+      // Inserts keys[i] with items[i] in one forward pass, keys sorted in increasing order
+      // Each key is found from where the previous one was left, O(n + k) instead of O(n * k)
+      // Every key is inserted (and linearized) on its own, the PNode FLUSHes are issued as one
+      // batch and are all persistent once it returns
+      // Returns the number of keys inserted
+      int insertBatch(const std::vector<K>& keys, const std::vector<T>& items, int id) {
+          return this->insertBatch(keys, items, &this->contexts[id]);
+      }
+
+      int insertBatch(const std::vector<K>& keys, const std::vector<T>& items, ThreadContext* context) {
+          int id = context->id;
+          int inserted = 0;
+          int numKeys = keys.size();
+          this->enterEpoch(id);
+          Node* last = this->startOf(context);
+          this->mem->beginBatch(id);
+          for (int i = 0; i < numKeys; i++) {
+              if (this->insertFrom(last, keys[i], items[i], context, &last)) inserted += 1;
           }
-          int numNodes = 0;
-          for (int i = 0; i < numIDs; i++) {
-              numNodes = writeOpsVector->at(i) + activeNodes->at(i);
-              this->preAllocatedNodes.at(i) = std::vector<Node*>(numNodes);
-              for (int j = 0; j < numNodes; j++) {
-                  this->preAllocatedNodes.at(i).at(j) = new Node();
+          this->mem->endBatch(id);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return inserted;
+      }
+
+      // TRIM_DEFERRED leaves unlinking removed nodes to trimBacklog
+      // Not run concurrently with the operations, what is left is trimmed first so the backlog starts empty
+      void setTrimMode(int mode) {
+          this->trimBacklog(0);
+          this->trimMode = mode;
+          this->backlog.store(0);
+      }
+
+      int getTrimMode(void) {
+          return this->trimMode;
+      }
+
+      // Once more than maxNodes removed nodes are left linked removes trim their own node again,
+      // which bounds the DELETED nodes a traversal crosses
+      // Not run concurrently with the operations
+      void setMaxBacklog(long maxNodes) {
+          this->maxBacklog = maxNodes;
+      }
+
+      // SEARCH_FROM_FINGER starts every operation of a thread context from the node its previous
+      // operation stopped at, unless that node was removed or lies past the key
+      // Not run concurrently with the operations
+      void setSearchMode(int mode) {
+          this->searchMode = mode;
+      }
+
+      int getSearchMode(void) {
+          return this->searchMode;
+      }
+
+      // Removed nodes still linked (TRIM_DEFERRED), a hint while operations run
+      long getBacklog(void) {
+          return this->backlog.load(std::memory_order_relaxed);
+      }
+
+      // One pass over the list that unlinks every run of DELETED nodes it crosses
+      // Run by any thread with id (i.e. a BackgroundTrimmer), holds one epoch for the whole pass
+      // Returns the number of nodes it unlinked
+      long trimBacklog(int id) {
+          long trimmed = 0;
+          this->enterEpoch(id);
+          Node* previous = this->head;
+          while (previous != this->tailOne) {
+              Node* current = previous->next.load();
+              Node* currentReference = this->getRef(current);
+              if (this->getState(currentReference->next.load()) != this->DELETED) {  // The tails never are
+                  previous = currentReference;
+                  continue;
               }
+              Node* stop = currentReference;
+              while (this->getState(stop->next.load()) == this->DELETED)
+                  stop = this->getRef(stop->next.load());
+              trimmed += this->trimRun(previous, current, stop, id);
+              previous = stop;
+          }
+          this->exitEpoch(id);
+          return trimmed;
+      }
+
+      // Searched for key
+      // Doesn't help with trimming logically deleted nodes or flushing
+      bool contains(K key, int id) {
+          return this->contains(key, &this->contexts[id]);
+      }
+
+      bool contains(K key, ThreadContext* context) {
+
+          int id = context->id;
+          this->enterEpoch(id);
+          Node* previous = this->startOf(context);
+          if (this->getState(previous->next.load()) == this->DELETED || !before(previous->key, key)) previous = this->head;
+          Node* currentReference = this->getRef(previous->next.load());
+          int currentState = 0;
+          long traversed = 0;
+          while (before(currentReference->key, key)) {
+              previous = currentReference;
+              currentReference = this->getRef(currentReference->next.load());
+              traversed += 1;
           }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
+          this->leaveFinger(context, previous);
 
-          // String the nodes together
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->insert(keys->at(i), items->at(i), durableAddressPrefixes->at(i));
+          currentState = this->getState(currentReference->next.load());
+          bool found = same(currentReference->key, key);
+          this->exitEpoch(id);
+          if (!found) return false;
+
+          // Abort Check (For abort testing only)
+          CRASH_POINT(this->abortFlag, false);
+
+          if (currentState == this->DELETED || currentState == this->INTEND_TO_INSERT) {
+              return false;
           }
+          return true;
 
-          delete keys;
-          delete items;
-          delete durableAddressPrefixes;
-          delete activeNodes;
+      }
+
+      // Removes key from the list
+      // Returns false if key was not present
+      bool remove(K key, int id) {
+          return this->remove(key, &this->contexts[id]);
+      }
+
+      bool remove(K key, ThreadContext* context) {
+          int id = context->id;
+          Node* last = nullptr;
+          this->enterEpoch(id);
+          bool result = this->removeFrom(this->startOf(context), key, id, &last);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return result;
+      }
 
-          return;
+      // Removes keys in one forward pass, keys sorted in increasing order
+      // Like insertBatch every key is removed on its own and the FLUSHes are issued as one batch
+      // Returns the number of keys removed
+      int removeBatch(const std::vector<K>& keys, int id) {
+          return this->removeBatch(keys, &this->contexts[id]);
+      }
+
+      int removeBatch(const std::vector<K>& keys, ThreadContext* context) {
+          int id = context->id;
+          int removed = 0;
+          int numKeys = keys.size();
+          this->enterEpoch(id);
+          Node* last = this->startOf(context);
+          this->mem->beginBatch(id);
+          for (int i = 0; i < numKeys; i++) {
+              if (this->removeFrom(last, keys.at(i), id, &last)) removed += 1;
+          }
+          this->mem->endBatch(id);
+          this->leaveFinger(context, last);
+          this->exitEpoch(id);
+          return removed;
+      }
+
+      // Calls callback(key, item) for the keys in [lo, hi] in increasing order
+      // Consistency as for Iterator, callback may not use the set as thread id
+      // Returns the number of keys visited
+      template <typename Callback>
+      long rangeScan(K lo, K hi, Callback callback, int id) {
+          long count = 0;
+          for (Iterator it(this, lo, hi, id); it.valid(); it.next()) {
+              callback(it.key(), it.item());
+              count += 1;
+          }
+          return count;
+      }
+
+      // Deletes all of the nodes
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass
+      // Will not be called concurrently
+      void recover(void) {
+
+          // Read Memory Manager, every section is scanned by its own thread
+          std::vector<typename Memory::RecoveredCell> cells;
+          int numActiveNodes = this->mem->recoverMemory(&cells);
+          this->rebuild(cells, numActiveNodes);
+      }
+
+      // Writes the set to path as a key ordered image of its durable cells while the operations go on
+      // Every linked node's cell is read once it began, later FLUSHes are logged by the memory
+      // manager (enableCheckpoints first), so the image and the log hold what is durable
+      // Holds one epoch of thread id for the whole pass, as trimBacklog
+      // Returns false if a checkpoint is under way or the image could not be written
+      bool checkpoint(const char* path, int id) {
+          std::uint32_t generation = this->mem->beginCheckpoint();
+          if (generation == 0) return false;
+          std::vector<typename Memory::RecoveredCell> cells;
+          this->enterEpoch(id);
+          for (Node* node = this->getRef(this->head->next.load()); node != this->tailOne; node = this->getRef(node->next.load())) {
+              typename Memory::RecoveredCell cell;
+              if (this->mem->readCell(node->PNodePointer->durableAddressPrefix, node->PNodePointer->durableAddressPostfix, &cell))
+                  cells.push_back(cell);
+          }
+          this->exitEpoch(id);
+          return this->mem->endCheckpoint(path, cells, generation);
+      }
+
+      // Same as recover from the image at path, only the cells FLUSHed since it was taken are read
+      // Scans the memory sections instead if there is no image (returns false then)
+      // Will not be called concurrently
+      bool restore(const char* path) {
+          std::vector<typename Memory::RecoveredCell> cells;
+          int numActiveNodes = this->mem->restoreMemory(path, &cells);
+          bool restored = numActiveNodes >= 0;
+          if (!restored) numActiveNodes = this->mem->recoverMemory(&cells);
+          this->rebuild(cells, numActiveNodes);
+          return restored;
+      }
+
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
       }
 
       // For testing (not run concurrentlly)
@@ -441,21 +928,15 @@ class SOFTDurableSet {
           std::cout << "Set size: " << count << std::endl;
       }
 
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<K>* volatileKeys, std::vector<K>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
       // For testing (not run concurrentlly) (For abort testing only)
       void printRecovery(void) {
-
-          // Print the keys recovered from volatile memory
-          std::cout << "Volatile Set keys" << std::endl;
-          int numVolatileRecovered = this->keysVolatileRecovered.size();
-          for (int i = 0; i < numVolatileRecovered; i++)
-              std::cout << "Key: " << this->keysVolatileRecovered.at(i) << std::endl;
-
-          // Print the keys recovered from durable memory
-          std::cout << "Durable Set keys" << std::endl;
-          int numDurableRecovered = this->keysDurableRecovered.size();
-          for (int i = 0; i < numDurableRecovered; i++)
-              std::cout << "Key: " << this->keysDurableRecovered.at(i) << std::endl;
-
+          this->store.printRecovery();
       }
 
 };
@@ -7,9 +7,10 @@
 #include <vector>
 #include <cstdint>
 #include "MemoryManager.h"
-
-long MIN_KEY = -100000;
-long MAX_KEY = 100000;
+#include "NodePool.h"
+#include "Stats.h"
+#include "DurableTypes.h"
+#include "DurablePolicy.h"
 
 template <typename T>
 class SequentialDurableSet {
@@ -18,7 +19,7 @@ class SequentialDurableSet {
 
       // Similar field to the node in MemoryManager
       // (except) durableAddress(Pre/Post)fix
-      struct Node {
+      struct alignas(DurableLayout<T>::ALIGNMENT) Node {
 
           long key;
           T item;
@@ -32,7 +33,7 @@ class SequentialDurableSet {
           // Constructor
           Node(void) {
               this->key = 0;
-              this->item = (T) 0;
+              this->item = T();
               this->validBits = 0;
               this->next = nullptr;
               this->durableAddressPrefix = -1;
@@ -52,30 +53,32 @@ class SequentialDurableSet {
           }
 
           // FLUSH
-          void FLUSH_INSERT(MemoryManager<T>* mem) {
+          void FLUSH_INSERT(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,   // insertValidFlag  // Memory Manager expects a bool
-                         false,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,   // insertValidFlag  // Memory Manager expects a bool
+                          false,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
           // FLUSH
-          void FLUSH_DELETE(MemoryManager<T>* mem) {
+          void FLUSH_DELETE(MemoryManager<T>* mem, int id) {
               mem->FLUSH(this->key,  // This call is always the same for a given node
                          this->item,
-                         this->validBits,
-                         true,  // insertValidFlag  // Memory Manager expects a bool
-                         true,  // deleteValidFlag  // Memory Manager expects a bool
-                         (std::uintptr_t) this->next,
+                         {this->validBits,
+                          true,  // insertValidFlag  // Memory Manager expects a bool
+                          true,  // deleteValidFlag  // Memory Manager expects a bool
+                          (std::uintptr_t) this->next},
                          this->durableAddressPrefix,
-                         this->durableAddressPostfix);
+                         this->durableAddressPostfix,
+                         id);
           }
 
-      }; // aligned(cache line size);
+      };
 
   private:
 
@@ -85,61 +88,38 @@ class SequentialDurableSet {
       // These are for the simulation only
       MemoryManager<T>* mem;
       std::atomic<bool>* abortFlag;
-      std::vector<Node*> preAllocatedNodes;
-      int allocIndices;  // Points current free node for insert
-      int maxIndices;
-      std::vector<long> keysVolatileRecovered;
-      std::vector<long> keysDurableRecovered;
+      DurableStore<Node, MemoryManager<T>, LockedCells> store;  // Node pool (growing chunks), allocation and recovery
+      OperationStats stats;      // Nodes traversed
       int sequential;  // Used by Memory Manager, only one thread
 
-      // Gets memory address from permanent storage and ties it with prealloc node
-      Node* allocFromArea(void) {
-          Node* newNode = this->preAllocatedNodes.at(this->allocIndices);
-          // Retrieve durable address
-          int durAddr = this->mem->retrieveAddress(this->sequential);
-          if (durAddr == -1) {
-              return nullptr;
-          }
-          // set the durableAddress(Pre/Post)fix
-          newNode->durableAddressPrefix = this->sequential;
-          newNode->durableAddressPostfix = durAddr;
-          return newNode;
-      }
-
-      // Insertion was successful move the indices
-      void updateAlloc(void) {
-          this->allocIndices -= 1;
-          this->mem->updateAddress(this->sequential);
-      }
-
       // Common function to traverse the linked list
-      Node* find(Node** curr, long key) {
+      Node* find(Node** curr, long key, int id) {
           Node* previous = this->head;
           Node* current = previous->next;
+          long traversed = 0;
           while (true) {
 
               // Abort Check (For abort testing only)
-              // if (this->abortFlag->load() == true) return nullptr;
+              CRASH_POINT(this->abortFlag, previous);  // Callers check again before using current
 
               if (current->key >= key) break;
               previous = current;
               current = current->next;
+              traversed += 1;
 
           }
+          this->stats.add(id, NODES_TRAVERSED, traversed);
           *curr = current;
           return previous;
       }
 
   public:
 
+      static const bool SINGLE_THREADED = true;  // Not thread safe, only ever run with one thread
+
       // Constructor
-      SequentialDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag, int maxWriteOps) {
-          this->allocIndices = maxWriteOps - 1;
-          this->maxIndices = maxWriteOps;
-          this->preAllocatedNodes = std::vector<Node*>(maxWriteOps);
-          for (int i = 0; i < maxWriteOps; i++) {
-              this->preAllocatedNodes.at(i) = new Node();
-          }
+      SequentialDurableSet(MemoryManager<T>* mem, std::atomic<bool>* abortFlag) : store(mem, 1) {
+          this->stats = OperationStats(1);
           this->sequential = 0;  // Used by Memory Manager, only one thread
           this->head = new Node();
           this->tail = new Node();
@@ -148,72 +128,73 @@ class SequentialDurableSet {
           this->tail->key = MAX_KEY;  // Make sure keys are not greater than
           this->abortFlag = abortFlag;
           this->mem = mem;
-          this->keysVolatileRecovered = std::vector<long>();
-          this->keysDurableRecovered = std::vector<long>();
       }
 
-      // Free the durable sets preallocated nodes
+      // Free the durable sets nodes
       void FREE() {
           delete this->head;
           delete this->tail;
-          for (int i = 0; i < this->maxIndices; i++) {
-              delete this->preAllocatedNodes.at(i);
-          }
+          this->store.release();
       }
 
       // Inserts a key at a designated spot in the list
       // Between previous and current
-      bool insert(long key, T item) {
+      // The id (last parameter) is ignored (only one thread), kept so every set has the same operations
+      bool insert(long key, T item, int) {
           Node *previous = nullptr;
           Node *current = nullptr;
 
-          previous = this->find(&current, key);
+          previous = this->find(&current, key, this->sequential);
 
           // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return false;
+          CRASH_POINT(this->abortFlag, false);
 
           // Already present
           if (current->key == key)
               return false;
 
           // Insert
-          Node* newNode = this->allocFromArea();
+          Node* newNode = this->store.allocate(this->sequential);
           if (newNode == nullptr) return false; // No memory available
           newNode->flipV1();
           newNode->key = key;
           newNode->item = item;
           newNode->next = current;
           previous->next = newNode;
-          this->updateAlloc();
+          this->store.commit(this->sequential);
           newNode->makeValid();
 
           // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return true;
+          CRASH_POINT(this->abortFlag, true);
 
-          newNode->FLUSH_INSERT(this->mem);
+          newNode->FLUSH_INSERT(this->mem, this->sequential);
           return true;
       }
 
       // Searched for key
-      bool contains(long key) {
+      bool contains(long key, int) {
           Node* current = this->head->next;
-          while (current->key < key)
+          long traversed = 0;
+          while (current->key < key) {
               current = current->next;
+              traversed += 1;
+          }
+          this->stats.add(this->sequential, NODES_TRAVERSED, traversed);
           if (current->key != key) return false;
           return true;
       }
 
       // Finds the node with the key then remove
       // Remove current between previous and successor
-      bool remove(long key) {
+      bool remove(long key, int) {
           Node* previous = nullptr;
           Node* current = nullptr;
           Node* successor = nullptr;
 
-          previous = find(&current, key);
+          previous = find(&current, key, this->sequential);
 
           // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return false;
+          CRASH_POINT(this->abortFlag, false);
 
           if (current->key != key) return false;
           successor = current->next;
@@ -221,63 +202,41 @@ class SequentialDurableSet {
           previous->next = successor;
 
           // Abort Check (For abort testing only)
-          // if (this->abortFlag->load() == true) return true;
+          CRASH_POINT(this->abortFlag, true);
 
-          current->FLUSH_DELETE(this->mem);
+          current->FLUSH_DELETE(this->mem, this->sequential);
           return true;
       }
 
       // Deletes all of the nodes
-      // Reads and resets memory
-      // Re-adds the valid nodes read from memory
-      void recover(int maxWriteOps) {
-
-          // Read Memory Manager
-          std::vector<long>* keys = new std::vector<long>();
-          std::vector<T>* items = new std::vector<T>();
-          std::vector<int>* durableAddressPrefixes = new std::vector<int>();  // Should all be 0 for each
-          std::vector<int>* activeNodes = new std::vector<int>(this->sequential);
-          for (int i = 0; i < this->sequential; i++) activeNodes->at(i) = 0;
-          int numActiveNodes = this->mem.recoverMemory(keys, items, durableAddressPrefixes, activeNodes);
-
-          // Record volatile memory (For testing only)
-          this->keysVolatileRecovered = std::vector<long>();
-          Node* current = this->head->next;
-          while (current->next != nullptr) {  // Only tail->next == nullptr
-              this->keysVolatileRecovered.push_back(current->key);
-              current = current->next;
-          }
-
-          // Record durable memory (For testing only)
-          this->keysDurableRecovered = std::vector<long>();
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->keysDurableRecovered.push_back(keys->at(i));
-          }
-
-          // Rejuvenate all of the nodes
-          this->FREE();
-          this->head = new Node();
-          this->tail = new Node();
-          this->head->next = this->tail;
-          this->head->key = MIN_KEY;  // Make sure keys are not less than
-          this->tail->key = MAX_KEY;  // Make sure keys are not greater than
-          this->allocIndices = maxWriteOps + activeNodes->at(this->sequential) - 1;
-          this->maxIndices = maxWriteOps + activeNodes->at(this->sequential);
-          this->preAllocatedNodes = std::vector<Node*>(this->maxIndices);
-          for (int i = 0; i < this->maxIndices; i++) {
-              this->preAllocatedNodes.at(i) = new Node();
-          }
-
-          // String the nodes together
-          for (int i = 0; i < numActiveNodes; i++) {
-              this->insert(keys->at(i), items->at(i), durableAddressPrefixes->at(i));
-          }
-
-          delete keys;
-          delete items;
-          delete durableAddressPrefixes;
-          delete activeNodes;
+      // Scans the memory sections in parallel, valid cells stay where they are
+      // Links the valid nodes in key order in one pass
+      void recover(void) {
+          Node* previous = nullptr;  // Last node linked
+          this->store.recover(
+              [this](std::vector<long>* keys) {
+                  for (Node* current = this->head->next; current->next != nullptr; current = current->next)  // Only tail->next == nullptr
+                      keys->push_back(current->key);
+              },
+              [this, &previous](void) {
+                  this->FREE();
+                  this->head = new Node();
+                  this->tail = new Node();
+                  this->head->next = this->tail;
+                  this->head->key = MIN_KEY;  // Make sure keys are not less than
+                  this->tail->key = MAX_KEY;  // Make sure keys are not greater than
+                  previous = this->head;
+              },
+              [&previous](Node* node, const typename MemoryManager<T>::RecoveredCell&) {
+                  previous->next = node;
+                  previous = node;
+              });
+          previous->next = this->tail;
+      }
 
+      // Read once the threads are done
+      OperationStats* getStats(void) {
+          return &this->stats;
       }
 
       // For testing
@@ -307,21 +266,15 @@ class SequentialDurableSet {
           std::cout << "Set size: " << count << std::endl;
       }
 
+      // Appends the keys the last recover found linked (volatile) and durable (For abort testing only)
+      // A crash loses the keys of the first that are not in the second
+      void recoveredKeys(std::vector<long>* volatileKeys, std::vector<long>* durableKeys) {
+          this->store.recoveredKeys(volatileKeys, durableKeys);
+      }
+
       // For testing (For abort testing only)
       void printRecovery(void) {
-
-          // Print the keys recovered from volatile memory
-          std::cout << "Volatile Set keys" << std::endl;
-          int numVolatileRecovered = this->keysVolatileRecovered.size();
-          for (int i = 0; i < numVolatileRecovered; i++)
-              std::cout << "Key: " << this->keysVolatileRecovered.at(i) << std::endl;
-
-          // Print the keys recovered from durable memory
-          std::cout << "Durable Set keys" << std::endl;
-          int numDurableRecovered = this->keysDurableRecovered.size();
-          for (int i = 0; i < numDurableRecovered; i++)
-              std::cout << "Key: " << this->keysDurableRecovered.at(i) << std::endl;
-
+          this->store.printRecovery();
       }
 
 };
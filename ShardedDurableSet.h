@@ -0,0 +1,311 @@
+#ifndef SHARDED_DURABLE_SET_H
+#define SHARDED_DURABLE_SET_H
+
+// Sharded Durable Set Class
+// numShards sets of type Set behind one front end, each over a memory manager of its own
+// (ShardedMemory), so no head, list or memPool is shared by all of the threads
+// SHARD_BY_RANGE gives every shard an equal slice of [lo, hi): a range query only asks the
+// shards it overlaps, in order. SHARD_BY_HASH spreads the keys (and any hot range) over all
+// of the shards: a range query asks every shard and merges what they found
+// Any set can be sharded (insert, remove, contains, recover), the batches and rangeScan need
+// a Set that has them (LinkFreeDurableSet, SOFTDurableSet)
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include "PersistentMemory.h"
+#include "NodePool.h"
+#include "Stats.h"
+
+enum ShardMode {
+    SHARD_BY_RANGE = 0,  // Shard i holds the i-th slice of [lo, hi)
+    SHARD_BY_HASH = 1    // A key's shard is a hash of it
+};
+
+static const int DEFAULT_SHARDS = 4;
+
+// One memory manager per shard, with the calls of a single one that the callers make on all of them
+template <typename Memory>
+class ShardedMemory {
+
+  private:
+
+      std::vector<Memory*> memories;
+      OperationStats totals;  // Summed up by getStats
+
+  public:
+
+      // Constructor, every shard simulates its memPool in DRAM
+      ShardedMemory(int numShards, int numIDs, long chunkSize = DEFAULT_CHUNK_SIZE) : totals(numIDs) {
+          for (int i = 0; i < numShards; i++)
+              this->memories.push_back(new Memory(numIDs, chunkSize));
+      }
+
+      // Shard i maps its memPool of numCells cells per id onto poolPath.i
+      ShardedMemory(int numShards, int numIDs, long numCells, const char* poolPath, bool clearPool = true)
+          : totals(numIDs) {
+          for (int i = 0; i < numShards; i++) {
+              std::string path = std::string(poolPath) + "." + std::to_string(i);
+              this->memories.push_back(new Memory(numIDs, numCells, path.c_str(), clearPool));
+          }
+      }
+
+      ShardedMemory(const ShardedMemory&) = delete;
+      ShardedMemory& operator=(const ShardedMemory&) = delete;
+
+      // Destructor
+      ~ShardedMemory(void) {
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              delete this->memories.at(i);
+      }
+
+      Memory* shard(int i) {
+          return this->memories.at(i);
+      }
+
+      int getNumShards(void) {
+          return this->memories.size();
+      }
+
+      // MAPPED_FILE only if every shard could map its file
+      int getBackend(void) {
+          for (int i = 0; i < (int) this->memories.size(); i++) {
+              if (this->memories.at(i)->getBackend() != MAPPED_FILE) return DRAM_SIMULATION;
+          }
+          return MAPPED_FILE;
+      }
+
+      // Not run concurrently with the operations
+      void setFlushMode(int mode, int groupSize = DEFAULT_GROUP_SIZE) {
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              this->memories.at(i)->setFlushMode(mode, groupSize);
+      }
+
+      // What thread id queued in any shard is durable once it returns (GROUP_COMMIT)
+      void sync(int id) {
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              this->memories.at(i)->sync(id);
+      }
+
+      void syncAll(void) {
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              this->memories.at(i)->syncAll();
+      }
+
+      // See Memory::tearUnsynced, returns the torn cells of every shard
+      long tearUnsynced(void) {
+          long torn = 0;
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              torn += this->memories.at(i)->tearUnsynced();
+          return torn;
+      }
+
+      // The counters of every thread summed over the shards, a snapshot (not run concurrently)
+      OperationStats* getStats(void) {
+          sumStats(&this->totals, this->memories);
+          return &this->totals;
+      }
+
+      // Zeroes the counters of every shard (not run concurrently)
+      void resetStats(void) {
+          for (int i = 0; i < (int) this->memories.size(); i++)
+              this->memories.at(i)->getStats()->reset();
+          this->totals.reset();
+      }
+
+      // Adds up the counters of parts (sets or memory managers) into totals
+      template <typename Part>
+      static void sumStats(OperationStats* totals, std::vector<Part*>& parts) {
+          totals->reset();
+          int numIDs = totals->getNumIDs();
+          for (int i = 0; i < (int) parts.size(); i++) {
+              OperationStats* stats = parts.at(i)->getStats();
+              for (int id = 0; id < numIDs && id < stats->getNumIDs(); id++) {
+                  for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                      totals->add(id, j, stats->get(id, j));
+              }
+          }
+      }
+
+};
+
+template <typename Set, typename Memory, typename T, typename K = long, typename Compare = std::less<K>>
+class ShardedDurableSet {
+
+  private:
+
+      std::vector<Set*> sets;
+      ShardedMemory<Memory>* memories;
+      OperationStats totals;  // Summed up by getStats
+      int numShards;
+      int mode;               // SHARD_BY_RANGE or SHARD_BY_HASH
+      K lo;                   // SHARD_BY_RANGE slices [lo, hi), keys outside go to the first or last shard
+      K width;                // Keys per slice
+
+      static bool before(const K& a, const K& b) {
+          return Compare()(a, b);
+      }
+
+      // Splits keys (and items) by shard, the order of the keys within a shard is kept
+      template <typename Item>
+      void split(const std::vector<K>& keys, const std::vector<Item>* items,
+                 std::vector<std::vector<K>>* shardKeys, std::vector<std::vector<Item>>* shardItems) {
+          shardKeys->assign(this->numShards, std::vector<K>());
+          shardItems->assign(this->numShards, std::vector<Item>());
+          for (int i = 0; i < (int) keys.size(); i++) {
+              int shard = this->shardOf(keys.at(i));
+              shardKeys->at(shard).push_back(keys.at(i));
+              if (items != nullptr) shardItems->at(shard).push_back(items->at(i));
+          }
+      }
+
+  public:
+
+      // Constructor, createSet(mem, i) builds the set of shard i over mem (memories->shard(i))
+      // lo and hi bound the slices of SHARD_BY_RANGE (integral keys), SHARD_BY_HASH ignores them
+      // Will not be called concurrently
+      template <typename Factory>
+      ShardedDurableSet(ShardedMemory<Memory>* memories, int mode, K lo, K hi, Factory createSet)
+          : totals(memories->shard(0)->getStats()->getNumIDs()) {
+          this->memories = memories;
+          this->numShards = memories->getNumShards();
+          this->mode = mode;
+          this->lo = lo;
+          this->width = (hi > lo) ? (hi - lo + this->numShards - 1) / this->numShards : 1;
+          if (this->width < 1) this->width = 1;
+          for (int i = 0; i < this->numShards; i++)
+              this->sets.push_back(createSet(memories->shard(i), i));
+      }
+
+      ShardedDurableSet(const ShardedDurableSet&) = delete;
+      ShardedDurableSet& operator=(const ShardedDurableSet&) = delete;
+
+      // The shard that holds key, callers that route keys to threads can keep a thread on one shard
+      int shardOf(const K& key) {
+          if (this->mode == SHARD_BY_HASH) {
+              std::uint64_t hash = ((std::uint64_t) std::hash<K>()(key)) * 0x9E3779B97F4A7C15ull;  // Fibonacci hashing
+              return (int) ((hash >> 32) % (std::uint64_t) this->numShards);
+          }
+          if (before(key, this->lo)) return 0;
+          K slice = (key - this->lo) / this->width;
+          return (slice < (K) this->numShards) ? (int) slice : this->numShards - 1;
+      }
+
+      Set* shard(int i) {
+          return this->sets.at(i);
+      }
+
+      int getNumShards(void) {
+          return this->numShards;
+      }
+
+      int getShardMode(void) {
+          return this->mode;
+      }
+
+      // Free every shard's nodes
+      void FREE() {
+          for (int i = 0; i < this->numShards; i++) {
+              this->sets.at(i)->FREE();
+              delete this->sets.at(i);
+          }
+          this->sets.clear();
+      }
+
+      // Thread id of the front end is thread id of every shard
+      bool insert(K key, T item, int id) {
+          return this->sets[this->shardOf(key)]->insert(key, item, id);
+      }
+
+      bool remove(K key, int id) {
+          return this->sets[this->shardOf(key)]->remove(key, id);
+      }
+
+      bool contains(K key, int id) {
+          return this->sets[this->shardOf(key)]->contains(key, id);
+      }
+
+      // One batch per shard, keys sorted in increasing order (see Set::insertBatch)
+      // Returns the number of keys inserted
+      int insertBatch(const std::vector<K>& keys, const std::vector<T>& items, int id) {
+          std::vector<std::vector<K>> shardKeys;
+          std::vector<std::vector<T>> shardItems;
+          this->split(keys, &items, &shardKeys, &shardItems);
+          int inserted = 0;
+          for (int i = 0; i < this->numShards; i++) {
+              if (!shardKeys.at(i).empty()) inserted += this->sets.at(i)->insertBatch(shardKeys.at(i), shardItems.at(i), id);
+          }
+          return inserted;
+      }
+
+      int removeBatch(const std::vector<K>& keys, int id) {
+          std::vector<std::vector<K>> shardKeys;
+          std::vector<std::vector<T>> unused;
+          this->split<T>(keys, nullptr, &shardKeys, &unused);
+          int removed = 0;
+          for (int i = 0; i < this->numShards; i++) {
+              if (!shardKeys.at(i).empty()) removed += this->sets.at(i)->removeBatch(shardKeys.at(i), id);
+          }
+          return removed;
+      }
+
+      // Calls callback(key, item) for the keys in [lo, hi] in increasing order
+      // SHARD_BY_RANGE scans the shards [lo, hi] overlaps one after the other, SHARD_BY_HASH
+      // gathers the keys of every shard and merges them. Consistency as for each Set::rangeScan
+      // Returns the number of keys visited
+      template <typename Callback>
+      long rangeScan(K lo, K hi, Callback callback, int id) {
+          long count = 0;
+          if (this->mode == SHARD_BY_RANGE) {
+              for (int i = this->shardOf(lo); i <= this->shardOf(hi); i++)
+                  count += this->sets.at(i)->rangeScan(lo, hi, callback, id);
+              return count;
+          }
+          std::vector<std::pair<K, T>> found;
+          for (int i = 0; i < this->numShards; i++)
+              this->sets.at(i)->rangeScan(lo, hi, [&found](const K& key, const T& item) { found.push_back(std::make_pair(key, item)); }, id);
+          std::sort(found.begin(), found.end(), [](const std::pair<K, T>& a, const std::pair<K, T>& b) { return before(a.first, b.first); });
+          for (int i = 0; i < (int) found.size(); i++) {
+              callback(found.at(i).first, found.at(i).second);
+              count += 1;
+          }
+          return count;
+      }
+
+      // Recovers every shard on a thread of its own (each shard also scans its sections in parallel)
+      // Will not be called concurrently
+      void recover(void) {
+          std::vector<std::thread> threads;
+          for (int i = 0; i < this->numShards; i++)
+              threads.push_back(std::thread(&Set::recover, this->sets.at(i)));
+          for (int i = 0; i < this->numShards; i++)
+              threads.at(i).join();
+      }
+
+      // Appends what the last recover of every shard found (see Set::recoveredKeys)
+      void recoveredKeys(std::vector<K>* volatileKeys, std::vector<K>* durableKeys) {
+          for (int i = 0; i < this->numShards; i++)
+              this->sets.at(i)->recoveredKeys(volatileKeys, durableKeys);
+      }
+
+      // The counters of every thread summed over the shards, a snapshot (not run concurrently)
+      OperationStats* getStats(void) {
+          ShardedMemory<Memory>::sumStats(&this->totals, this->sets);
+          return &this->totals;
+      }
+
+      // Zeroes the counters of every shard (not run concurrently)
+      void resetStats(void) {
+          for (int i = 0; i < this->numShards; i++)
+              this->sets.at(i)->getStats()->reset();
+          this->totals.reset();
+      }
+
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Operation Statistics
+// Per thread counters, each thread only writes its own (padded) counters so they
+// are plain increments, the totals are read once the threads are done
+// Define NO_OPERATION_STATS to compile every count away
+
+#include <vector>
+#include "PersistentMemory.h"
+
+enum StatCounter {
+    FLUSHES_ISSUED = 0,       // Cells written by the memory manager
+    FLUSHES_ELIDED = 1,       // FLUSH_INSERT/FLUSH_DELETE skipped, the valid flag was already set
+    PERSIST_SAMPLES = 2,      // Timed persists, a cell or a whole batch (MAPPED_FILE only)
+    PERSIST_NANOSECONDS = 3,  // Total time of the timed persists
+    INSERT_CAS_FAILURES = 4,
+    REMOVE_CAS_FAILURES = 5,
+    TRIM_CAS_FAILURES = 6,
+    FIND_RESTARTS = 7,        // Traversals started over from the head
+    NODES_TRAVERSED = 8,
+    FENCES_ISSUED = 9,        // One per SYNC_FLUSH, one per GROUP_COMMIT batch (MAPPED_FILE only)
+    NODES_TRIMMED = 10,       // Removed nodes unlinked
+    OPS_ELIMINATED = 11,      // Inserts and removes done through an offer, without a write to the list
+    ELISION_ABORTS = 12,      // Hardware transactions of ELISION_RTM that aborted
+    NUM_STAT_COUNTERS = 13
+};
+
+inline const char* statName(int counter) {
+    static const char* names[NUM_STAT_COUNTERS] = {
+        "flushesIssued", "flushesElided", "persistSamples", "persistNanoseconds",
+        "insertCASFailures", "removeCASFailures", "trimCASFailures", "findRestarts", "nodesTraversed",
+        "fencesIssued", "nodesTrimmed", "opsEliminated", "elisionAborts"
+    };
+    return names[counter];
+}
+
+class OperationStats {
+
+  private:
+
+      struct alignas(CACHE_LINE_SIZE) ThreadStats {
+          long counters[NUM_STAT_COUNTERS];
+      };
+
+      std::vector<ThreadStats> threads;
+
+  public:
+
+      // Constructor
+      OperationStats(int numIDs = 0) : threads(numIDs) {
+          this->reset();
+      }
+
+      // Only called by thread id
+      inline void add(int id, int counter, long amount = 1) {
+#ifndef NO_OPERATION_STATS
+          this->threads[id].counters[counter] += amount;
+#else
+          (void) id; (void) counter; (void) amount;
+#endif
+      }
+
+      // True once every `every` counts of counter by thread id (never without stats)
+      inline bool every(int id, int counter, long every) {
+#ifndef NO_OPERATION_STATS
+          return this->threads[id].counters[counter] % every == 0;
+#else
+          (void) id; (void) counter; (void) every;
+          return false;
+#endif
+      }
+
+      long get(int id, int counter) {
+          return this->threads.at(id).counters[counter];
+      }
+
+      long total(int counter) {
+          long sum = 0;
+          int numIDs = this->threads.size();
+          for (int i = 0; i < numIDs; i++)
+              sum += this->threads.at(i).counters[counter];
+          return sum;
+      }
+
+      // Not run concurrently
+      void reset(void) {
+          int numIDs = this->threads.size();
+          for (int i = 0; i < numIDs; i++) {
+              for (int j = 0; j < NUM_STAT_COUNTERS; j++)
+                  this->threads.at(i).counters[j] = 0;
+          }
+      }
+
+      int getNumIDs(void) {
+          return this->threads.size();
+      }
+
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRANSACTIONAL_MEMORY_H
+#define TRANSACTIONAL_MEMORY_H
+
+// Hardware Transactions (Intel RTM)
+// begin, end and abort are encoded by hand so no -mrtm is needed, whether they can be used is
+// read from cpuid once. Hosts without RTM, or whose microcode makes every transaction abort,
+// report it as unavailable and the callers take their locks as usual
+// A FLUSH can not run inside of a transaction, callers write back after it committed
+
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+static const int DEFAULT_ELISION_ATTEMPTS = 3;  // Transactions tried before the locks are taken
+
+class HardwareTransaction {
+
+  private:
+
+      static bool detectRTM(void) {
+#if defined(__x86_64__) || defined(__i386__)
+          unsigned int eax, ebx, ecx, edx;
+          if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+          return (ebx & (1u << 11)) && !(edx & (1u << 11));  // RTM, and not RTM_ALWAYS_ABORT
+#else
+          return false;
+#endif
+      }
+
+  public:
+
+      static const unsigned int STARTED = ~0u;          // begin() inside of the transaction
+      static const unsigned int ABORT_EXPLICIT = 1u << 0;  // abort() (a lock was held)
+      static const unsigned int ABORT_RETRY = 1u << 1;     // May commit if tried again
+      static const unsigned int ABORT_CONFLICT = 1u << 2;  // Another thread touched what it read or wrote
+
+      static bool available(void) {
+          static const bool rtm = detectRTM();
+          return rtm;
+      }
+
+      // Returns STARTED inside of the transaction, the abort status once it aborted
+      // Only called if available()
+      static inline unsigned int begin(void) {
+          unsigned int status = STARTED;
+#if defined(__x86_64__) || defined(__i386__)
+          asm volatile(".byte 0xc7, 0xf8; .long 0" : "+a" (status) : : "memory");  // xbegin to the next instruction
+#else
+          status = 0;
+#endif
+          return status;
+      }
+
+      // Commits the transaction
+      static inline void end(void) {
+#if defined(__x86_64__) || defined(__i386__)
+          asm volatile(".byte 0x0f, 0x01, 0xd5" : : : "memory");  // xend
+#endif
+      }
+
+      // Aborts the transaction, begin() then returns with ABORT_EXPLICIT set
+      static inline void abort(void) {
+#if defined(__x86_64__) || defined(__i386__)
+          asm volatile(".byte 0xc6, 0xf8, 0xff" : : : "memory");  // xabort 0xff
+#endif
+      }
+
+};
+
+#endif
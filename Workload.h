@@ -0,0 +1,250 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+// Workload Generators
+// Pre-generate one stream of operations per thread, so no random numbers are drawn while timing
+// UNIFORM       every key is as likely
+// ZIPFIAN       key ranks follow a Zipf law (theta), scattered over the range like YCSB's scrambled zipfian
+// HOTSPOT       hotOpPercent of the operations go to the first hotKeyPercent of the keys
+// LATEST        inserts take fresh keys, the rest favour the keys the thread inserted last
+// INSERT_BURST  every burstPeriod operations start with burstLength inserts
+// READ_ONLY     contains only (prefill the set)
+
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstdint>
+
+enum OperationType { INSERT_OP = 0, REMOVE_OP = 1, CONTAINS_OP = 2, NUM_OP_TYPES = 3 };
+
+struct Operation {
+    int type;
+    long key;
+};
+
+enum WorkloadKind { UNIFORM = 0, ZIPFIAN = 1, HOTSPOT = 2, LATEST = 3, INSERT_BURST = 4, READ_ONLY = 5 };
+
+struct WorkloadConfig {
+    int kind;
+    long keyRange;       // Keys are drawn from [0, keyRange)
+    int insertChance;    // Percent of inserts
+    int removeChance;    // Percent of removes, the rest are contains
+    double theta;        // ZIPFIAN and LATEST skew, in (0, 1)
+    int hotKeyPercent;   // HOTSPOT
+    int hotOpPercent;    // HOTSPOT
+    long burstLength;    // INSERT_BURST
+    long burstPeriod;    // INSERT_BURST
+    unsigned int seed;
+};
+
+inline WorkloadConfig defaultWorkload(void) {
+    WorkloadConfig workload;
+    workload.kind = UNIFORM;
+    workload.keyRange = 100;
+    workload.insertChance = 50;
+    workload.removeChance = 30;
+    workload.theta = 0.99;
+    workload.hotKeyPercent = 20;
+    workload.hotOpPercent = 80;
+    workload.burstLength = 1000;
+    workload.burstPeriod = 10000;
+    workload.seed = 1;
+    return workload;
+}
+
+// Returns the kind named by name, or -1
+inline int workloadKind(const std::string& name) {
+    if (name == "uniform") return UNIFORM;
+    if (name == "zipf") return ZIPFIAN;
+    if (name == "hotspot") return HOTSPOT;
+    if (name == "latest") return LATEST;
+    if (name == "burst") return INSERT_BURST;
+    if (name == "read-only") return READ_ONLY;
+    return -1;
+}
+
+inline const char* workloadName(int kind) {
+    static const char* names[] = { "uniform", "zipf", "hotspot", "latest", "burst", "read-only" };
+    return names[kind];
+}
+
+// YCSB core workloads A to D, updates are split between inserts and removes
+// Returns false if preset is not one of them
+inline bool ycsbPreset(const std::string& preset, WorkloadConfig* workload) {
+    if (preset == "A") {         // Update heavy
+        workload->kind = ZIPFIAN;
+        workload->insertChance = 25;
+        workload->removeChance = 25;
+    } else if (preset == "B") {  // Read mostly
+        workload->kind = ZIPFIAN;
+        workload->insertChance = 3;
+        workload->removeChance = 2;
+    } else if (preset == "C") {  // Read only
+        workload->kind = ZIPFIAN;
+        workload->insertChance = 0;
+        workload->removeChance = 0;
+    } else if (preset == "D") {  // Read latest
+        workload->kind = LATEST;
+        workload->insertChance = 5;
+        workload->removeChance = 0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Ranks in [0, items), rank r is drawn with a chance proportional to 1 / (r + 1)^theta
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases" (as in YCSB)
+class ZipfianGenerator {
+
+  private:
+
+      long items;
+      double theta;
+      double zetan;
+      double alpha;
+      double eta;
+
+      static double zeta(long n, double theta) {
+          double sum = 0;
+          for (long i = 1; i <= n; i++)
+              sum += 1.0 / std::pow((double) i, theta);
+          return sum;
+      }
+
+  public:
+
+      // Constructor
+      // O(items), build once and share between the threads
+      ZipfianGenerator(long items, double theta) {
+          this->items = (items > 0) ? items : 1;
+          this->theta = theta;
+          this->zetan = zeta(this->items, theta);
+          this->alpha = 1.0 / (1.0 - theta);
+          this->eta = (1.0 - std::pow(2.0 / this->items, 1.0 - theta)) / (1.0 - zeta(2, theta) / this->zetan);
+      }
+
+      template <typename Generator>
+      long next(Generator& generator) {
+          double u = std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+          double uz = u * this->zetan;
+          if (uz < 1.0) return 0;
+          if (uz < 1.0 + std::pow(0.5, this->theta)) return (this->items > 1) ? 1 : 0;
+          long rank = (long) (this->items * std::pow(this->eta * u - this->eta + 1.0, this->alpha));
+          return (rank < this->items) ? rank : this->items - 1;
+      }
+
+};
+
+class WorkloadGenerator {
+
+  private:
+
+      WorkloadConfig config;
+      int numThreads;
+      ZipfianGenerator* zipfian;  // ZIPFIAN and LATEST only
+
+      // FNV-1a, scatters the zipfian ranks over the key range
+      static long scramble(long rank, long keyRange) {
+          std::uint64_t hash = 0xCBF29CE484222325ull;
+          for (int i = 0; i < 8; i++) {
+              hash ^= (rank >> (8 * i)) & 0xFF;
+              hash *= 0x100000001B3ull;
+          }
+          return (long) (hash % (std::uint64_t) keyRange);
+      }
+
+      int drawType(std::mt19937_64& generator) {
+          int value = std::uniform_int_distribution<int>(0, 99)(generator);
+          if (value < this->config.insertChance) return INSERT_OP;
+          if (value < this->config.insertChance + this->config.removeChance) return REMOVE_OP;
+          return CONTAINS_OP;
+      }
+
+      long uniformKey(std::mt19937_64& generator, long low, long high) {
+          return std::uniform_int_distribution<long>(low, high - 1)(generator);
+      }
+
+      long hotspotKey(std::mt19937_64& generator) {
+          long range = this->config.keyRange;
+          long hotKeys = range * this->config.hotKeyPercent / 100;
+          if (hotKeys < 1) hotKeys = 1;
+          if (hotKeys >= range) return this->uniformKey(generator, 0, range);
+          if (std::uniform_int_distribution<int>(0, 99)(generator) < this->config.hotOpPercent)
+              return this->uniformKey(generator, 0, hotKeys);
+          return this->uniformKey(generator, hotKeys, range);
+      }
+
+      // Thread id inserts the keys id, id + numThreads, id + 2 * numThreads, ... (modulo keyRange)
+      // The other operations pick one of those, the later the more likely
+      void generateLatest(int id, std::mt19937_64& generator, std::vector<Operation>* stream) {
+          long range = this->config.keyRange;
+          long inserted = 0;
+          for (long i = 0; i < (long) stream->size(); i++) {
+              Operation& op = stream->at(i);
+              op.type = this->drawType(generator);
+              if (op.type == INSERT_OP) {
+                  op.key = (inserted * this->numThreads + id) % range;
+                  inserted += 1;
+              } else if (inserted == 0) {
+                  op.key = this->uniformKey(generator, 0, range);
+              } else {
+                  long back = this->zipfian->next(generator) % inserted;
+                  op.key = ((inserted - 1 - back) * this->numThreads + id) % range;
+              }
+          }
+      }
+
+  public:
+
+      // Constructor
+      WorkloadGenerator(const WorkloadConfig& config, int numThreads) {
+          this->config = config;
+          this->numThreads = numThreads;
+          if (this->config.kind == READ_ONLY) {
+              this->config.insertChance = 0;
+              this->config.removeChance = 0;
+          }
+          this->zipfian = nullptr;
+          if (this->config.kind == ZIPFIAN)
+              this->zipfian = new ZipfianGenerator(config.keyRange, config.theta);
+          else if (this->config.kind == LATEST)
+              this->zipfian = new ZipfianGenerator(config.keyRange / numThreads + 1, config.theta);
+      }
+
+      WorkloadGenerator(const WorkloadGenerator&) = delete;
+      WorkloadGenerator& operator=(const WorkloadGenerator&) = delete;
+
+      // Destructor
+      ~WorkloadGenerator(void) {
+          delete this->zipfian;
+      }
+
+      // Fills the stream of thread id, streams of different threads may be generated concurrently
+      void generate(int id, long numOps, std::vector<Operation>* stream) {
+          std::mt19937_64 generator(this->config.seed + id);
+          long range = this->config.keyRange;
+          stream->resize(numOps);
+          if (this->config.kind == LATEST) {
+              this->generateLatest(id, generator, stream);
+              return;
+          }
+          for (long i = 0; i < numOps; i++) {
+              Operation& op = stream->at(i);
+              if (this->config.kind == INSERT_BURST && i % this->config.burstPeriod < this->config.burstLength)
+                  op.type = INSERT_OP;
+              else
+                  op.type = this->drawType(generator);
+              if (this->config.kind == ZIPFIAN)
+                  op.key = scramble(this->zipfian->next(generator), range);
+              else if (this->config.kind == HOTSPOT)
+                  op.key = this->hotspotKey(generator);
+              else
+                  op.key = this->uniformKey(generator, 0, range);
+          }
+      }
+
+};
+
+#endif
@@ -8,6 +8,10 @@
 #define _BITSET_INCLUDED_
 
 #include <string.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #define WORD_INDEX(INDEX) ((INDEX) >> 5)
 #define BIT_INDEX(INDEX) ((INDEX) & 0x0000001f)
@@ -113,5 +117,146 @@ private:
     int* m_bits;
 };
 
+//------------------------------------------------------------------------------
+//
+//     StaticBitset
+//
+//     N bits in 64-bit words, padded to whole cache lines so the kernels never
+//     need a tail loop. operator& and operator bool use AVX-512 or AVX2 when the
+//     target has them (-mavx512f, -mavx2 or -march=native), 64-bit words otherwise
+//
+//------------------------------------------------------------------------------
+
+template<int N>
+class StaticBitset
+{
+public:
+    static const int SIZE = N;
+    static const int WORDS = ((N + 511) / 512) * 8;  // 64 byte lines
+
+    StaticBitset()
+    {
+        memset(m_bits, 0, sizeof(m_bits));
+    }
+
+    //Same interface as Bitset, size can not be more than N
+    inline void Resize(int size, int flag = 0)
+    {
+        (void) size;
+        memset(m_bits, flag, sizeof(m_bits));
+    }
+
+    inline void operator=(int flag)
+    {
+        memset(m_bits, flag, sizeof(m_bits));
+    }
+
+    inline operator bool () const
+    {
+#if defined(__AVX512F__)
+        for (int i = 0; i < WORDS; i += 8)
+        {
+            __m512i a = _mm512_load_si512((const void*) (m_bits + i));
+            if(_mm512_test_epi64_mask(a, a))
+            {
+                return true;
+            }
+        }
+#elif defined(__AVX2__)
+        for (int i = 0; i < WORDS; i += 4)
+        {
+            __m256i a = _mm256_load_si256((const __m256i*) (m_bits + i));
+            if(!_mm256_testz_si256(a, a))
+            {
+                return true;
+            }
+        }
+#else
+        for (int i = 0; i < WORDS; i++)
+        {
+            if(m_bits[i])
+            {
+                return true;
+            }
+        }
+#endif
+        return false;
+    }
+
+    inline bool operator & (const StaticBitset& rhs) const
+    {
+#if defined(__AVX512F__)
+        for (int i = 0; i < WORDS; i += 8)
+        {
+            __m512i a = _mm512_load_si512((const void*) (m_bits + i));
+            __m512i b = _mm512_load_si512((const void*) (rhs.m_bits + i));
+            if(_mm512_test_epi64_mask(a, b))
+            {
+                return true;
+            }
+        }
+#elif defined(__AVX2__)
+        for (int i = 0; i < WORDS; i += 4)
+        {
+            __m256i a = _mm256_load_si256((const __m256i*) (m_bits + i));
+            __m256i b = _mm256_load_si256((const __m256i*) (rhs.m_bits + i));
+            if(!_mm256_testz_si256(a, b))
+            {
+                return true;
+            }
+        }
+#else
+        for (int i = 0; i < WORDS; i++)
+        {
+            if(m_bits[i] & rhs.m_bits[i])
+            {
+                return true;
+            }
+        }
+#endif
+        return false;
+    }
+
+    inline void Set(int pos = -1)
+    {
+        if(pos >= 0)
+        {
+            m_bits[pos >> 6] |= ((uint64_t) 1) << (pos & 63);
+        }
+        else
+        {
+            memset(m_bits, ~0, sizeof(m_bits));
+        }
+    }
+
+    inline void Reset(int pos = -1)
+    {
+        if(pos >= 0)
+        {
+            m_bits[pos >> 6] &= ~(((uint64_t) 1) << (pos & 63));
+        }
+        else
+        {
+            memset(m_bits, 0, sizeof(m_bits));
+        }
+    }
+
+private:
+    alignas(64) uint64_t m_bits[WORDS];
+};
+
+//Most resources a bitset type can hold
+template<typename BitsetType>
+struct BitsetCapacity
+{
+    static const int value = 0x7fffffff;  //Bitset is sized at run time
+};
+
+template<int N>
+struct BitsetCapacity<StaticBitset<N> >
+{
+    static const int value = N;
+};
+
 #endif //_BITSET_INCLUDED_
 
@@ -11,11 +11,179 @@
 #include <cassert>
 #include <cstdint>
 #include <thread>
+#include <climits>
 #include "bitset.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__) && !defined(__cpp_lib_atomic_wait)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+//------------------------------------------------------------------------------
+//
+//     Wait policies
+//
+//     Lock waits while the ring is full and while an earlier cell conflicts.
+//     A policy object lives for one Lock call: Wait is called once per failed
+//     check (Reset after progress), Watch reads the event word before a check and
+//     Notify is called by every Unlock after it released and dequeued its cells.
+//
+//     BackoffWait   pause, doubling the pauses up to 2^MAX_ROUNDS
+//     YieldWait     BackoffWait, then std::this_thread::yield (the default)
+//     ParkWait      YieldWait, then sleeps on the event word (atomic::wait or futex)
+//
+//------------------------------------------------------------------------------
+
+inline void MRLockPause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+class BackoffWait
+{
+public:
+    static const uint32_t MAX_ROUNDS = 10;
+
+    BackoffWait() : m_rounds(0)
+    {}
+
+    static inline uint32_t Watch(const std::atomic<uint32_t>& /*event*/)
+    {
+        return 0;
+    }
+
+    static inline void Notify(std::atomic<uint32_t>& /*event*/)
+    {}
+
+    inline void Reset()
+    {
+        m_rounds = 0;
+    }
+
+    inline void Wait(std::atomic<uint32_t>& /*event*/, uint32_t /*seen*/)
+    {
+        Backoff();
+    }
+
+protected:
+    //Returns false without pausing once the backoff is exhausted
+    inline bool Backoff()
+    {
+        if(m_rounds > MAX_ROUNDS)
+        {
+            return false;
+        }
+        uint32_t pauses = 1u << (m_rounds < MAX_ROUNDS ? m_rounds : MAX_ROUNDS);
+        for(uint32_t i = 0; i < pauses; i++)
+        {
+            MRLockPause();
+        }
+        m_rounds++;
+        return true;
+    }
+
+    uint32_t m_rounds;
+};
+
+class YieldWait : public BackoffWait
+{
+public:
+    inline void Wait(std::atomic<uint32_t>& /*event*/, uint32_t /*seen*/)
+    {
+        if(!Backoff())
+        {
+            std::this_thread::yield();
+        }
+    }
+};
+
+class ParkWait : public BackoffWait
+{
+public:
+    static const uint32_t MAX_YIELDS = 16;
+
+    ParkWait() : m_yields(0)
+    {}
+
+    //Bit 0 of the event word is set while a thread may be parked, Notify adds 2
+    static inline uint32_t Watch(const std::atomic<uint32_t>& event)
+    {
+        return event.load(std::memory_order_seq_cst);
+    }
+
+    static inline void Notify(std::atomic<uint32_t>& event)
+    {
+        uint32_t old = event.fetch_add(2, std::memory_order_seq_cst);
+        if(old & 1)
+        {
+            event.fetch_and(~1u, std::memory_order_seq_cst);
+            Wake(event);
+        }
+    }
+
+    inline void Reset()
+    {
+        m_rounds = 0;
+        m_yields = 0;
+    }
+
+    inline void Wait(std::atomic<uint32_t>& event, uint32_t seen)
+    {
+        if(Backoff())
+        {
+            return;
+        }
+        if(m_yields < MAX_YIELDS)
+        {
+            m_yields++;
+            std::this_thread::yield();
+            return;
+        }
+
+        //Any Notify since seen changed the word, so the sleep below returns at once
+        uint32_t current = event.fetch_or(1, std::memory_order_seq_cst) | 1;
+        if(current != (seen | 1))
+        {
+            return;
+        }
+        Park(event, current);
+    }
+
+private:
+    static inline void Park(std::atomic<uint32_t>& event, uint32_t expected)
+    {
+#if defined(__cpp_lib_atomic_wait)
+        event.wait(expected, std::memory_order_seq_cst);
+#elif defined(__linux__)
+        syscall(SYS_futex, (uint32_t*) &event, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static inline void Wake(std::atomic<uint32_t>& event)
+    {
+#if defined(__cpp_lib_atomic_wait)
+        event.notify_all();
+#elif defined(__linux__)
+        syscall(SYS_futex, (uint32_t*) &event, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    uint32_t m_yields;
+};
+
 //A bit of hack to initialize the bitset class
 template<typename BitsetType>
-inline void InitializeBitset(BitsetType& b, uint32_t r)
+inline void InitializeBitset(BitsetType& /*b*/, uint32_t /*r*/)
 {}
 
 template<>
@@ -24,16 +192,18 @@ inline void InitializeBitset<Bitset>(Bitset& b, uint32_t r)
     b.Resize(r);
 }
 
-template<typename BitsetType>
+template<typename BitsetType, typename WaitPolicy = YieldWait>
 class MRLock
 {
 public:
-    MRLock(uint32_t resources)
+    //capacity is the number of requests that can be queued at once, threads beyond it wait
+    //for a free cell, 0 uses std::thread::hardware_concurrency()
+    MRLock(uint32_t resources, uint32_t capacity = 0)
     {
         //We are using mask to wrap the index around cicular array,
         //so the buffer size should be the power of 2
-        //We set buffer size equal to or greater than the std::thread::hardware_concurrency()
-        uint32_t maxThreads = std::thread::hardware_concurrency(); 
+        //We set buffer size greater than the capacity
+        uint32_t maxThreads = (capacity > 0) ? capacity : std::thread::hardware_concurrency(); 
         uint32_t bufferSize = 2;
         while(bufferSize <= maxThreads)
         {
@@ -58,6 +228,12 @@ public:
 
         m_head.store(0, std::memory_order_relaxed);
         m_tail.store(0, std::memory_order_relaxed);
+        m_event.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t Capacity() const
+    {
+        return m_bufferMask + 1;
     }
 
     ~MRLock()
@@ -68,13 +244,15 @@ public:
     inline uint32_t Lock(const BitsetType& resources)
     {
         //Enqueue the resource request at the tail
-        //If the queue is full, busy wait at the end
+        //If the queue is full, wait at the end
         //So the capacity of the queue actually determine the FIFO fairness
         Cell* cell;
         uint32_t pos;
+        WaitPolicy wait;
 
         for(;;)
         {
+            uint32_t seen = WaitPolicy::Watch(m_event);
             pos = m_tail.load(std::memory_order_relaxed);
             cell = &m_buffer[pos & m_bufferMask];
             uint32_t seq = cell->m_sequence.load(std::memory_order_acquire);
@@ -87,15 +265,22 @@ public:
                     break;
                 }
             }
+            else if(dif < 0)
+            {
+                //The ring is full, the cell is freed by the Unlock that dequeues it
+                wait.Wait(m_event, seen);
+            }
         }
 
         cell->m_bits = resources;
         cell->m_sequence.store(pos + 1, std::memory_order_release);
 
         //Spin on all previsou locks 
+        wait.Reset();
         uint32_t spinPos = m_head;
         while(spinPos != pos)
         {
+            uint32_t seen = WaitPolicy::Watch(m_event);
             //We start from the head moving toward my pos, spin on cell that collide with my request
             //When that cell is freed we move on to the next one util reaching myself
             //we need to check both m_sequence and m_bits, because either of them could be set to 
@@ -104,6 +289,11 @@ public:
                     || !(m_buffer[spinPos & m_bufferMask].m_bits & resources))
             {
                 spinPos++;
+                wait.Reset();
+            }
+            else
+            {
+                wait.Wait(m_event, seen);
             }
         }
 
@@ -111,11 +301,43 @@ public:
         return pos;
     }
 
+    //Lock for a caller inside a hardware transaction, it never waits
+    //Returns false if the ring is full or an earlier cell conflicts, the caller then has to abort
+    //the transaction, which also takes back the enqueue (MRLockDurableSet with ELISION_RTM)
+    //The transaction makes the check of the tail and its store one step, so no CAS is needed
+    inline bool LockInTransaction(const BitsetType& resources, uint32_t* handle)
+    {
+        uint32_t pos = m_tail.load(std::memory_order_relaxed);
+        Cell* cell = &m_buffer[pos & m_bufferMask];
+        if(cell->m_sequence.load(std::memory_order_acquire) != pos)
+        {
+            return false;
+        }
+        m_tail.store(pos + 1, std::memory_order_relaxed);
+        cell->m_bits = resources;
+        cell->m_sequence.store(pos + 1, std::memory_order_release);
+        for(uint32_t spinPos = m_head; spinPos != pos; spinPos++)
+        {
+            if(pos - m_buffer[spinPos & m_bufferMask].m_sequence <= m_bufferMask 
+                    && (m_buffer[spinPos & m_bufferMask].m_bits & resources))
+            {
+                return false;
+            }
+        }
+        *handle = pos;
+        return true;
+    }
+
     inline void Unlock(uint32_t handle)
     {
         //Release my lock by setting the bits to 0
         m_buffer[handle & m_bufferMask].m_bits = 0;
 
+        //The release has to be visible before m_head is read, and a dequeuer has to read the
+        //bits after it moved m_head, otherwise both can miss the released cell and it stays
+        //queued forever (store buffering)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
         //Dequeue cells that have been released
         uint32_t pos = m_head.load(std::memory_order_relaxed);
         while(!m_buffer[pos & m_bufferMask].m_bits)
@@ -130,11 +352,15 @@ public:
                 {
                     cell->m_bits = ~0;
                     cell->m_sequence.store(pos + m_bufferMask + 1, std::memory_order_release);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
                 }
             }
 
             pos = m_head.load(std::memory_order_relaxed);
         }
+
+        //Wakes the waiters of the released and dequeued cells
+        WaitPolicy::Notify(m_event);
     }
 
 private:
@@ -158,6 +384,10 @@ private:
 
     char m_pad2[CACHELINE_SIZE - sizeof(std::atomic<uint32_t>)];
     std::atomic<uint32_t> m_tail;
+
+    //Changed by every Unlock (ParkWait only)
+    char m_pad3[CACHELINE_SIZE - sizeof(std::atomic<uint32_t>)];
+    std::atomic<uint32_t> m_event;
 };
 
 #endif //_CONCEPT_MRLOCK_INCLUDED_